@@ -0,0 +1,275 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#include "analyze.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <core/vector.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MODULE_NAME "analyze"
+
+/* The number of sub-histograms used by `analyze_histogram` */
+#define ANALYZE_N_SUBHISTS 4
+
+/* The histogram kernel works on stripes of this many bytes */
+#define ANALYZE_STRIPE_SIZE 64
+
+/* Above this entropy (in bits per byte), data is most likely
+ * compressed or encrypted */
+#define ANALYZE_HIGH_ENTROPY 7.5
+
+/* Above this fill ratio, a partition is mostly padding */
+#define ANALYZE_HIGH_FILL 0.9
+
+/* The number of values per line in the verbose output */
+#define ANALYZE_VALUES_PER_LINE 16
+
+static f64 entropy_u32(const u32 hist[ANALYZE_N_BYTE_VALUES], u64 n);
+static f64 entropy_u64(const u64 hist[ANALYZE_N_BYTE_VALUES], u64 n);
+
+void part_analysis_init(struct part_analysis *a, u64 size)
+{
+    u_check_params(a != NULL);
+    memset(a, 0, sizeof(struct part_analysis));
+    a->max_bytes = size;
+    a->block_entropies = vector_new(f32);
+}
+
+void part_analysis_update(struct part_analysis *a, const u8 *data, u64 len)
+{
+    u_check_params(a != NULL && (data != NULL || len == 0));
+
+    const u64 n_fed = a->n_bytes + a->block_len;
+    len = n_fed < a->max_bytes ? u_min(len, a->max_bytes - n_fed) : 0;
+    while (len > 0) {
+        const u32 n = u_min(ANALYZE_BLOCK_SIZE - a->block_len, len);
+        analyze_histogram(a->block_hist, data, n);
+        a->block_len += n;
+        data += n;
+        len -= n;
+
+        if (a->block_len == ANALYZE_BLOCK_SIZE) {
+            part_analysis_add_block(a, a->block_hist, a->block_len);
+            memset(a->block_hist, 0, sizeof(a->block_hist));
+            a->block_len = 0;
+        }
+    }
+}
+
+void part_analysis_add_block(struct part_analysis *a,
+    const u32 hist[ANALYZE_N_BYTE_VALUES], u32 len)
+{
+    u_check_params(a != NULL && hist != NULL && len <= ANALYZE_BLOCK_SIZE);
+    if (len == 0)
+        return;
+
+    for (u32 i = 0; i < ANALYZE_N_BYTE_VALUES; i++)
+        a->hist[i] += hist[i];
+    a->n_bytes += len;
+
+    vector_push_back(&a->block_entropies, (f32)entropy_u32(hist, len));
+}
+
+void part_analysis_finish(struct part_analysis *a)
+{
+    u_check_params(a != NULL);
+
+    part_analysis_add_block(a, a->block_hist, a->block_len);
+    memset(a->block_hist, 0, sizeof(a->block_hist));
+    a->block_len = 0;
+}
+
+void part_analysis_report(const struct part_analysis *a)
+{
+    u_check_params(a != NULL);
+
+    if (a->n_bytes == 0) {
+        s_log_info("Analysis: empty");
+        return;
+    }
+
+    const f64 entropy = entropy_u64(a->hist, a->n_bytes);
+    f32 min_block = 8.0f, max_block = 0.0f;
+    for (u64 i = 0; i < vector_size(a->block_entropies); i++) {
+        min_block = u_min(min_block, a->block_entropies[i]);
+        max_block = u_max(max_block, a->block_entropies[i]);
+    }
+    const f64 fill = (f64)(a->hist[0x00] + a->hist[0xFF]) / a->n_bytes;
+
+    const char *guess = "plain code or data";
+    if (fill >= ANALYZE_HIGH_FILL)
+        guess = "mostly padding";
+    else if (entropy >= ANALYZE_HIGH_ENTROPY)
+        guess = "likely compressed or encrypted";
+
+    s_log_info("Analysis: entropy %.3f bits/byte (blocks: %.3f - %.3f), "
+        "fill %.1f%% (0x00: %.1f%%, 0xFF: %.1f%%) - %s",
+        entropy, min_block, max_block, fill * 100.0,
+        a->hist[0x00] * 100.0 / a->n_bytes,
+        a->hist[0xFF] * 100.0 / a->n_bytes, guess);
+
+    /* The most common byte values, by repeated selection */
+    char line[256];
+    i32 line_len = snprintf(line, sizeof(line), "Most common bytes:");
+    bool taken[ANALYZE_N_BYTE_VALUES] = { 0 };
+    for (u32 n = 0; n < ANALYZE_N_TOP_BYTES; n++) {
+        u32 best = 0;
+        bool found = false;
+        for (u32 i = 0; i < ANALYZE_N_BYTE_VALUES; i++) {
+            if (!taken[i] && a->hist[i] > 0 &&
+                (!found || a->hist[i] > a->hist[best]))
+            {
+                best = i;
+                found = true;
+            }
+        }
+        if (!found)
+            break;
+
+        taken[best] = true;
+        line_len += snprintf(line + line_len, sizeof(line) - line_len,
+            "%s 0x%.2x (%.1f%%)", n > 0 ? "," : "",
+            best, a->hist[best] * 100.0 / a->n_bytes);
+    }
+    s_log_info("%s", line);
+
+    /* The details */
+    for (u64 i = 0; i < vector_size(a->block_entropies);
+        i += ANALYZE_VALUES_PER_LINE)
+    {
+        line_len = 0;
+        for (u64 j = i; j < vector_size(a->block_entropies) &&
+            j < i + ANALYZE_VALUES_PER_LINE; j++)
+        {
+            line_len += snprintf(line + line_len, sizeof(line) - line_len,
+                " %.2f", a->block_entropies[j]);
+        }
+        s_log_verbose("Block entropy @ %#llx:%s",
+            (unsigned long long)(i * ANALYZE_BLOCK_SIZE), line);
+    }
+    for (u32 i = 0; i < ANALYZE_N_BYTE_VALUES; i += ANALYZE_VALUES_PER_LINE) {
+        line_len = 0;
+        for (u32 j = i; j < i + ANALYZE_VALUES_PER_LINE; j++) {
+            line_len += snprintf(line + line_len, sizeof(line) - line_len,
+                " %llu", (unsigned long long)a->hist[j]);
+        }
+        s_log_verbose("Histogram 0x%.2x-0x%.2x:%s",
+            i, i + ANALYZE_VALUES_PER_LINE - 1, line);
+    }
+}
+
+void part_analysis_destroy(struct part_analysis *a)
+{
+    if (a == NULL || a->block_entropies == NULL)
+        return;
+
+    vector_destroy(&a->block_entropies);
+}
+
+/* Returns whether the `ANALYZE_STRIPE_SIZE` bytes at `p` are all equal */
+static inline bool is_uniform_stripe(const u8 *p)
+{
+#if defined(__SSE2__)
+    const __m128i b = _mm_set1_epi8((char)p[0]);
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), b);
+    for (u32 i = 1; i < ANALYZE_STRIPE_SIZE / 16; i++) {
+        eq = _mm_and_si128(eq,
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p + i), b));
+    }
+    return _mm_movemask_epi8(eq) == 0xFFFF;
+#else
+    const u64 b = p[0] * 0x0101010101010101ULL;
+    u64 diff = 0;
+    for (u32 i = 0; i < ANALYZE_STRIPE_SIZE / sizeof(u64); i++) {
+        u64 v;
+        memcpy(&v, p + i * sizeof(u64), sizeof(u64));
+        diff |= v ^ b;
+    }
+    return diff == 0;
+#endif /* __SSE2__ */
+}
+
+void analyze_histogram(u32 hist[ANALYZE_N_BYTE_VALUES],
+    const u8 *data, u64 len)
+{
+    u_check_params(hist != NULL && (data != NULL || len == 0));
+
+    /* Consecutive bytes are counted in different sub-histograms,
+     * so that runs of equal bytes don't stall on reloading a counter
+     * that was only just stored (store-to-load forwarding) */
+    u32 sub[ANALYZE_N_SUBHISTS][ANALYZE_N_BYTE_VALUES];
+    memset(sub, 0, sizeof(sub));
+
+    u64 i = 0;
+    for (; i + ANALYZE_STRIPE_SIZE <= len; i += ANALYZE_STRIPE_SIZE) {
+        const u8 *p = data + i;
+
+        /* Padding and fill areas are counted a whole stripe at a time */
+        if (is_uniform_stripe(p)) {
+            sub[0][p[0]] += ANALYZE_STRIPE_SIZE;
+            continue;
+        }
+
+        for (u32 j = 0; j < ANALYZE_STRIPE_SIZE; j += sizeof(u64)) {
+            u64 v;
+            memcpy(&v, p + j, sizeof(u64));
+            sub[0][(u8)(v >> 0)]++;
+            sub[1][(u8)(v >> 8)]++;
+            sub[2][(u8)(v >> 16)]++;
+            sub[3][(u8)(v >> 24)]++;
+            sub[0][(u8)(v >> 32)]++;
+            sub[1][(u8)(v >> 40)]++;
+            sub[2][(u8)(v >> 48)]++;
+            sub[3][(u8)(v >> 56)]++;
+        }
+    }
+    for (; i < len; i++)
+        sub[i % ANALYZE_N_SUBHISTS][data[i]]++;
+
+    /* Vectorized by the compiler */
+    for (u32 b = 0; b < ANALYZE_N_BYTE_VALUES; b++)
+        hist[b] += sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+}
+
+static f64 entropy_u32(const u32 hist[ANALYZE_N_BYTE_VALUES], u64 n)
+{
+    f64 sum = 0.0;
+    for (u32 i = 0; i < ANALYZE_N_BYTE_VALUES; i++) {
+        if (hist[i] > 0)
+            sum += hist[i] * log2((f64)hist[i]);
+    }
+    /* H = -sum(p * log2(p)) = log2(n) - sum(c * log2(c)) / n,
+     * which can come out as a tiny negative number for uniform data */
+    return u_max(0.0, log2((f64)n) - sum / n);
+}
+
+static f64 entropy_u64(const u64 hist[ANALYZE_N_BYTE_VALUES], u64 n)
+{
+    f64 sum = 0.0;
+    for (u32 i = 0; i < ANALYZE_N_BYTE_VALUES; i++) {
+        if (hist[i] > 0)
+            sum += hist[i] * log2((f64)hist[i]);
+    }
+    return u_max(0.0, log2((f64)n) - sum / n);
+}
@@ -0,0 +1,85 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef ANALYZE_H_
+#define ANALYZE_H_
+
+#include <core/int.h>
+#include <core/vector.h>
+
+/* Partition content analysis (`--analyze`).
+ *
+ * For every partition, the Shannon entropy (in bits per byte) of each
+ * `ANALYZE_BLOCK_SIZE` block and of the whole body, the byte histogram
+ * and the fill ratio (the share of 0x00 and 0xFF bytes) are computed,
+ * which is usually enough to tell encrypted or compressed images
+ * from plain code and from padding.
+ *
+ * The analysis is fed with the data that's already being read anyway
+ * (the extraction copy loop, or the `--diff` block hashing tasks),
+ * so it doesn't cost any extra I/O. */
+
+/* The granularity of the per-block entropy.
+ * Matches `DIFF_BLOCK_SIZE`, so that `--diff` can share its blocks. */
+#define ANALYZE_BLOCK_SIZE (64 * 1024)
+
+#define ANALYZE_N_BYTE_VALUES 256
+
+/* The number of most common byte values printed per partition */
+#define ANALYZE_N_TOP_BYTES 4
+
+struct part_analysis {
+    u64 hist[ANALYZE_N_BYTE_VALUES];
+    u64 n_bytes;
+
+    /* Any bytes fed past this (alignment padding) are ignored */
+    u64 max_bytes;
+
+    /* The entropy of every complete (and the last incomplete) block */
+    VECTOR(f32) block_entropies;
+
+    /* The histogram of the block being filled by `part_analysis_update` */
+    u32 block_hist[ANALYZE_N_BYTE_VALUES];
+    u32 block_len;
+};
+
+/* Prepares `a` for a body of `size` bytes */
+void part_analysis_init(struct part_analysis *a, u64 size);
+
+/* Adds the next `len` bytes of the body to `a` */
+void part_analysis_update(struct part_analysis *a, const u8 *data, u64 len);
+
+/* Adds the next block of `len` bytes (at most `ANALYZE_BLOCK_SIZE`,
+ * and less only for the last block), whose histogram is `hist`, to `a`.
+ * Can't be mixed with `part_analysis_update`. */
+void part_analysis_add_block(struct part_analysis *a,
+    const u32 hist[ANALYZE_N_BYTE_VALUES], u32 len);
+
+/* Accounts for the last, incomplete block (if any) */
+void part_analysis_finish(struct part_analysis *a);
+
+/* Logs the results. The per-block entropies and the full histogram
+ * are only logged at the verbose level. */
+void part_analysis_report(const struct part_analysis *a);
+
+void part_analysis_destroy(struct part_analysis *a);
+
+/* Adds the histogram of the `len` bytes at `data` to `hist`.
+ * `len` must fit in a `u32`. */
+void analyze_histogram(u32 hist[ANALYZE_N_BYTE_VALUES],
+    const u8 *data, u64 len);
+
+#endif /* ANALYZE_H_ */
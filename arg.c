@@ -21,12 +21,20 @@
 #include <core/int.h>
 #include <core/util.h>
 #include <core/vector.h>
+#include <stdio.h>
 #include <string.h>
 
 #define MODULE_NAME "arg"
 
+#define X_(name, short, long, value, desc) value,
+static const char *const g_value_names[ARG_MAX_] = {
+    ARG_OPTIONS_LIST
+};
+#undef X_
+
 i32 arg_parse(i32 argc, char **argv,
-    VECTOR(const char *) *o_file_paths, u32 *o_flags)
+    VECTOR(const char *) *o_file_paths, u32 *o_flags,
+    const char *o_values[ARG_MAX_])
 {
     if (argc <= 1) {
         s_log_error("Not enough arguments");
@@ -53,19 +61,38 @@ i32 arg_parse(i32 argc, char **argv,
 
         /* Long (`--`) option */
         if (argv[i][1] == '-') {
-#define X_(name, short, long, desc) "--"long,
+#define X_(name, short, long, value, desc) "--"long,
             static const char *long_opts[ARG_MAX_] = {
                 ARG_OPTIONS_LIST
             };
 #undef X_
 
+            /* Split `--option=value` */
+            const char *eq = strchr(argv[i], '=');
+            const size_t name_len = eq ? (size_t)(eq - argv[i])
+                : strlen(argv[i]);
+
             bool found = false;
             for (u32 opt = 0; opt < ARG_MAX_; opt++) {
-                if (!strcmp(argv[i], long_opts[opt])) {
-                    *o_flags |= 1 << opt; /* ARG_FLAG_... */
-                    found = true;
-                    break;
+                if (strlen(long_opts[opt]) != name_len ||
+                    strncmp(argv[i], long_opts[opt], name_len))
+                    continue;
+
+                if (g_value_names[opt] == NULL && eq != NULL) {
+                    goto_error("Option \"%s\" doesn't take a value",
+                        long_opts[opt]);
+                } else if (g_value_names[opt] != NULL && eq != NULL) {
+                    o_values[opt] = eq + 1;
+                } else if (g_value_names[opt] != NULL) {
+                    if (i + 1 >= argc || argv[i + 1] == NULL)
+                        goto_error("Option \"%s\" requires a value (%s)",
+                            long_opts[opt], g_value_names[opt]);
+                    o_values[opt] = argv[++i];
                 }
+
+                *o_flags |= 1 << opt; /* ARG_FLAG_... */
+                found = true;
+                break;
             }
 
             if (!found)
@@ -78,26 +105,47 @@ i32 arg_parse(i32 argc, char **argv,
             (second_char >= 'A' && second_char <= 'Z') ||
             (second_char >= '0' && second_char <= '9')
         ) {
-            for (char *chr_p = &argv[i][1]; *chr_p != '\0'; chr_p++) {
+            const i32 arg_index = i;
+            for (char *chr_p = &argv[arg_index][1]; *chr_p != '\0'; chr_p++) {
                 /* We can't use a switch/case here due to the preprocessor's
                  * limitations (can't expand >c< into char literal >'c'<). */
 
-#define X_(name, short, long, desc) #short,
+#define X_(name, short, long, value, desc) #short,
                 static const char *short_opts[ARG_MAX_] = {
                     ARG_OPTIONS_LIST
                 };
 #undef X_
                 bool found = false;
+                bool consumed_rest = false;
                 for (u32 opt = 0; opt < ARG_MAX_; opt++) {
-                    if (*chr_p == short_opts[opt][0]) {
-                        *o_flags |= 1 << opt; /* ARG_FLAG_... */
-                        found = true;
-                        break;
+                    /* `_` means that the option has no short form */
+                    if (*chr_p == '_' || *chr_p != short_opts[opt][0])
+                        continue;
+
+                    /* An option with a value must be the last one in a group;
+                     * the value is either the rest of the group (`-jN`)
+                     * or the next argument (`-j N`) */
+                    if (g_value_names[opt] != NULL) {
+                        if (chr_p[1] != '\0') {
+                            o_values[opt] = chr_p + 1;
+                        } else if (i + 1 < argc && argv[i + 1] != NULL) {
+                            o_values[opt] = argv[++i];
+                        } else {
+                            goto_error("Option \"-%c\" requires a value (%s)",
+                                *chr_p, g_value_names[opt]);
+                        }
+                        consumed_rest = true;
                     }
+
+                    *o_flags |= 1 << opt; /* ARG_FLAG_... */
+                    found = true;
+                    break;
                 }
 
                 if (!found)
                     goto_error("Unknown option \"-%c\"", *chr_p);
+                if (consumed_rest)
+                    break;
             }
         }
 
@@ -114,10 +162,37 @@ err:
 
 const char *arg_get_help_options_string(void)
 {
-    return "Available options:\n"
-#define X_(name, short, long, desc) \
-    "    " "-"#short", --"long": "desc"\n"
+    /* Built on the first call, because the options without a short form
+     * or with a value can't be formatted with plain string concatenation */
+    static char help_buf[4096] = { 0 };
+    if (help_buf[0] != '\0')
+        return help_buf;
+
+#define X_(name, short, long, value, desc) { #short, long, value, desc },
+    static const struct {
+        const char *short_name, *long_name, *value, *desc;
+    } opts[ARG_MAX_] = {
         ARG_OPTIONS_LIST
+    };
 #undef X_
-        ;
+
+    u32 len = snprintf(help_buf, sizeof(help_buf), "Available options:\n");
+    for (u32 i = 0; i < ARG_MAX_ && len < sizeof(help_buf); i++) {
+        char short_buf[8] = "   ";
+        if (opts[i].short_name[0] != '_')
+            (void) snprintf(short_buf, sizeof(short_buf), "-%s,",
+                opts[i].short_name);
+
+        const i32 ret = snprintf(help_buf + len, sizeof(help_buf) - len,
+            "    %s --%s%s%s: %s\n",
+            short_buf, opts[i].long_name,
+            opts[i].value ? " " : "", opts[i].value ? opts[i].value : "",
+            opts[i].desc
+        );
+        if (ret < 0)
+            break;
+        len += ret;
+    }
+
+    return help_buf;
 }
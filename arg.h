@@ -20,29 +20,85 @@
 #include <core/int.h>
 #include <core/vector.h>
 
+/* X_(name, short, long, value, description)
+ * `short` is the single-character short option name, or `_` if there is none.
+ * `value` is the name of the option's value shown in the help message,
+ * or `NULL` if the option doesn't take one. */
 #define ARG_OPTIONS_LIST                                                       \
-    X_(HELP, h, "help", "Show this message and exit")                          \
-    X_(VERSION, V, "version", "Print the program version and exit")            \
-    X_(VERBOSE, v, "verbose", "Enable verbose logging")                        \
-    X_(CHAIN, c, "chain", "Process all headers found in a header chain")       \
-    X_(SAVE_HDR, s, "save-headers", "Save binary header contents to disk")     \
-    X_(EXTRACT_PART, e, "extract-parts", "Extract binary partition contents")  \
-
-#define X_(name, short, long, desc) ARG_OPT_##name,
+    X_(HELP, h, "help", NULL, "Show this message and exit")                    \
+    X_(VERSION, V, "version", NULL, "Print the program version and exit")      \
+    X_(VERBOSE, v, "verbose", NULL, "Enable verbose logging")                  \
+    X_(CHAIN, c, "chain", NULL, "Process all headers found in a header chain") \
+    X_(SAVE_HDR, s, "save-headers", NULL, "Save binary header contents to disk")\
+    X_(EXTRACT_PART, e, "extract-parts", NULL,                                 \
+        "Extract binary partition contents")                                   \
+    X_(STATS, S, "stats", NULL, "Print I/O and per-phase timing statistics")   \
+    X_(TRACE_OUT, _, "trace-out", "FILE",                                      \
+        "Write a Chrome trace (JSON) of the run to FILE")                      \
+    X_(ONLY, o, "only", "NAME[,NAME...]",                                      \
+        "Only process partitions with matching names (globs allowed)")         \
+    X_(TYPE, t, "type", "TYPE[,TYPE...]",                                      \
+        "Only process partitions of the given IMG_TYPE_* types")               \
+    X_(OUTDIR, d, "outdir", "DIR",                                             \
+        "Write the outputs to DIR/<input file name>/ instead of the CWD")      \
+    X_(HUGE_PAGES, _, "huge-pages", NULL,                                      \
+        "Back the I/O buffers with huge pages")                                \
+    X_(VERIFY, _, "verify", NULL,                                              \
+        "Validate the header chains instead of dumping them")                  \
+    X_(JOBS, j, "jobs", "N",                                                   \
+        "Number of worker threads (default: number of CPUs)")                  \
+    X_(PIN_THREADS, _, "pin-threads", NULL,                                    \
+        "Pin each worker thread to its own CPU")                               \
+    X_(RECURSIVE, r, "recursive", NULL,                                        \
+        "Search directories recursively for MTK partition files")              \
+    X_(WATCH, _, "watch", "DIR",                                               \
+        "Keep processing new files as they appear in DIR until interrupted")   \
+    X_(SERVE, _, "serve", "SOCKET",                                            \
+        "Answer list/extract/verify requests on a Unix socket")                \
+    X_(DIFF, _, "diff", NULL,                                                  \
+        "Compare the chains of two files (OLD NEW) entry by entry")            \
+    X_(ANALYZE, _, "analyze", NULL,                                            \
+        "Print the entropy, byte histogram and fill ratio of each partition")  \
+    X_(RECURSE_PAYLOADS, _, "recurse-payloads", NULL,                          \
+        "Look for nested payloads in the partitions and walk nested chains")   \
+    X_(TAR, _, "tar", "FILE",                                                  \
+        "Write the outputs of -e/-s as a tar stream to FILE (- for stdout)")   \
+    X_(CAT, _, "cat", "NAME|INDEX",                                            \
+        "Write the body of the partition NAME (or no. INDEX) to stdout")       \
+    X_(CACHE_FRIENDLY, _, "cache-friendly", NULL,                              \
+        "Keep the data read and written out of the page cache (fadvise)")      \
+    X_(MEM_LIMIT, _, "mem-limit", "SIZE",                                      \
+        "Limit all the I/O buffers to SIZE bytes in total (K/M/G suffixes)")   \
+    X_(RESYNC, _, "resync", NULL,                                              \
+        "On a broken chain, look for the next valid header and continue")      \
+
+#define X_(name, short, long, value, desc) ARG_OPT_##name,
 enum mtkpartdump_arg_options {
     ARG_OPTIONS_LIST
     ARG_MAX_
 };
 #undef X_
 
-#define X_(name, short, long, decs) ARG_FLAG_##name = 1 << ARG_OPT_##name,
+#define X_(name, short, long, value, decs) ARG_FLAG_##name = 1 << ARG_OPT_##name,
 enum mtkpartdump_arg_option_flags {
     ARG_OPTIONS_LIST
 };
 #undef X_
 
+/* Parses the command line.
+ * Non-option arguments are appended to `*o_file_paths`,
+ * the flags of all the options found are OR'd into `*o_flags`,
+ * and for the options that take a value, the value is stored
+ * in `o_values[ARG_OPT_...]` (the last occurrence wins).
+ *
+ * Option values can be given either as the next argument
+ * (`--trace-out out.json`) or, for long options, after an `=` sign
+ * (`--trace-out=out.json`).
+ *
+ * Returns 0 on success and non-zero on failure. */
 i32 arg_parse(i32 argc, char **argv,
-    VECTOR(const char *) *o_file_paths, u32 *o_flags);
+    VECTOR(const char *) *o_file_paths, u32 *o_flags,
+    const char *o_values[ARG_MAX_]);
 
 const char * arg_get_help_options_string(void);
 
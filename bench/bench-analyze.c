@@ -0,0 +1,118 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include "../analyze.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-analyze - the `--analyze` byte histogram kernel.
+ *
+ * Compares `analyze_histogram` (sub-histograms, whole-stripe counting
+ * of uniform runs) with the plain one-counter-per-byte loop
+ * on random data, code-like data (many repeated bytes, like zeros
+ * in x86 or ARM instructions) and padding. Both histograms are
+ * compared for every case, so a broken kernel fails the benchmark. */
+
+#define BUF_SIZE (16 * 1024 * 1024)
+
+enum data_kind {
+    DATA_RANDOM,
+    DATA_CODE,
+    DATA_PADDING,
+};
+
+static void fill_data(u8 *buf, u64 size, enum data_kind kind)
+{
+    u64 x = 0x9e3779b97f4a7c15ULL;
+    for (u64 i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        switch (kind) {
+        case DATA_RANDOM: buf[i] = (u8)x; break;
+        /* About a third zeros, the rest from a small alphabet */
+        case DATA_CODE: buf[i] = (x % 3 == 0) ? 0 : (u8)(x >> 8) & 0x3F; break;
+        case DATA_PADDING: buf[i] = (i & (1 << 20)) ? 0xFF : 0x00; break;
+        }
+    }
+}
+
+static void naive_histogram(u32 hist[ANALYZE_N_BYTE_VALUES],
+    const u8 *data, u64 len)
+{
+    for (u64 i = 0; i < len; i++)
+        hist[data[i]]++;
+}
+
+static void run_case(const char *name, const u8 *buf, u64 n_passes)
+{
+    static u32 naive[ANALYZE_N_BYTE_VALUES], fast[ANALYZE_N_BYTE_VALUES];
+    memset(naive, 0, sizeof(naive));
+    memset(fast, 0, sizeof(fast));
+
+    /* In `ANALYZE_BLOCK_SIZE` pieces, just like `--analyze` does it */
+    f64 start = bench_now();
+    for (u64 pass = 0; pass < n_passes; pass++) {
+        for (u64 off = 0; off < BUF_SIZE; off += ANALYZE_BLOCK_SIZE)
+            naive_histogram(naive, buf + off, ANALYZE_BLOCK_SIZE);
+    }
+    const f64 t_naive = bench_now() - start;
+
+    start = bench_now();
+    for (u64 pass = 0; pass < n_passes; pass++) {
+        for (u64 off = 0; off < BUF_SIZE; off += ANALYZE_BLOCK_SIZE)
+            analyze_histogram(fast, buf + off, ANALYZE_BLOCK_SIZE);
+    }
+    const f64 t_fast = bench_now() - start;
+
+    if (memcmp(naive, fast, sizeof(naive))) {
+        fprintf(stderr, "bench-analyze: histogram mismatch (%s)\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    const f64 n_bytes = (f64)BUF_SIZE * n_passes;
+    bench_report("analyze", name,
+        "\"bytes\":%.0f,\"naive_gb_per_s\":%.2f,\"kernel_gb_per_s\":%.2f",
+        n_bytes, n_bytes / t_naive / 1e9, n_bytes / t_fast / 1e9);
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    u8 *buf = malloc(BUF_SIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "bench-analyze: malloc() failed\n");
+        return EXIT_FAILURE;
+    }
+
+    fill_data(buf, BUF_SIZE, DATA_RANDOM);
+    run_case("random", buf, 8 * scale);
+    fill_data(buf, BUF_SIZE, DATA_CODE);
+    run_case("code", buf, 8 * scale);
+    fill_data(buf, BUF_SIZE, DATA_PADDING);
+    run_case("padding", buf, 8 * scale);
+
+    free(buf);
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
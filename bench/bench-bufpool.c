@@ -0,0 +1,150 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include "../bufpool.h"
+#include "../stats.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-bufpool - I/O buffer pool borrow/return throughput.
+ *
+ * N threads each borrow a buffer `n_iters` times, touch it, and return it,
+ * with no budget and with budgets smaller than the number of threads
+ * (where borrowers have to wait for each other). Reports the borrows
+ * per second and the number of waits. The number of buffers held at once
+ * is tracked and checked against the budget. */
+
+struct pool_ctx {
+    u32 n_iters;
+    u64 max_bufs;
+    _Atomic u64 n_held;
+    _Atomic u64 max_held;
+};
+
+static void * worker(void *arg)
+{
+    struct pool_ctx *ctx = arg;
+
+    for (u32 i = 0; i < ctx->n_iters; i++) {
+        u8 *buf = bufpool_get();
+        if (buf == NULL) {
+            fprintf(stderr, "bench-bufpool: bufpool_get() failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        const u64 held = atomic_fetch_add(&ctx->n_held, 1) + 1;
+        u64 max = atomic_load(&ctx->max_held);
+        while (held > max &&
+            !atomic_compare_exchange_weak(&ctx->max_held, &max, held))
+            ;
+
+        buf[0] = (u8)i;
+        buf[BUFPOOL_BUF_SIZE - 1] = (u8)i;
+
+        atomic_fetch_sub(&ctx->n_held, 1);
+        bufpool_put(buf);
+    }
+
+    return NULL;
+}
+
+static void run_case(u32 n_threads, u64 max_bufs, u32 n_iters)
+{
+    struct pool_ctx ctx = { .n_iters = n_iters, .max_bufs = max_bufs };
+    if (bufpool_init(max_bufs * BUFPOOL_BUF_SIZE, false)) {
+        fprintf(stderr, "bench-bufpool: bufpool_init() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stats_snapshot before;
+    stats_snapshot(&before);
+
+    pthread_t threads[64];
+    const f64 start = bench_now();
+    for (u32 i = 0; i < n_threads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &ctx)) {
+            fprintf(stderr, "bench-bufpool: pthread_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (u32 i = 0; i < n_threads; i++)
+        (void) pthread_join(threads[i], NULL);
+    const f64 t = bench_now() - start;
+
+    struct stats_snapshot after;
+    stats_snapshot(&after);
+    bufpool_destroy();
+
+    const u64 max_held = atomic_load(&ctx.max_held);
+    if (max_bufs != 0 && max_held > max_bufs) {
+        fprintf(stderr, "bench-bufpool: %llu buffers held at once "
+            "with a budget of %llu\n", (unsigned long long)max_held,
+            (unsigned long long)max_bufs);
+        exit(EXIT_FAILURE);
+    }
+
+    char case_name[64];
+    if (max_bufs == 0) {
+        (void) snprintf(case_name, sizeof(case_name), "%ut-unlimited",
+            n_threads);
+    } else {
+        (void) snprintf(case_name, sizeof(case_name), "%ut-max%llu",
+            n_threads, (unsigned long long)max_bufs);
+    }
+    const u64 n_total = (u64)n_threads * n_iters;
+    bench_report("bufpool", case_name,
+        "\"threads\":%u,\"max_bufs\":%llu,\"borrows\":%llu,\"seconds\":%.6f,"
+        "\"mops_per_sec\":%.3f,\"waits\":%llu,\"max_held\":%llu",
+        n_threads, (unsigned long long)max_bufs,
+        (unsigned long long)n_total, t, (f64)n_total / t / 1e6,
+        (unsigned long long)(after.counters[STATS_BUFFER_WAITS]
+            - before.counters[STATS_BUFFER_WAITS]),
+        (unsigned long long)max_held
+    );
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) n_cpus = 1;
+    const u32 max_threads = (u32)(n_cpus > 16 ? 16 : n_cpus);
+    const u32 thread_counts[] = { 1, 4, max_threads * 2 };
+
+    for (u32 t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); t++) {
+        if (t > 0 && thread_counts[t] <= thread_counts[t - 1])
+            continue;
+
+        const u32 n_threads = thread_counts[t];
+        const u32 n_iters = (u32)(200000 * scale / n_threads);
+        run_case(n_threads, 0, n_iters);
+        run_case(n_threads, 1, n_iters);
+        if (n_threads > 2)
+            run_case(n_threads, n_threads / 2, n_iters);
+    }
+
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
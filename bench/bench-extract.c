@@ -0,0 +1,245 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include "corpus.h"
+#include <arg.h>
+#include <mtkparthdr.h>
+#include <mtkpartdump.h>
+#include <core/int.h>
+#include <core/log.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* bench-extract - extraction throughput per I/O engine.
+ *
+ * `mtkpartdump` is the actual `mtkpart_dump_file()` code path.
+ * The `raw-*` engines copy exactly the same byte ranges into the same
+ * output files using a minimal header walk, and serve as a reference
+ * for how fast the extraction could be with a given set of syscalls. */
+
+typedef i32 (*extract_engine_fn)(const char *in_path, i32 out_dirfd);
+
+static i32 engine_mtkpartdump(const char *in_path, i32 out_dirfd);
+static i32 engine_raw_pread_pwrite(const char *in_path, i32 out_dirfd);
+static i32 engine_raw_copy_file_range(const char *in_path, i32 out_dirfd);
+
+static const struct extract_engine {
+    const char *name;
+    extract_engine_fn fn;
+} g_engines[] = {
+    { "mtkpartdump", engine_mtkpartdump },
+    { "raw-pread-pwrite", engine_raw_pread_pwrite },
+    { "raw-copy_file_range", engine_raw_copy_file_range },
+};
+
+struct extract_case {
+    const char *name;
+    u32 n_entries;
+    u64 body_size;
+};
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    char tmpdir[256] = { 0 }, outdir[512] = { 0 }, in_path[512] = { 0 };
+    bench_make_tmpdir(tmpdir, sizeof(tmpdir));
+    (void) snprintf(in_path, sizeof(in_path), "%s/extract.bin", tmpdir);
+    (void) snprintf(outdir, sizeof(outdir), "%s/out", tmpdir);
+    if (mkdir(outdir, 0755)) {
+        fprintf(stderr, "Failed to create \"%s\": %s\n",
+            outdir, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const i32 out_dirfd = open(outdir, O_RDONLY | O_DIRECTORY);
+    if (out_dirfd < 0) {
+        fprintf(stderr, "Failed to open \"%s\": %s\n",
+            outdir, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    const struct extract_case cases[] = {
+        { "256x64K", 256 * scale, 64 * 1024 },
+        { "64x1M", 64 * scale, 1024 * 1024 },
+        { "4x32M", 4 * scale, 32 * 1024 * 1024 },
+    };
+    const u32 n_iterations = 3;
+
+    for (u32 i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        const struct extract_case *c = &cases[i];
+
+        struct corpus_params p = CORPUS_PARAMS_DEFAULT;
+        p.n_entries = c->n_entries;
+        p.min_size = p.max_size = c->body_size;
+        u64 total_bytes = 0;
+        if (corpus_generate(in_path, &p, &total_bytes))
+            return EXIT_FAILURE;
+
+        for (u32 e = 0; e < sizeof(g_engines) / sizeof(*g_engines); e++) {
+            const struct extract_engine *engine = &g_engines[e];
+
+            /* Warm-up run (also populates the page cache) */
+            if (engine->fn(in_path, out_dirfd)) {
+                fprintf(stderr, "Engine \"%s\" failed\n", engine->name);
+                return EXIT_FAILURE;
+            }
+            bench_clean_dir(outdir, false);
+
+            f64 t = 0.0;
+            for (u32 it = 0; it < n_iterations; it++) {
+                const f64 start = bench_now();
+                if (engine->fn(in_path, out_dirfd)) {
+                    fprintf(stderr, "Engine \"%s\" failed\n", engine->name);
+                    return EXIT_FAILURE;
+                }
+                t += bench_now() - start;
+                bench_clean_dir(outdir, false);
+            }
+
+            const u64 n_bytes = total_bytes * n_iterations;
+            bench_report("extract", c->name,
+                "\"engine\":\"%s\",\"bytes\":%llu,\"seconds\":%.6f,"
+                "\"gb_per_sec\":%.3f",
+                engine->name, (unsigned long long)n_bytes, t,
+                (f64)n_bytes / t / 1e9
+            );
+        }
+    }
+
+    close(out_dirfd);
+    bench_clean_dir(outdir, true);
+    bench_clean_dir(tmpdir, true);
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
+
+static i32 engine_mtkpartdump(const char *in_path, i32 out_dirfd)
+{
+    const i32 fd = open(in_path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    mtkpart_dump_file(fd, out_dirfd, &(struct mtkpart_dump_cfg) {
+        .flags = ARG_FLAG_CHAIN | ARG_FLAG_EXTRACT_PART,
+    });
+    close(fd);
+
+    return 0;
+}
+
+/* Walks the chain in `in_fd` and calls `copy_fn` for every body */
+typedef i32 (*raw_copy_fn)(i32 in_fd, i32 out_fd, u64 offset, u64 size);
+static i32 raw_walk_and_copy(const char *in_path, i32 out_dirfd,
+    raw_copy_fn copy_fn)
+{
+    const i32 in_fd = open(in_path, O_RDONLY);
+    if (in_fd < 0)
+        return 1;
+
+    u64 offset = 0;
+    for (u32 index = 0; ; index++) {
+        union mtk_partition_header hdr;
+        if (pread(in_fd, hdr.buf_, MTK_PART_HEADER_SIZE, (off_t)offset)
+            != MTK_PART_HEADER_SIZE || hdr.data.magic != MTK_PART_MAGIC)
+            break;
+        offset += MTK_PART_HEADER_SIZE;
+
+        const u64 align = hdr.data.ext.size_alignment_bytes;
+        u64 size = ((u64)hdr.data.ext.part_size_hi << 32)
+            | hdr.data.part_size;
+        if (align != 0)
+            size = ((size + align - 1) / align) * align;
+
+        char name[MTK_PART_NAME_LEN + 32] = { 0 };
+        (void) snprintf(name, sizeof(name), "%.32s.extracted_0x%x.bin",
+            hdr.data.part_name, index);
+        const i32 out_fd = openat(out_dirfd, name,
+            O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0 || copy_fn(in_fd, out_fd, offset, size)) {
+            if (out_fd >= 0) close(out_fd);
+            close(in_fd);
+            return 1;
+        }
+        close(out_fd);
+
+        offset += size;
+        if (hdr.data.ext.is_image_list_end)
+            break;
+    }
+
+    close(in_fd);
+    return 0;
+}
+
+static i32 raw_copy_pread_pwrite(i32 in_fd, i32 out_fd, u64 offset, u64 size)
+{
+#define RAW_BUF_SIZE (1024 * 1024)
+    static u8 buf[RAW_BUF_SIZE];
+    u64 out_offset = 0;
+    while (size > 0) {
+        const u64 chunk = size < RAW_BUF_SIZE ? size : RAW_BUF_SIZE;
+        const ssize_t n_read = pread(in_fd, buf, chunk, (off_t)offset);
+        if (n_read <= 0)
+            return 1;
+        if (corpus_write_all__(out_fd, buf, n_read, out_offset))
+            return 1;
+        offset += n_read;
+        out_offset += n_read;
+        size -= n_read;
+    }
+    return 0;
+#undef RAW_BUF_SIZE
+}
+
+static i32 raw_copy_copy_file_range(i32 in_fd, i32 out_fd,
+    u64 offset, u64 size)
+{
+    loff_t in_off = offset;
+    bool copied_any = false;
+    while (size > 0) {
+        const ssize_t ret = copy_file_range(in_fd, &in_off, out_fd, NULL,
+            size, 0);
+        if (ret < 0 && !copied_any &&
+            (errno == EXDEV || errno == ENOSYS || errno == EINVAL))
+        {
+            /* Not supported for this pair of files */
+            return raw_copy_pread_pwrite(in_fd, out_fd, offset, size);
+        } else if (ret <= 0) {
+            return 1;
+        }
+        copied_any = true;
+        size -= ret;
+    }
+    return 0;
+}
+
+static i32 engine_raw_pread_pwrite(const char *in_path, i32 out_dirfd)
+{
+    return raw_walk_and_copy(in_path, out_dirfd, raw_copy_pread_pwrite);
+}
+
+static i32 engine_raw_copy_file_range(const char *in_path, i32 out_dirfd)
+{
+    return raw_walk_and_copy(in_path, out_dirfd, raw_copy_copy_file_range);
+}
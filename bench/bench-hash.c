@@ -0,0 +1,140 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include <core/hash.h>
+#include <core/int.h>
+#include <core/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-hash - `core/hash` throughput on `--diff`-sized blocks.
+ *
+ * Hashes the same random buffer in 64 KiB blocks (`DIFF_BLOCK_SIZE`)
+ * with `hash_bytes` and with every version of the `hash_block`
+ * accumulate loop (portable, SSE2 and AVX2, where available).
+ * All the `hash_block` versions must agree on every block
+ * (and on a range of odd lengths), or the benchmark fails. */
+
+#define BLOCK_SIZE (64 * 1024)
+
+typedef u64 (*hash_fn_t)(const void *data, u64 len, u64 seed);
+
+static u64 hash_block_scalar(const void *data, u64 len, u64 seed)
+{
+    return hash_block_with__(data, len, seed, hash_block_accumulate_scalar__);
+}
+
+#if defined(__SSE2__)
+static u64 hash_block_sse2(const void *data, u64 len, u64 seed)
+{
+    return hash_block_with__(data, len, seed, hash_block_accumulate_sse2__);
+}
+#endif /* __SSE2__ */
+
+#if defined(HASH_BLOCK_HAVE_AVX2__)
+static u64 hash_block_avx2(const void *data, u64 len, u64 seed)
+{
+    return hash_block_with__(data, len, seed, hash_block_accumulate_avx2__);
+}
+#endif /* HASH_BLOCK_HAVE_AVX2__ */
+
+static void fail(const char *what, u64 i)
+{
+    fprintf(stderr, "bench-hash: %s mismatch at %llu\n",
+        what, (unsigned long long)i);
+    exit(EXIT_FAILURE);
+}
+
+static u64 run_case(const char *name, hash_fn_t fn,
+    const u8 *buf, u64 n_blocks, u64 n_passes)
+{
+    u64 checksum = 0;
+    const f64 start = bench_now();
+    for (u64 pass = 0; pass < n_passes; pass++) {
+        for (u64 i = 0; i < n_blocks; i++)
+            checksum = checksum * 31 +
+                fn(buf + i * BLOCK_SIZE, BLOCK_SIZE, HASH_DEFAULT_SEED);
+    }
+    const f64 t = bench_now() - start;
+
+    const f64 n_bytes = (f64)n_blocks * n_passes * BLOCK_SIZE;
+    bench_report("hash", name,
+        "\"block_size\":%u,\"bytes\":%.0f,\"gb_per_s\":%.2f,"
+        "\"checksum\":\"%016llx\"",
+        BLOCK_SIZE, n_bytes, n_bytes / t / 1e9, (unsigned long long)checksum);
+
+    return checksum;
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    /* 16 MiB of data, hashed 16 times (at scale 1) */
+    const u64 n_blocks = 256;
+    const u64 n_passes = 16 * scale;
+    u8 *buf = malloc(n_blocks * BLOCK_SIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "bench-hash: malloc() failed\n");
+        return EXIT_FAILURE;
+    }
+    u64 x = 0x9e3779b97f4a7c15ULL;
+    for (u64 i = 0; i < n_blocks * BLOCK_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (u8)x;
+    }
+
+    (void) run_case("hash_bytes", hash_bytes, buf, n_blocks, n_passes);
+    const u64 scalar = run_case("hash_block-scalar", hash_block_scalar,
+        buf, n_blocks, n_passes);
+#if defined(__SSE2__)
+    if (run_case("hash_block-sse2", hash_block_sse2, buf, n_blocks, n_passes)
+        != scalar)
+    {
+        fail("hash_block-sse2 checksum", 0);
+    }
+    for (u64 len = 0; len < 3 * HASH_BLOCK_ROUND_SIZE; len += 7) {
+        if (hash_block_scalar(buf, len, len) != hash_block_sse2(buf, len, len))
+            fail("hash_block-sse2 length", len);
+    }
+#endif /* __SSE2__ */
+#if defined(HASH_BLOCK_HAVE_AVX2__)
+    if (__builtin_cpu_supports("avx2")) {
+        if (run_case("hash_block-avx2", hash_block_avx2,
+                buf, n_blocks, n_passes) != scalar)
+        {
+            fail("hash_block-avx2 checksum", 0);
+        }
+        for (u64 len = 0; len < 3 * HASH_BLOCK_ROUND_SIZE; len += 7) {
+            if (hash_block_scalar(buf, len, len) !=
+                hash_block_avx2(buf, len, len))
+            {
+                fail("hash_block-avx2 length", len);
+            }
+        }
+    }
+#endif /* HASH_BLOCK_HAVE_AVX2__ */
+
+    free(buf);
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include <core/hashmap.h>
+#include <core/arena.h>
+#include <core/int.h>
+#include <core/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-hashmap - `core/hashmap` insert/lookup/delete rates.
+ *
+ * Keys are partition-name-like strings ("md1rom_0x1234abcd") and
+ * 32-byte binary keys (like content hashes). Every lookup result
+ * is checked, so a broken map fails the benchmark instead of
+ * producing a nice number. All the keys are generated up front,
+ * so that only the map operations are timed. */
+
+#define KEY_BUF_SIZE 32
+
+static void make_key(u8 o_key[KEY_BUF_SIZE], u32 i, bool binary)
+{
+    if (binary) {
+        /* splitmix64-scrambled, 32 bytes */
+        u64 x = (u64)i + 0x9e3779b97f4a7c15ULL;
+        for (u32 j = 0; j < KEY_BUF_SIZE / sizeof(u64); j++) {
+            x += 0x9e3779b97f4a7c15ULL;
+            u64 z = x;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            memcpy(o_key + j * sizeof(u64), &z, sizeof(u64));
+        }
+    } else {
+        (void) snprintf((char *)o_key, KEY_BUF_SIZE, "md1rom_%#x", i);
+    }
+}
+
+static u32 key_len(const u8 key[KEY_BUF_SIZE], bool binary)
+{
+    return binary ? KEY_BUF_SIZE : strlen((const char *)key);
+}
+
+static void fail(const char *what, u32 i)
+{
+    fprintf(stderr, "bench-hashmap: %s failed for key no. %u\n", what, i);
+    exit(EXIT_FAILURE);
+}
+
+static void run_case(const char *name, u32 n_keys, bool binary, bool in_arena)
+{
+    /* The first `n_keys` keys are inserted, the rest are used for misses */
+    u8 (*keys)[KEY_BUF_SIZE] = calloc(2 * (u64)n_keys, KEY_BUF_SIZE);
+    u32 *key_lens = calloc(2 * (u64)n_keys, sizeof(u32));
+    if (keys == NULL || key_lens == NULL)
+        fail("calloc", 0);
+    for (u32 i = 0; i < 2 * n_keys; i++) {
+        make_key(keys[i], i, binary);
+        key_lens[i] = key_len(keys[i], binary);
+    }
+
+    struct arena *arena = NULL;
+    if (in_arena) {
+        arena = arena_create(0, 0);
+        if (arena == NULL)
+            fail("arena_create", 0);
+    }
+
+    struct hashmap *map = hashmap_create_in(0, arena);
+    if (map == NULL)
+        fail("hashmap_create", 0);
+
+    /* Values are the key indices + 1 (`NULL` means "not found") */
+    f64 start = bench_now();
+    for (u32 i = 0; i < n_keys; i++) {
+        if (hashmap_insert_bytes(map, keys[i], key_lens[i],
+                (void *)(uintptr_t)(i + 1)))
+            fail("insert", i);
+    }
+    const f64 t_insert = bench_now() - start;
+
+    start = bench_now();
+    for (u32 i = 0; i < n_keys; i++) {
+        if (hashmap_lookup_bytes(map, keys[i], key_lens[i])
+                != (void *)(uintptr_t)(i + 1))
+            fail("lookup (hit)", i);
+    }
+    const f64 t_hit = bench_now() - start;
+
+    start = bench_now();
+    for (u32 i = n_keys; i < 2 * n_keys; i++) {
+        if (hashmap_lookup_bytes(map, keys[i], key_lens[i]) != NULL)
+            fail("lookup (miss)", i);
+    }
+    const f64 t_miss = bench_now() - start;
+
+    /* Delete every other key, and check that the rest is still there */
+    start = bench_now();
+    for (u32 i = 0; i < n_keys; i += 2)
+        hashmap_delete_bytes(map, keys[i], key_lens[i]);
+    const f64 t_delete = bench_now() - start;
+
+    for (u32 i = 0; i < n_keys; i++) {
+        void *expected = (i % 2) ? (void *)(uintptr_t)(i + 1) : NULL;
+        if (hashmap_lookup_bytes(map, keys[i], key_lens[i]) != expected)
+            fail("lookup (after delete)", i);
+    }
+    if (map->n_elements != n_keys / 2)
+        fail("n_elements", map->n_elements);
+
+    hashmap_destroy(&map);
+    arena_destroy(&arena);
+    free(keys);
+    free(key_lens);
+
+    bench_report("hashmap", name,
+        "\"keys\":%u,\"insert_ns\":%.1f,\"hit_ns\":%.1f,\"miss_ns\":%.1f,"
+        "\"delete_ns\":%.1f",
+        n_keys,
+        t_insert * 1e9 / n_keys, t_hit * 1e9 / n_keys,
+        t_miss * 1e9 / n_keys, t_delete * 1e9 / (n_keys / 2)
+    );
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    run_case("names-10k", 10000 * scale, false, false);
+    run_case("names-1M", 1000000 * scale, false, false);
+    run_case("names-1M-arena", 1000000 * scale, false, true);
+    run_case("hashes-1M", 1000000 * scale, true, false);
+
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include <core/spinlock.h>
+#include <core/int.h>
+#include <core/log.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-lock - lock throughput under contention.
+ *
+ * N threads each take a lock `n_iters` times, doing a tiny bit of work
+ * inside the critical section (incrementing a shared counter)
+ * and a bit of work outside of it. Reports the total acquisitions
+ * per second, the CPU time burned per acquisition (to catch spinning),
+ * and the contention counters. The final counter value is checked. */
+
+#define X_LOCK_TYPES \
+    X_(spinlock) X_(ticketlock) X_(hybridlock)
+
+enum lock_type {
+#define X_(name) LOCK_##name,
+    X_LOCK_TYPES
+#undef X_
+};
+
+static const char *const g_lock_type_names[] = {
+#define X_(name) #name,
+    X_LOCK_TYPES
+#undef X_
+};
+
+struct lock_ctx {
+    enum lock_type type;
+    u32 n_iters;
+    spinlock_t spin;
+    ticketlock_t ticket;
+    hybridlock_t hybrid;
+    volatile u64 counter;
+};
+
+static void * worker(void *arg)
+{
+    struct lock_ctx *ctx = arg;
+    volatile u32 outside = 0;
+
+    for (u32 i = 0; i < ctx->n_iters; i++) {
+        switch (ctx->type) {
+        case LOCK_spinlock: spinlock_acquire(&ctx->spin); break;
+        case LOCK_ticketlock: ticketlock_acquire(&ctx->ticket); break;
+        case LOCK_hybridlock: hybridlock_acquire(&ctx->hybrid); break;
+        }
+
+        ctx->counter = ctx->counter + 1;
+
+        switch (ctx->type) {
+        case LOCK_spinlock: spinlock_release(&ctx->spin); break;
+        case LOCK_ticketlock: ticketlock_release(&ctx->ticket); break;
+        case LOCK_hybridlock: hybridlock_release(&ctx->hybrid); break;
+        }
+
+        for (u32 j = 0; j < 32; j++)
+            outside = outside + 1;
+    }
+
+    return NULL;
+}
+
+static f64 cpu_seconds(void)
+{
+    struct timespec ts = { 0 };
+    (void) clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (f64)ts.tv_sec + ((f64)ts.tv_nsec / 1e9);
+}
+
+static void run_case(enum lock_type type, u32 n_threads, u32 n_iters)
+{
+    struct lock_ctx ctx = { .type = type, .n_iters = n_iters };
+    spinlock_init(&ctx.spin);
+    ticketlock_init(&ctx.ticket);
+    hybridlock_init(&ctx.hybrid);
+
+    u64 counters_before[SPINLOCK_N_COUNTERS_];
+    for (u32 i = 0; i < SPINLOCK_N_COUNTERS_; i++)
+        counters_before[i] = spinlock_get_counter(i);
+
+    pthread_t threads[64];
+    const f64 cpu_start = cpu_seconds();
+    const f64 start = bench_now();
+    for (u32 i = 0; i < n_threads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &ctx)) {
+            fprintf(stderr, "bench-lock: pthread_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (u32 i = 0; i < n_threads; i++)
+        (void) pthread_join(threads[i], NULL);
+    const f64 t = bench_now() - start;
+    const f64 cpu = cpu_seconds() - cpu_start;
+
+    const u64 n_total = (u64)n_threads * n_iters;
+    if (ctx.counter != n_total) {
+        fprintf(stderr, "bench-lock: %s is broken (counter %llu, "
+            "expected %llu)\n", g_lock_type_names[type],
+            (unsigned long long)ctx.counter, (unsigned long long)n_total);
+        exit(EXIT_FAILURE);
+    }
+
+    char case_name[64];
+    (void) snprintf(case_name, sizeof(case_name), "%s-%ut",
+        g_lock_type_names[type], n_threads);
+    bench_report("lock", case_name,
+        "\"threads\":%u,\"acquisitions\":%llu,\"seconds\":%.6f,"
+        "\"mops_per_sec\":%.3f,\"cpu_ns_per_op\":%.1f,"
+        "\"contended\":%llu,\"yields\":%llu,\"futex_waits\":%llu",
+        n_threads, (unsigned long long)n_total, t,
+        (f64)n_total / t / 1e6, cpu * 1e9 / (f64)n_total,
+        (unsigned long long)(spinlock_get_counter(SPINLOCK_COUNTER_CONTENDED)
+            - counters_before[SPINLOCK_COUNTER_CONTENDED]),
+        (unsigned long long)(spinlock_get_counter(SPINLOCK_COUNTER_YIELDS)
+            - counters_before[SPINLOCK_COUNTER_YIELDS]),
+        (unsigned long long)(spinlock_get_counter(SPINLOCK_COUNTER_FUTEX_WAITS)
+            - counters_before[SPINLOCK_COUNTER_FUTEX_WAITS])
+    );
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) n_cpus = 1;
+    const u32 thread_counts[] = { 1, 4, (u32)(n_cpus > 64 ? 64 : n_cpus) };
+
+    for (u32 t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); t++) {
+        if (t > 0 && thread_counts[t] <= thread_counts[t - 1])
+            continue;
+
+        for (u32 type = 0; type < sizeof(g_lock_type_names) /
+            sizeof(*g_lock_type_names); type++)
+        {
+            const u32 n_threads = thread_counts[t];
+            run_case(type, n_threads, (u32)(2000000 * scale / n_threads));
+        }
+    }
+
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
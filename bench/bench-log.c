@@ -0,0 +1,101 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <core/ringbuffer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bench-log - `core/log` throughput.
+ *
+ * Measures the cost of a typical `s_log_info()` call
+ * (one line of the header dump) for the output types we actually use:
+ * a `FILE *` stream, an in-memory ring buffer, and a message that is
+ * filtered out by the log level (the cost of a disabled `s_log_verbose`). */
+
+#define MODULE_NAME "bench-log"
+
+#define BENCH_LOG_FMT "        .part_size = %#x, // aligned: %#x, full: %#x"
+
+static f64 run_log(u64 n_messages)
+{
+    const f64 start = bench_now();
+    for (u64 i = 0; i < n_messages; i++)
+        s_log_info(BENCH_LOG_FMT, (u32)i, (u32)i + 16, (u32)i);
+    return bench_now() - start;
+}
+
+static void report(const char *case_name, u64 n_messages, f64 t,
+    u64 msg_size)
+{
+    bench_report("log", case_name,
+        "\"messages\":%llu,\"seconds\":%.6f,\"messages_per_sec\":%.1f,"
+        "\"ns_per_message\":%.1f,\"mb_per_sec\":%.3f",
+        (unsigned long long)n_messages, t, (f64)n_messages / t,
+        t * 1e9 / (f64)n_messages,
+        (f64)(n_messages * msg_size) / t / 1e6
+    );
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    const u64 n_messages = 1000000 * scale;
+    FILE *devnull = bench_setup_log();
+
+    /* The approximate size of a single formatted line */
+    char tmp[S_LOG_MAX_SIZE] = { 0 };
+    const u64 msg_size = (u64)snprintf(tmp, sizeof(tmp),
+        "I [" MODULE_NAME "] " BENCH_LOG_FMT "\n", 0x1000, 0x1010, 0x1000);
+
+    /* FILE * output (to /dev/null, so that only our overhead is measured) */
+    report("file", n_messages, run_log(n_messages), msg_size);
+
+    /* FILE * output, with ANSI escape sequence stripping */
+    struct s_log_output_cfg cfg = {
+        .type = S_LOG_OUTPUT_FILE,
+        .out.file = devnull,
+        .flags = S_LOG_CONFIG_FLAG_STRIP_ESC_SEQUENCES,
+    };
+    if (s_configure_log_output(S_LOG_INFO, &cfg, NULL))
+        return EXIT_FAILURE;
+    report("file-strip-esc", n_messages, run_log(n_messages), msg_size);
+
+    /* In-memory ring buffer */
+    struct ringbuffer *membuf = ringbuffer_init(1024 * 1024);
+    if (membuf == NULL)
+        return EXIT_FAILURE;
+    cfg.type = S_LOG_OUTPUT_MEMORYBUF;
+    cfg.out.membuf = membuf;
+    cfg.flags = 0;
+    if (s_configure_log_output(S_LOG_INFO, &cfg, NULL))
+        return EXIT_FAILURE;
+    report("membuf", n_messages, run_log(n_messages), msg_size);
+
+    /* Filtered out by the log level */
+    s_configure_log_level(S_LOG_WARNING);
+    report("filtered", n_messages * 10, run_log(n_messages * 10), 0);
+    s_configure_log_level(S_LOG_INFO);
+
+    s_log_cleanup_all();
+    ringbuffer_destroy(&membuf);
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
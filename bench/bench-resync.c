@@ -0,0 +1,167 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include "../resync.h"
+#include "../mtkparthdr.h"
+#include "../bufpool.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <core/math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* bench-resync - `--resync` header search throughput.
+ *
+ * A file made of a run of junk followed by a single valid header is
+ * searched from the start, with the header on a sector boundary
+ * (found in the first pass) and off one (found only in the byte-granular
+ * second pass). The junk is random, with a fake magic (followed by
+ * a garbage name) every 64 KiB, so the candidate checks get exercised too.
+ * Reports the scan rate and checks that the header is found where it is. */
+
+#define FAKE_MAGIC_INTERVAL (64 * 1024)
+#define BODY_SIZE 4096
+
+struct resync_case {
+    const char *name;
+    u64 misalignment;
+};
+
+static u64 g_rng = 0x9E3779B97F4A7C15ULL;
+static u64 xorshift64(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static void write_or_die(i32 fd, const void *buf, u64 size)
+{
+    if (write(fd, buf, size) != (ssize_t)size) {
+        fprintf(stderr, "bench-resync: write() failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void generate(const char *path, u64 junk_size)
+{
+    const i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create \"%s\"\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    static const u8 fake_magic[] = { 0x88, 0x16, 0x88, 0x58 };
+    static u8 chunk[FAKE_MAGIC_INTERVAL];
+    for (u64 written = 0; written < junk_size; written += sizeof(chunk)) {
+        for (u32 i = 0; i < sizeof(chunk); i += sizeof(u64)) {
+            const u64 r = xorshift64();
+            memcpy(chunk + i, &r, sizeof(u64));
+        }
+        memcpy(chunk + 1000, fake_magic, sizeof(fake_magic));
+        chunk[1000 + 8] = 0x01; /* Not a printable name */
+
+        write_or_die(fd, chunk, u_min(sizeof(chunk), junk_size - written));
+    }
+
+    union mtk_partition_header hdr;
+    memset(hdr.buf_, 0xFF, sizeof(hdr.buf_));
+    memset(&hdr.data, 0, MTK_PART_HEADER_DATA_SIZE);
+    hdr.data.magic = MTK_PART_MAGIC;
+    hdr.data.part_size = BODY_SIZE;
+    memcpy(hdr.data.part_name, "target", sizeof("target"));
+    hdr.data.ext.magic = MTK_PART_EXT_MAGIC;
+    hdr.data.ext.hdr_size = MTK_PART_HEADER_SIZE;
+    hdr.data.ext.is_image_list_end = 1;
+    write_or_die(fd, hdr.buf_, sizeof(hdr.buf_));
+
+    static const u8 body[BODY_SIZE] = { 0 };
+    write_or_die(fd, body, sizeof(body));
+
+    close(fd);
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    char tmpdir[256] = { 0 };
+    bench_make_tmpdir(tmpdir, sizeof(tmpdir));
+    char path[512] = { 0 };
+    (void) snprintf(path, sizeof(path), "%s/resync.bin", tmpdir);
+
+    u8 *buf = aligned_alloc(4096, BUFPOOL_BUF_SIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "bench-resync: aligned_alloc() failed\n");
+        return EXIT_FAILURE;
+    }
+
+    const struct resync_case cases[] = {
+        { "sector-aligned", 0 },
+        { "unaligned", 13 },
+    };
+    const u64 base_junk_size = 64 * 1024 * 1024 * scale;
+    const u32 n_iterations = 4;
+
+    for (u32 i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        const struct resync_case *c = &cases[i];
+        const u64 junk_size = base_junk_size + c->misalignment;
+        const u64 file_size = junk_size + MTK_PART_HEADER_SIZE + BODY_SIZE;
+        generate(path, junk_size);
+
+        const i32 fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Failed to open \"%s\"\n", path);
+            return EXIT_FAILURE;
+        }
+
+        /* Warm the page cache */
+        (void) resync_find_header(fd, 0, file_size,
+            MTK_PART_BYTE_ORDER_UNKNOWN, buf, BUFPOOL_BUF_SIZE);
+
+        const f64 start = bench_now();
+        for (u32 j = 0; j < n_iterations; j++) {
+            const u64 found = resync_find_header(fd, 0, file_size,
+                MTK_PART_BYTE_ORDER_UNKNOWN, buf, BUFPOOL_BUF_SIZE);
+            if (found != junk_size) {
+                fprintf(stderr, "bench-resync: %s: found %#llx, "
+                    "expected %#llx\n", c->name, (unsigned long long)found,
+                    (unsigned long long)junk_size);
+                return EXIT_FAILURE;
+            }
+        }
+        const f64 t = bench_now() - start;
+        close(fd);
+
+        const u64 n_bytes = junk_size * n_iterations;
+        bench_report("resync", c->name,
+            "\"bytes\":%llu,\"seconds\":%.6f,\"mb_per_sec\":%.1f",
+            (unsigned long long)n_bytes, t, (f64)n_bytes / t / 1e6);
+    }
+
+    free(buf);
+    bench_clean_dir(tmpdir, true);
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
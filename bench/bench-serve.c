@@ -0,0 +1,308 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include "corpus.h"
+#include "../serve.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <core/math.h>
+#include <core/threadpool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* bench-serve - `--serve` request round trips.
+ *
+ * Runs the server in a thread and measures the rate of pipelined
+ * `ping`s and (cached) `list`s over one connection, and of short-lived
+ * connections that send a few requests and then half-close
+ * (like `socat` does at the end of its input). Every response is checked:
+ * all the requests must be answered, in order, with `"ok":true`.
+ * Malformed requests (an over-long or invalid `id`, a request line that
+ * fills the whole input buffer while another request is in flight)
+ * must be rejected without taking the server down. Finally, the server
+ * is stopped while a request is in flight and more are queued up behind
+ * it, which must neither crash nor leave tasks in the pool. */
+
+#define PIPELINE_DEPTH 64
+
+struct server_thread {
+    const char *socket_path;
+    struct threadpool *tp;
+    i32 ret;
+};
+
+static void * server_thread_fn(void *arg)
+{
+    struct server_thread *st = arg;
+    st->ret = serve_run(st->socket_path, st->tp);
+    return NULL;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "bench-serve: %s\n", what);
+    exit(EXIT_FAILURE);
+}
+
+static i32 connect_to(const char *socket_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    (void) snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+
+    /* The server may still be starting up */
+    for (u32 attempt = 0; attempt < 500; attempt++) {
+        const i32 fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            die("socket() failed");
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        close(fd);
+        usleep(10000);
+    }
+    die("couldn't connect to the server");
+    return -1;
+}
+
+static void send_all(i32 fd, const char *buf, u64 len)
+{
+    while (len > 0) {
+        const ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            die("send() failed");
+        buf += n;
+        len -= n;
+    }
+}
+
+/* Reads `n_lines` response lines (or, if `n_lines` is 0, everything
+ * until the server closes the connection), checks that each contains
+ * `expect` and returns the number of lines read */
+static u32 read_responses(i32 fd, u32 n_lines, const char *expect)
+{
+    static char buf[1024 * 1024];
+    u64 len = 0;
+    u32 n_read = 0;
+
+    while (n_lines == 0 || n_read < n_lines) {
+        char *nl;
+        while ((n_lines == 0 || n_read < n_lines) &&
+            (nl = memchr(buf, '\n', len)) != NULL)
+        {
+            *nl = '\0';
+            if (strstr(buf, expect) == NULL) {
+                fprintf(stderr, "bench-serve: unexpected response: %.200s\n",
+                    buf);
+                exit(EXIT_FAILURE);
+            }
+            n_read++;
+            len -= nl + 1 - buf;
+            memmove(buf, nl + 1, len);
+        }
+        if (n_lines != 0 && n_read >= n_lines)
+            break;
+
+        if (len == sizeof(buf))
+            die("a response line is too long");
+        const ssize_t n = recv(fd, buf + len, sizeof(buf) - len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            die("recv() failed");
+        if (n == 0)
+            break;
+        len += n;
+    }
+
+    return n_read;
+}
+
+static void run_pipelined(const char *socket_path, const char *case_name,
+    const char *request, const char *expect, u32 n_requests)
+{
+    const i32 fd = connect_to(socket_path);
+    const u64 req_len = strlen(request);
+
+    char *batch = malloc(req_len * PIPELINE_DEPTH);
+    if (batch == NULL)
+        die("malloc() failed");
+    for (u32 i = 0; i < PIPELINE_DEPTH; i++)
+        memcpy(batch + i * req_len, request, req_len);
+
+    const f64 start = bench_now();
+    for (u32 i = 0; i < n_requests; i += PIPELINE_DEPTH) {
+        const u32 n = u_min(PIPELINE_DEPTH, n_requests - i);
+        send_all(fd, batch, req_len * n);
+        if (read_responses(fd, n, expect) != n)
+            die("the server closed the connection");
+    }
+    const f64 t = bench_now() - start;
+
+    free(batch);
+    close(fd);
+    bench_report("serve", case_name,
+        "\"requests\":%u,\"seconds\":%.6f,\"requests_per_sec\":%.1f,"
+        "\"us_per_request\":%.2f",
+        n_requests, t, (f64)n_requests / t, t * 1e6 / (f64)n_requests);
+}
+
+static void run_half_close(const char *socket_path, const char *list_request,
+    u32 n_conns)
+{
+    /* A few pings and a list, then EOF - without a newline at the end */
+    char request[1024];
+    const i32 len = snprintf(request, sizeof(request),
+        "{\"op\":\"ping\",\"id\":1}\n{\"op\":\"ping\",\"id\":\"two\"}\n%.*s",
+        (i32)strlen(list_request) - 1, list_request);
+    if (len < 0 || (u32)len >= sizeof(request))
+        die("the half-close request is too long");
+
+    const f64 start = bench_now();
+    for (u32 i = 0; i < n_conns; i++) {
+        const i32 fd = connect_to(socket_path);
+        send_all(fd, request, len);
+        if (shutdown(fd, SHUT_WR))
+            die("shutdown() failed");
+        if (read_responses(fd, 0, "\"ok\":true") != 3)
+            die("not all requests before a half-close were answered");
+        close(fd);
+    }
+    const f64 t = bench_now() - start;
+
+    bench_report("serve", "half-close",
+        "\"connections\":%u,\"seconds\":%.6f,\"connections_per_sec\":%.1f",
+        n_conns, t, (f64)n_conns / t);
+}
+
+static void check_malformed(const char *socket_path, const char *list_request)
+{
+    const i32 fd = connect_to(socket_path);
+
+    /* Neither of these ids may be echoed back */
+    char request[1024];
+    (void) snprintf(request, sizeof(request),
+        "{\"op\":\"ping\",\"id\":\"%0600d\"}\n{\"op\":\"ping\",\"id\":1]}\n", 0);
+    send_all(fd, request, strlen(request));
+    if (read_responses(fd, 2, "\"ok\":false") != 2)
+        die("a malformed id wasn't rejected");
+
+    /* A full input buffer while a request is in flight,
+     * with another complete request at the end of it */
+    static char filler[SERVE_MAX_REQUEST_SIZE];
+    const char *tail = "{\"op\":\"ping\"}\n";
+    memset(filler, ' ', sizeof(filler));
+    memcpy(filler + sizeof(filler) - strlen(tail), tail, strlen(tail));
+    send_all(fd, list_request, strlen(list_request));
+    send_all(fd, filler, sizeof(filler));
+    if (read_responses(fd, 2, "\"ok\":true") != 2)
+        die("a full input buffer wasn't handled");
+
+    close(fd);
+
+    /* Still alive */
+    run_pipelined(socket_path, "ping-after-malformed",
+        "{\"op\":\"ping\"}\n", "\"ok\":true", PIPELINE_DEPTH);
+}
+
+/* Stops the server (and destroys its thread pool right away, like `main()`
+ * does) in the middle of a batch of pipelined requests */
+static void stop_server(const char *socket_path, const char *verify_request,
+    pthread_t server, struct server_thread *st)
+{
+    const i32 fd = connect_to(socket_path);
+    const u64 req_len = strlen(verify_request);
+    send_all(fd, verify_request, req_len);
+    if (read_responses(fd, 1, "\"ok\":true") != 1)
+        die("the server closed the connection");
+
+    for (u32 i = 0; i < PIPELINE_DEPTH; i++)
+        send_all(fd, verify_request, req_len);
+    (void) kill(getpid(), SIGTERM);
+
+    pthread_join(server, NULL);
+    threadpool_destroy(&st->tp);
+    if (st->ret != 0)
+        die("the server failed");
+
+    /* Whatever was still answered must be complete */
+    (void) read_responses(fd, 0, "\"ok\":true");
+    close(fd);
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    char tmpdir[256] = { 0 };
+    bench_make_tmpdir(tmpdir, sizeof(tmpdir));
+    char path[512] = { 0 }, socket_path[512] = { 0 };
+    (void) snprintf(path, sizeof(path), "%s/serve.bin", tmpdir);
+    (void) snprintf(socket_path, sizeof(socket_path), "%s/serve.sock", tmpdir);
+
+    struct corpus_params p = CORPUS_PARAMS_DEFAULT;
+    p.n_entries = 256;
+    p.min_size = p.max_size = 4096;
+    if (corpus_generate(path, &p, NULL))
+        return EXIT_FAILURE;
+
+    char list_request[1024], verify_request[1024];
+    (void) snprintf(list_request, sizeof(list_request),
+        "{\"op\":\"list\",\"path\":\"%s\"}\n", path);
+    (void) snprintf(verify_request, sizeof(verify_request),
+        "{\"op\":\"verify\",\"path\":\"%s\"}\n", path);
+
+    /* The server is stopped with `SIGTERM`, which must only
+     * ever reach its signalfd */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL))
+        die("pthread_sigmask() failed");
+
+    struct server_thread st = { .socket_path = socket_path };
+    st.tp = threadpool_create(2, 0);
+    if (st.tp == NULL)
+        die("threadpool_create() failed");
+    pthread_t server;
+    if (pthread_create(&server, NULL, server_thread_fn, &st))
+        die("pthread_create() failed");
+
+    run_pipelined(socket_path, "ping-pipelined", "{\"op\":\"ping\"}\n",
+        "\"ok\":true", 20000 * scale);
+    run_pipelined(socket_path, "list-cached", list_request,
+        "\"ok\":true", 2000 * scale);
+    run_half_close(socket_path, list_request, 500 * scale);
+    check_malformed(socket_path, list_request);
+
+    stop_server(socket_path, verify_request, server, &st);
+
+    bench_clean_dir(tmpdir, true);
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include <core/threadpool.h>
+#include <core/int.h>
+#include <core/log.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-threadpool - task overhead and load balancing.
+ *
+ * - `tasks-*`: many empty tasks, submitted from outside of the pool
+ *   (`inject`) or split recursively with `threadpool_parallel_for`
+ *   (`parallel-for`), to measure the per-task overhead.
+ *
+ * - `skewed-*`: one huge item next to many tiny ones (like a big md1img
+ *   among small cert images). `static` hands each thread a contiguous
+ *   share of the items up front, while `pool` runs one item per task
+ *   on the work-stealing pool.
+ *
+ * The results of every case are checked. */
+
+/* The number of work units in the huge item of the skewed workload,
+ * relative to a tiny item (which is 1 unit) */
+#define SKEWED_HUGE_ITEM_UNITS 2000
+
+struct skewed_ctx {
+    u64 n_items;
+    u32 n_threads;
+    _Atomic u64 checksum;
+};
+
+static _Atomic u64 g_n_run;
+
+static void empty_task(void *arg)
+{
+    (void) arg;
+    atomic_fetch_add_explicit(&g_n_run, 1, memory_order_relaxed);
+}
+
+static void empty_item(void *arg, u64 index, u32 slot)
+{
+    (void) arg; (void) index; (void) slot;
+    atomic_fetch_add_explicit(&g_n_run, 1, memory_order_relaxed);
+}
+
+/* Some CPU work that the compiler can't throw away */
+static u64 do_units(u64 seed, u64 n_units)
+{
+    u64 x = seed | 1;
+    for (u64 i = 0; i < n_units * 4096; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+static u64 item_units(u64 index)
+{
+    return index == 0 ? SKEWED_HUGE_ITEM_UNITS : 1;
+}
+
+static void skewed_item(void *arg, u64 index, u32 slot)
+{
+    (void) slot;
+    struct skewed_ctx *ctx = arg;
+    atomic_fetch_add_explicit(&ctx->checksum,
+        do_units(index, item_units(index)), memory_order_relaxed);
+}
+
+struct static_share {
+    struct skewed_ctx *ctx;
+    u64 begin, end;
+};
+
+static void * static_worker(void *arg)
+{
+    struct static_share *share = arg;
+    for (u64 i = share->begin; i < share->end; i++)
+        skewed_item(share->ctx, i, 0);
+    return NULL;
+}
+
+static u64 expected_checksum(u64 n_items)
+{
+    u64 sum = 0;
+    for (u64 i = 0; i < n_items; i++)
+        sum += do_units(i, item_units(i));
+    return sum;
+}
+
+static void run_tasks(u32 n_threads, u64 n_tasks)
+{
+    struct threadpool *tp = threadpool_create(n_threads - 1, 0);
+    if (tp == NULL) {
+        fprintf(stderr, "bench-threadpool: threadpool_create() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char case_name[64];
+
+    /* Submitted one by one from the main thread */
+    atomic_store(&g_n_run, 0);
+    struct threadpool_group group = THREADPOOL_GROUP_INIT;
+    f64 start = bench_now();
+    for (u64 i = 0; i < n_tasks; i++)
+        threadpool_submit(tp, &group, empty_task, NULL);
+    threadpool_group_wait(tp, &group);
+    f64 t = bench_now() - start;
+    if (atomic_load(&g_n_run) != n_tasks) {
+        fprintf(stderr, "bench-threadpool: inject ran %llu of %llu tasks\n",
+            (unsigned long long)atomic_load(&g_n_run),
+            (unsigned long long)n_tasks);
+        exit(EXIT_FAILURE);
+    }
+    (void) snprintf(case_name, sizeof(case_name), "tasks-inject-%ut",
+        n_threads);
+    bench_report("threadpool", case_name,
+        "\"threads\":%u,\"tasks\":%llu,\"seconds\":%.6f,\"ns_per_task\":%.1f",
+        n_threads, (unsigned long long)n_tasks, t, t * 1e9 / (f64)n_tasks);
+
+    /* Split recursively, one item per task */
+    atomic_store(&g_n_run, 0);
+    start = bench_now();
+    threadpool_parallel_for(tp, n_tasks, 1, empty_item, NULL);
+    t = bench_now() - start;
+    if (atomic_load(&g_n_run) != n_tasks) {
+        fprintf(stderr, "bench-threadpool: parallel-for ran %llu of %llu "
+            "items\n", (unsigned long long)atomic_load(&g_n_run),
+            (unsigned long long)n_tasks);
+        exit(EXIT_FAILURE);
+    }
+    (void) snprintf(case_name, sizeof(case_name), "tasks-parallel-for-%ut",
+        n_threads);
+    bench_report("threadpool", case_name,
+        "\"threads\":%u,\"tasks\":%llu,\"seconds\":%.6f,\"ns_per_task\":%.1f",
+        n_threads, (unsigned long long)n_tasks, t, t * 1e9 / (f64)n_tasks);
+
+    threadpool_destroy(&tp);
+}
+
+static void run_skewed(u32 n_threads, u64 n_items, u64 expected)
+{
+    char case_name[64];
+
+    /* Static partitioning */
+    struct skewed_ctx ctx = { .n_items = n_items, .n_threads = n_threads };
+    pthread_t threads[64];
+    struct static_share shares[64];
+    f64 start = bench_now();
+    for (u32 i = 0; i < n_threads; i++) {
+        shares[i] = (struct static_share) {
+            .ctx = &ctx,
+            .begin = n_items * i / n_threads,
+            .end = n_items * (i + 1) / n_threads,
+        };
+        if (pthread_create(&threads[i], NULL, static_worker, &shares[i])) {
+            fprintf(stderr, "bench-threadpool: pthread_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (u32 i = 0; i < n_threads; i++)
+        (void) pthread_join(threads[i], NULL);
+    f64 t = bench_now() - start;
+    if (atomic_load(&ctx.checksum) != expected) {
+        fprintf(stderr, "bench-threadpool: static checksum mismatch\n");
+        exit(EXIT_FAILURE);
+    }
+    (void) snprintf(case_name, sizeof(case_name), "skewed-static-%ut",
+        n_threads);
+    bench_report("threadpool", case_name,
+        "\"threads\":%u,\"items\":%llu,\"seconds\":%.6f",
+        n_threads, (unsigned long long)n_items, t);
+
+    /* Work stealing */
+    struct threadpool *tp = threadpool_create(n_threads - 1, 0);
+    if (tp == NULL) {
+        fprintf(stderr, "bench-threadpool: threadpool_create() failed\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&ctx.checksum, 0);
+    start = bench_now();
+    threadpool_parallel_for(tp, n_items, 1, skewed_item, &ctx);
+    t = bench_now() - start;
+    threadpool_destroy(&tp);
+    if (atomic_load(&ctx.checksum) != expected) {
+        fprintf(stderr, "bench-threadpool: pool checksum mismatch\n");
+        exit(EXIT_FAILURE);
+    }
+    (void) snprintf(case_name, sizeof(case_name), "skewed-pool-%ut",
+        n_threads);
+    bench_report("threadpool", case_name,
+        "\"threads\":%u,\"items\":%llu,\"seconds\":%.6f",
+        n_threads, (unsigned long long)n_items, t);
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) n_cpus = 1;
+    const u32 thread_counts[] = { 1, 4, (u32)(n_cpus > 64 ? 64 : n_cpus) };
+
+    const u64 n_skewed_items = 4000 * scale;
+    const u64 expected = expected_checksum(n_skewed_items);
+
+    for (u32 t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); t++) {
+        if (t > 0 && thread_counts[t] <= thread_counts[t - 1])
+            continue;
+
+        run_tasks(thread_counts[t], 1000000 * scale);
+        run_skewed(thread_counts[t], n_skewed_items, expected);
+    }
+
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+#include <core/static-tests.h>
+
+#include <core/int.h>
+#include <core/log.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Shared helpers for the benchmark programs in `bench/`.
+ *
+ * Every benchmark prints its results to stdout as JSON Lines
+ * (one self-contained JSON object per line), so that the output
+ * of `make bench` can be appended to a results file and compared
+ * between revisions with any JSON-aware tool.
+ *
+ * The including source file must define `_GNU_SOURCE`
+ * (or an equivalent POSIX feature test macro) before any includes. */
+
+/* Returns the current value of the monotonic clock in seconds */
+static inline f64 bench_now(void)
+{
+    struct timespec ts = { 0 };
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + ((f64)ts.tv_nsec / 1e9);
+}
+
+/* Prints a single result record.
+ * `fields_fmt` is a printf-style format string for the remaining
+ * (already JSON-formatted) fields, e.g. `"\"bytes\":%llu"`. */
+static inline void bench_report(const char *bench, const char *case_name,
+    const char *fields_fmt, ...)
+{
+    va_list vlist;
+    va_start(vlist, fields_fmt);
+
+    printf("{\"bench\":\"%s\",\"case\":\"%s\",", bench, case_name);
+    vprintf(fields_fmt, vlist);
+    printf("}\n");
+    fflush(stdout);
+
+    va_end(vlist);
+}
+
+/* Redirects all the `core/log` output levels to `/dev/null`
+ * (except for errors, which still go to `stderr`),
+ * so that the benchmarked code pays the full formatting cost
+ * without flooding the terminal.
+ *
+ * Returns the `/dev/null` handle, which the caller should close
+ * after calling `s_log_cleanup_all()`. */
+static inline FILE * bench_setup_log(void)
+{
+    FILE *devnull = fopen("/dev/null", "wb");
+    if (devnull == NULL) {
+        fprintf(stderr, "Failed to open /dev/null\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct s_log_output_cfg cfg = {
+        .type = S_LOG_OUTPUT_FILE,
+        .out.file = devnull,
+    };
+    if (s_configure_log_outputs(S_LOG_STDOUT_MASKS, &cfg)) {
+        fprintf(stderr, "Failed to configure the log output\n");
+        exit(EXIT_FAILURE);
+    }
+
+    cfg.out.file = stderr;
+    if (s_configure_log_outputs(S_LOG_STDERR_MASKS, &cfg)) {
+        fprintf(stderr, "Failed to configure the error log output\n");
+        exit(EXIT_FAILURE);
+    }
+
+    s_configure_log_level(S_LOG_INFO);
+
+    return devnull;
+}
+
+/* Creates a fresh scratch directory for a benchmark run
+ * in `$MTKPARTDUMP_BENCH_TMPDIR` (or `/tmp` if unset)
+ * and writes its path to `out_path`. */
+static inline void bench_make_tmpdir(char *out_path, u32 out_size)
+{
+    const char *base = getenv("MTKPARTDUMP_BENCH_TMPDIR");
+    if (base == NULL || base[0] == '\0')
+        base = "/tmp";
+
+    i32 ret = snprintf(out_path, out_size, "%s/mtkpartdump-bench.XXXXXX", base);
+    if (ret < 0 || (u32)ret >= out_size || mkdtemp(out_path) == NULL) {
+        fprintf(stderr, "Failed to create a scratch directory in \"%s\"\n",
+            base);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Removes all the regular files in the (flat) directory `path`.
+ * If `remove_dir` is set, the directory itself is removed as well. */
+static inline void bench_clean_dir(const char *path, bool remove_dir)
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return;
+
+    const i32 dfd = dirfd(dir);
+    struct dirent *ent = NULL;
+    while (ent = readdir(dir), ent != NULL) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        (void) unlinkat(dfd, ent->d_name, 0);
+    }
+    closedir(dir);
+
+    if (remove_dir)
+        (void) rmdir(path);
+}
+
+/* Returns the value of the environment variable `name` parsed as an integer,
+ * or `default_val` if it's unset or invalid.
+ * Used to scale the benchmarks (e.g. `BENCH_SCALE=4 make bench`). */
+static inline u64 bench_env_u64(const char *name, u64 default_val)
+{
+    const char *str = getenv(name);
+    if (str == NULL || str[0] == '\0')
+        return default_val;
+
+    char *end = NULL;
+    const unsigned long long val = strtoull(str, &end, 0);
+    if (end == NULL || *end != '\0')
+        return default_val;
+
+    return val;
+}
+
+#endif /* BENCH_UTIL_H_ */
@@ -0,0 +1,105 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bench-util.h"
+#include "corpus.h"
+#include <arg.h>
+#include <mtkpartdump.h>
+#include <core/int.h>
+#include <core/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bench-walk - header chain walk rate (no extraction).
+ *
+ * Measures how many headers per second `mtkpart_dump_file()` can walk
+ * with `--chain`, both with the header dump going through the logger
+ * (the normal listing use case) and with logging disabled
+ * (pure I/O + parsing cost). */
+
+struct walk_case {
+    const char *name;
+    u32 n_entries;
+    u64 body_size;
+    bool sparse;
+    bool quiet;
+};
+
+static f64 run_walk(const char *path, u32 flags, u32 n_iterations)
+{
+    const f64 start = bench_now();
+    for (u32 i = 0; i < n_iterations; i++) {
+        const i32 fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Failed to open \"%s\"\n", path);
+            exit(EXIT_FAILURE);
+        }
+        mtkpart_dump_file(fd, AT_FDCWD, &(struct mtkpart_dump_cfg) {
+            .flags = flags,
+        });
+        close(fd);
+    }
+    return bench_now() - start;
+}
+
+i32 main(void)
+{
+    const u64 scale = bench_env_u64("BENCH_SCALE", 1);
+    FILE *devnull = bench_setup_log();
+
+    char tmpdir[256] = { 0 };
+    bench_make_tmpdir(tmpdir, sizeof(tmpdir));
+    char path[512] = { 0 };
+    (void) snprintf(path, sizeof(path), "%s/walk.bin", tmpdir);
+
+    const struct walk_case cases[] = {
+        { "tiny-bodies", 4096 * scale, 16, false, false },
+        { "tiny-bodies-quiet", 4096 * scale, 16, false, true },
+        { "1M-bodies-sparse", 1024 * scale, 1024 * 1024, true, false },
+        { "1M-bodies-sparse-quiet", 1024 * scale, 1024 * 1024, true, true },
+    };
+    const u32 n_iterations = 8;
+
+    for (u32 i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        const struct walk_case *c = &cases[i];
+
+        struct corpus_params p = CORPUS_PARAMS_DEFAULT;
+        p.n_entries = c->n_entries;
+        p.min_size = p.max_size = c->body_size;
+        p.sparse = c->sparse;
+        if (corpus_generate(path, &p, NULL))
+            return EXIT_FAILURE;
+
+        s_configure_log_level(c->quiet ? S_LOG_DISABLED : S_LOG_INFO);
+        (void) run_walk(path, ARG_FLAG_CHAIN, 1); /* Warm the page cache */
+        const f64 t = run_walk(path, ARG_FLAG_CHAIN, n_iterations);
+        s_configure_log_level(S_LOG_INFO);
+
+        const u64 n_headers = (u64)c->n_entries * n_iterations;
+        bench_report("walk", c->name,
+            "\"engine\":\"pread\",\"headers\":%llu,\"seconds\":%.6f,"
+            "\"headers_per_sec\":%.1f,\"ns_per_header\":%.1f",
+            (unsigned long long)n_headers, t,
+            (f64)n_headers / t, t * 1e9 / (f64)n_headers
+        );
+    }
+
+    bench_clean_dir(tmpdir, true);
+    s_log_cleanup_all();
+    fclose(devnull);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef BENCH_CORPUS_H_
+#define BENCH_CORPUS_H_
+#include <core/static-tests.h>
+
+#include <mtkparthdr.h>
+#include <core/int.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* A generator of synthetic MediaTek partition header chains.
+ *
+ * The generated files follow the same layout as real firmware blobs:
+ * each entry is a 512-byte header (unused bytes filled with `0xFF`)
+ * followed by the partition body, padded to `size_alignment_bytes`.
+ * The last entry has `is_image_list_end` set.
+ *
+ * The including source file must define `_GNU_SOURCE`
+ * (or an equivalent POSIX feature test macro) before any includes. */
+
+struct corpus_params {
+    /* The number of entries (headers) in the chain */
+    u32 n_entries;
+
+    /* The body sizes are picked uniformly from <min_size, max_size> */
+    u64 min_size, max_size;
+
+    /* Value of `size_alignment_bytes` for every entry (0 = unaligned) */
+    u32 alignment;
+
+    /* Every `hi_every`th entry gets a 64-bit size (`part_size_hi != 0`).
+     * 0 disables 64-bit sizes entirely.
+     * Note that such bodies are always at least 4 GiB,
+     * so they are only practical together with `sparse`. */
+    u32 hi_every;
+
+    /* If set, the bodies are left as holes (the file is only extended with
+     * `ftruncate()`), which makes generating huge chains nearly free. */
+    bool sparse;
+
+    /* Seed for the size and content PRNG */
+    u64 seed;
+};
+
+#define CORPUS_PARAMS_DEFAULT (struct corpus_params) {  \
+    .n_entries = 16,                                    \
+    .min_size = 4096,                                   \
+    .max_size = 4096,                                   \
+    .alignment = 16,                                    \
+    .hi_every = 0,                                      \
+    .sparse = false,                                    \
+    .seed = 0x5888168858891689ULL,                      \
+}
+
+/* xorshift64* - good enough for sizes and filler bytes */
+static inline u64 corpus_rand__(u64 *state)
+{
+    u64 x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline i32 corpus_write_all__(i32 fd, const void *buf, u64 size,
+    u64 offset)
+{
+    const u8 *p = buf;
+    while (size > 0) {
+        const ssize_t ret = pwrite(fd, p, size, (off_t)offset);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        else if (ret <= 0)
+            return 1;
+
+        p += ret;
+        offset += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+/* Writes a chain described by `p` to the file at `path`
+ * (overwriting it if it exists).
+ *
+ * If `o_total_size` is not `NULL`, the sum of all the aligned body sizes
+ * (= the number of bytes that a full extraction would write)
+ * is stored in it.
+ *
+ * Returns 0 on success and non-zero on failure. */
+static inline i32 corpus_generate(const char *path,
+    const struct corpus_params *p, u64 *o_total_size)
+{
+#define CORPUS_BUF_SIZE (1024 * 1024)
+    u8 *fill_buf = NULL;
+    i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open \"%s\": %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (!p->sparse) {
+        fill_buf = malloc(CORPUS_BUF_SIZE);
+        if (fill_buf == NULL) {
+            fprintf(stderr, "Failed to allocate the fill buffer\n");
+            goto err;
+        }
+    }
+
+    u64 rand_state = p->seed ? p->seed : 1;
+    u64 offset = 0, total = 0;
+
+    for (u32 i = 0; i < p->n_entries; i++) {
+        union mtk_partition_header hdr;
+        memset(hdr.buf_, 0xFF, sizeof(hdr.buf_));
+
+        u64 size = p->min_size;
+        if (p->max_size > p->min_size)
+            size += corpus_rand__(&rand_state) % (p->max_size - p->min_size + 1);
+        if (p->hi_every && (i + 1) % p->hi_every == 0)
+            size |= 1ULL << 32;
+
+        static const u32 img_types[] = {
+#define X_(name, value) value,
+            MTK_PART_EXT_IMG_TYPE_LIST
+#undef X_
+        };
+
+        hdr.data.magic = MTK_PART_MAGIC;
+        hdr.data.part_size = (u32)size;
+        memset(hdr.data.part_name, 0, MTK_PART_NAME_LEN);
+        (void) snprintf(hdr.data.part_name, MTK_PART_NAME_LEN, "part%u", i);
+        hdr.data.memory_address = 0xFFFFFFFF;
+        hdr.data.memory_address_mode = 0;
+        hdr.data.ext.magic = MTK_PART_EXT_MAGIC;
+        hdr.data.ext.hdr_size = MTK_PART_HEADER_SIZE;
+        hdr.data.ext.hdr_version = 1;
+        hdr.data.ext.img_type = img_types[i % (sizeof(img_types) /
+            sizeof(*img_types))];
+        hdr.data.ext.is_image_list_end = (i == p->n_entries - 1);
+        hdr.data.ext.size_alignment_bytes = p->alignment;
+        hdr.data.ext.part_size_hi = (u32)(size >> 32);
+        hdr.data.ext.memory_address_hi = 0;
+
+        u64 aligned_size = size;
+        if (p->alignment != 0)
+            aligned_size = ((size + p->alignment - 1) / p->alignment)
+                * p->alignment;
+
+        if (corpus_write_all__(fd, hdr.buf_, MTK_PART_HEADER_SIZE, offset))
+            goto err_write;
+        offset += MTK_PART_HEADER_SIZE;
+
+        if (!p->sparse) {
+            u64 left = aligned_size;
+            while (left > 0) {
+                const u64 chunk = left < CORPUS_BUF_SIZE ?
+                    left : CORPUS_BUF_SIZE;
+                for (u64 j = 0; j < chunk; j += sizeof(u64)) {
+                    const u64 r = corpus_rand__(&rand_state);
+                    memcpy(fill_buf + j, &r, chunk - j < sizeof(u64) ?
+                        chunk - j : sizeof(u64));
+                }
+                if (corpus_write_all__(fd, fill_buf, chunk, offset))
+                    goto err_write;
+                offset += chunk;
+                left -= chunk;
+            }
+        } else {
+            offset += aligned_size;
+        }
+        total += aligned_size;
+    }
+
+    if (ftruncate(fd, (off_t)offset)) {
+        fprintf(stderr, "Failed to truncate \"%s\": %s\n",
+            path, strerror(errno));
+        goto err;
+    }
+
+    free(fill_buf);
+    if (close(fd)) {
+        fprintf(stderr, "Failed to close \"%s\": %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (o_total_size != NULL)
+        *o_total_size = total;
+
+    return 0;
+
+err_write:
+    fprintf(stderr, "Failed to write to \"%s\": %s\n", path, strerror(errno));
+err:
+    free(fill_buf);
+    (void) close(fd);
+    return 1;
+#undef CORPUS_BUF_SIZE
+}
+
+#endif /* BENCH_CORPUS_H_ */
@@ -0,0 +1,115 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "corpus.h"
+#include <core/int.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* gen-corpus - write a synthetic MediaTek partition chain to a file.
+ * Used by the benchmarks, but also handy on its own
+ * for producing test inputs of arbitrary shape. */
+
+static void print_usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS...] <OUTPUT_FILE>\n"
+        "Available options:\n"
+        "    -n COUNT: Number of entries in the chain (default: 16)\n"
+        "    -s SIZE: Body size in bytes (default: 4096)\n"
+        "    -S MAX_SIZE: Pick body sizes randomly from <SIZE, MAX_SIZE>\n"
+        "    -a ALIGN: Size alignment (default: 16, 0 = none)\n"
+        "    -H N: Give every Nth entry a 64-bit size (implies -z)\n"
+        "    -z: Leave bodies as holes (sparse file)\n"
+        "    -r SEED: PRNG seed\n"
+        "    -h: Show this message and exit\n",
+        argv0
+    );
+}
+
+static i32 parse_u64(const char *str, u64 *o)
+{
+    char *end = NULL;
+    const unsigned long long val = strtoull(str, &end, 0);
+    if (str[0] == '\0' || end == NULL || *end != '\0')
+        return 1;
+
+    *o = val;
+    return 0;
+}
+
+i32 main(i32 argc, char **argv)
+{
+    struct corpus_params p = CORPUS_PARAMS_DEFAULT;
+    bool max_size_set = false;
+    const char *out_path = NULL;
+
+    for (i32 i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] == '\0') {
+            if (out_path != NULL)
+                goto err_usage;
+            out_path = arg;
+            continue;
+        }
+
+        if (arg[2] != '\0')
+            goto err_usage;
+
+        u64 val = 0;
+        const bool takes_value = strchr("nsSaHr", arg[1]) != NULL;
+        if (takes_value && (i + 1 >= argc || parse_u64(argv[++i], &val))) {
+            fprintf(stderr, "Option \"%s\" requires a numeric value\n", arg);
+            goto err_usage;
+        }
+
+        switch (arg[1]) {
+        case 'n': p.n_entries = (u32)val; break;
+        case 's': p.min_size = val; break;
+        case 'S': p.max_size = val; max_size_set = true; break;
+        case 'a': p.alignment = (u32)val; break;
+        case 'H': p.hi_every = (u32)val; p.sparse = p.sparse || val; break;
+        case 'r': p.seed = val; break;
+        case 'z': p.sparse = true; break;
+        case 'h':
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            fprintf(stderr, "Unknown option \"%s\"\n", arg);
+            goto err_usage;
+        }
+    }
+
+    if (!max_size_set || p.max_size < p.min_size)
+        p.max_size = p.min_size;
+
+    if (out_path == NULL || p.n_entries == 0)
+        goto err_usage;
+
+    u64 total = 0;
+    if (corpus_generate(out_path, &p, &total))
+        return EXIT_FAILURE;
+
+    printf("Wrote %u entries (%llu body bytes) to \"%s\"\n",
+        p.n_entries, (unsigned long long)total, out_path);
+    return EXIT_SUCCESS;
+
+err_usage:
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,188 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "bufpool.h"
+#include "stats.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/vector.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MODULE_NAME "bufpool"
+
+/* Returned buffers are chained through their first bytes */
+struct free_buf {
+    struct free_buf *next;
+};
+
+struct slab {
+    void *mem;
+    u64 size;
+};
+
+static struct bufpool {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    /* The most buffers that may exist at once (0 for no limit) */
+    u64 n_max;
+    u64 n_allocated;
+    bool huge_pages;
+
+    struct free_buf *free_list;
+    VECTOR(struct slab) slabs;
+
+    /* Waiters take a ticket and are served in ticket order */
+    u64 next_ticket;
+    u64 now_serving;
+} g_pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static i32 map_slab(u64 n_bufs);
+
+i32 bufpool_init(u64 mem_limit, bool huge_pages)
+{
+    if (mem_limit != 0 && mem_limit < BUFPOOL_BUF_SIZE) {
+        s_log_error("The memory limit must be at least %u bytes",
+            BUFPOOL_BUF_SIZE);
+        return 1;
+    }
+
+    (void) pthread_mutex_lock(&g_pool.mutex);
+    s_assert(g_pool.n_allocated == 0, "bufpool_init() called too late");
+    g_pool.n_max = mem_limit / BUFPOOL_BUF_SIZE;
+    g_pool.huge_pages = huge_pages;
+    (void) pthread_mutex_unlock(&g_pool.mutex);
+
+    return 0;
+}
+
+u8 * bufpool_get(void)
+{
+    u8 *buf = NULL;
+
+    (void) pthread_mutex_lock(&g_pool.mutex);
+
+    const u64 ticket = g_pool.next_ticket++;
+    bool waited = false;
+    while (ticket != g_pool.now_serving || (g_pool.free_list == NULL &&
+        g_pool.n_max != 0 && g_pool.n_allocated >= g_pool.n_max))
+    {
+        waited = true;
+        (void) pthread_cond_wait(&g_pool.cond, &g_pool.mutex);
+    }
+    if (waited)
+        stats_add(STATS_BUFFER_WAITS, 1);
+
+    if (g_pool.free_list == NULL) {
+        /* A whole slab if the budget allows, so that a huge page
+         * isn't half wasted */
+        const u64 n_bufs = g_pool.n_max == 0 ||
+            g_pool.n_max - g_pool.n_allocated >= 2 ? 2 : 1;
+        (void) map_slab(n_bufs);
+    }
+
+    if (g_pool.free_list != NULL) {
+        buf = (u8 *)g_pool.free_list;
+        g_pool.free_list = g_pool.free_list->next;
+    }
+
+    /* Let the next waiter in */
+    g_pool.now_serving++;
+    (void) pthread_cond_broadcast(&g_pool.cond);
+    (void) pthread_mutex_unlock(&g_pool.mutex);
+
+    return buf;
+}
+
+void bufpool_put(u8 *buf)
+{
+    if (buf == NULL)
+        return;
+
+    (void) pthread_mutex_lock(&g_pool.mutex);
+    struct free_buf *f = (struct free_buf *)buf;
+    f->next = g_pool.free_list;
+    g_pool.free_list = f;
+    (void) pthread_cond_broadcast(&g_pool.cond);
+    (void) pthread_mutex_unlock(&g_pool.mutex);
+}
+
+void bufpool_destroy(void)
+{
+    (void) pthread_mutex_lock(&g_pool.mutex);
+    if (g_pool.slabs != NULL) {
+        for (u64 i = 0; i < vector_size(g_pool.slabs); i++)
+            (void) munmap(g_pool.slabs[i].mem, g_pool.slabs[i].size);
+        vector_destroy(&g_pool.slabs);
+    }
+    g_pool.free_list = NULL;
+    g_pool.n_allocated = 0;
+    (void) pthread_mutex_unlock(&g_pool.mutex);
+}
+
+/* Maps `n_bufs` new buffers and puts them on the free list.
+ * Must be called with the mutex held. */
+static i32 map_slab(u64 n_bufs)
+{
+    const u64 size = n_bufs * BUFPOOL_BUF_SIZE;
+    void *mem = MAP_FAILED;
+
+    if (g_pool.huge_pages && size == BUFPOOL_SLAB_SIZE) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (mem == MAP_FAILED) {
+            /* No explicit huge pages reserved - fall back to THP */
+            mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem != MAP_FAILED && madvise(mem, size, MADV_HUGEPAGE))
+                s_log_debug("madvise(MADV_HUGEPAGE) failed: %s",
+                    strerror(errno));
+        }
+    } else {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (mem == MAP_FAILED) {
+        s_log_error("Failed to map %llu bytes of buffers: %s",
+            (unsigned long long)size, strerror(errno));
+        return 1;
+    }
+
+    if (g_pool.slabs == NULL)
+        g_pool.slabs = vector_new(struct slab);
+    const struct slab slab = { .mem = mem, .size = size };
+    vector_push_back(&g_pool.slabs, slab);
+
+    for (u64 i = 0; i < n_bufs; i++) {
+        struct free_buf *f = (struct free_buf *)((u8 *)mem
+            + i * BUFPOOL_BUF_SIZE);
+        f->next = g_pool.free_list;
+        g_pool.free_list = f;
+    }
+    g_pool.n_allocated += n_bufs;
+
+    return 0;
+}
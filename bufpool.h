@@ -0,0 +1,66 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef BUFPOOL_H_
+#define BUFPOOL_H_
+
+#include <core/int.h>
+#include <stdbool.h>
+
+/* The global pool of I/O buffers.
+ *
+ * Everything that reads partition bodies (extraction, `--verify`,
+ * `--diff`, `--serve`, ...) borrows a buffer from here for as long as
+ * it needs one and then returns it, so the total size of all the I/O
+ * buffers never exceeds the budget set with `--mem-limit`,
+ * however many threads there are. A borrower that finds the budget
+ * used up blocks until a buffer is returned; waiters are served
+ * strictly in the order they arrived in.
+ *
+ * The buffers are page-aligned and are mapped in `BUFPOOL_SLAB_SIZE`
+ * slabs (one huge page each, with `--huge-pages`). Returned buffers
+ * are kept for reuse until `bufpool_destroy()`.
+ *
+ * A thread must never hold more than one buffer at a time, and must not
+ * wait for a task that needs a buffer while holding one, or it could
+ * deadlock with the smallest budgets. */
+
+/* The size of every buffer */
+#define BUFPOOL_BUF_SIZE (1024 * 1024)
+
+/* Buffers are mapped in slabs of this size */
+#define BUFPOOL_SLAB_SIZE (2 * BUFPOOL_BUF_SIZE)
+
+/* Sets the budget to `mem_limit` bytes (at least `BUFPOOL_BUF_SIZE`;
+ * 0 means no limit, which is the default), and backs the buffers
+ * with huge pages if `huge_pages` is set. Must be called
+ * before any buffer is borrowed. Returns 0 on success
+ * and non-zero if `mem_limit` is too small. */
+i32 bufpool_init(u64 mem_limit, bool huge_pages);
+
+/* Borrows a buffer of `BUFPOOL_BUF_SIZE` bytes,
+ * waiting for one to be returned if the budget is used up.
+ * Returns `NULL` only if a new buffer couldn't be mapped. */
+u8 * bufpool_get(void);
+
+/* Returns the buffer `buf` (from `bufpool_get`) to the pool.
+ * `buf` may be `NULL`. */
+void bufpool_put(u8 *buf);
+
+/* Unmaps all the buffers, which must have been returned by now */
+void bufpool_destroy(void);
+
+#endif /* BUFPOOL_H_ */
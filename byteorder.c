@@ -0,0 +1,81 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "byteorder.h"
+#include "mtkparthdr.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <endian.h>
+#include <string.h>
+
+#define MODULE_NAME "byteorder"
+
+#define X_(field) out->field = le32toh(in->data.field);
+static void parse_header_le(struct mtk_partition_header_data *out,
+    const union mtk_partition_header *in)
+{
+    MTK_PART_HEADER_U32_FIELD_LIST
+    memcpy(out->part_name, in->data.part_name, MTK_PART_NAME_LEN);
+}
+#undef X_
+
+#define X_(field) out->field = be32toh(in->data.field);
+static void parse_header_be(struct mtk_partition_header_data *out,
+    const union mtk_partition_header *in)
+{
+    MTK_PART_HEADER_U32_FIELD_LIST
+    memcpy(out->part_name, in->data.part_name, MTK_PART_NAME_LEN);
+}
+#undef X_
+
+enum mtk_part_byte_order
+mtk_part_detect_byte_order(const union mtk_partition_header *hdr)
+{
+    return mtk_part_detect_magic_byte_order(hdr->data.magic);
+}
+
+enum mtk_part_byte_order
+mtk_part_detect_magic_byte_order(u32 raw_magic)
+{
+    if (le32toh(raw_magic) == MTK_PART_MAGIC)
+        return MTK_PART_BYTE_ORDER_LE;
+    else if (be32toh(raw_magic) == MTK_PART_MAGIC)
+        return MTK_PART_BYTE_ORDER_BE;
+    else
+        return MTK_PART_BYTE_ORDER_UNKNOWN;
+}
+
+mtk_part_header_parser_t
+mtk_part_get_header_parser(enum mtk_part_byte_order order)
+{
+    switch (order) {
+    case MTK_PART_BYTE_ORDER_LE: return parse_header_le;
+    case MTK_PART_BYTE_ORDER_BE: return parse_header_be;
+    default:
+        s_log_fatal("Invalid byte order %d", (i32)order);
+    }
+}
+
+const char * mtk_part_byte_order_string(enum mtk_part_byte_order order)
+{
+    switch (order) {
+    case MTK_PART_BYTE_ORDER_LE: return "little-endian";
+    case MTK_PART_BYTE_ORDER_BE: return "big-endian";
+    default: return "unknown";
+    }
+}
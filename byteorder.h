@@ -0,0 +1,62 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef BYTEORDER_H_
+#define BYTEORDER_H_
+
+#include "mtkparthdr.h"
+#include <core/int.h>
+
+/* Most blobs store their headers in little-endian byte order,
+ * but some vendors store them big-endian (`MTK_PART_MAGIC_BE`).
+ *
+ * The byte order is detected once per file from the first header's magic,
+ * and the matching parser is then used for every header in the chain.
+ * Both parsers are generated from `MTK_PART_HEADER_U32_FIELD_LIST`,
+ * so the one matching the host's byte order compiles down
+ * to a plain copy, without any per-field checks. */
+
+enum mtk_part_byte_order {
+    MTK_PART_BYTE_ORDER_UNKNOWN,
+    MTK_PART_BYTE_ORDER_LE,
+    MTK_PART_BYTE_ORDER_BE,
+};
+
+/* Converts the raw header `in` to host byte order and stores it in `out` */
+typedef void (*mtk_part_header_parser_t)(
+    struct mtk_partition_header_data *out,
+    const union mtk_partition_header *in
+);
+
+/* Returns the byte order of the raw header `hdr` based on its magic,
+ * or `MTK_PART_BYTE_ORDER_UNKNOWN` if the magic is invalid */
+enum mtk_part_byte_order
+mtk_part_detect_byte_order(const union mtk_partition_header *hdr);
+
+/* Same as `mtk_part_detect_byte_order`, but only needs the raw magic
+ * (the first 4 bytes of the header, as stored in the file) */
+enum mtk_part_byte_order
+mtk_part_detect_magic_byte_order(u32 raw_magic);
+
+/* Returns the parser for headers stored in byte order `order`.
+ * `order` must not be `MTK_PART_BYTE_ORDER_UNKNOWN`. */
+mtk_part_header_parser_t
+mtk_part_get_header_parser(enum mtk_part_byte_order order);
+
+/* Returns a human-readable name of `order` (e.g. "little-endian") */
+const char * mtk_part_byte_order_string(enum mtk_part_byte_order order);
+
+#endif /* BYTEORDER_H_ */
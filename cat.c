@@ -0,0 +1,130 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "cat.h"
+#include "chainindex.h"
+#include "mtkparthdr.h"
+#include "mtkpartdump.h"
+#include "stats.h"
+#include "io.h"
+#include "bufpool.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/trace.h>
+#include <core/vector.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MODULE_NAME "cat"
+
+static const struct chain_entry * find_entry(const struct chain_index *ci,
+    const char *selector, u64 *o_index);
+
+i32 cat_part(const char *path, const char *selector, i32 out_fd)
+{
+    u_check_params(path != NULL && selector != NULL && out_fd >= 0);
+
+    struct chain_index ci = { 0 };
+    bool have_index = false;
+    u8 *buf = NULL;
+
+    stats_add(STATS_SYSCALLS, 1);
+    const i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        goto_error("Failed to open \"%s\": %s", path, strerror(errno));
+    stats_add(STATS_FILES_PROCESSED, 1);
+
+    if (chain_index_build(&ci, fd))
+        goto_error("\"%s\" doesn't start with a valid partition header", path);
+    have_index = true;
+    stats_add(STATS_HEADERS, vector_size(ci.entries));
+
+    u64 index = 0;
+    const struct chain_entry *e = find_entry(&ci, selector, &index);
+    if (e == NULL)
+        goto_error("No partition \"%s\" in \"%s\"", selector, path);
+
+    const u64 size = get_full_part_size(&e->hdr);
+    s_log_verbose("Writing the body of [%llu] \"%.32s\" (%llu bytes)...",
+        (unsigned long long)index, e->hdr.part_name,
+        (unsigned long long)size);
+
+    /* Only used if the data can't be moved by the kernel */
+    buf = bufpool_get();
+    if (buf == NULL)
+        goto_error("Failed to get a copy buffer");
+
+    const u64 body_offset = e->hdr_offset + MTK_PART_HEADER_SIZE;
+    io_cache_will_read(fd, body_offset, size);
+
+    trace_begin("extract", "cat", selector);
+    const i64 n_copied = io_copy_range(out_fd, fd, body_offset, size,
+        buf, MTKPART_EXTRACT_BUF_SIZE);
+    trace_end("extract", "cat");
+    io_cache_done_reading(fd, body_offset, size);
+    if (n_copied < 0) {
+        goto_error("Failed to write the body of \"%.32s\": %s",
+            e->hdr.part_name, strerror(errno));
+    } else if ((u64)n_copied != size) {
+        goto_error("Input file doesn't contain the full partition "
+            "content (unexpected end of file while reading)!");
+    }
+
+    bufpool_put(buf);
+    chain_index_destroy(&ci);
+    (void) close(fd);
+    return 0;
+
+err:
+    bufpool_put(buf);
+    if (have_index)
+        chain_index_destroy(&ci);
+    if (fd >= 0)
+        (void) close(fd);
+    return 1;
+}
+
+static const struct chain_entry * find_entry(const struct chain_index *ci,
+    const char *selector, u64 *o_index)
+{
+    if (strlen(selector) <= MTK_PART_NAME_LEN) {
+        for (u64 i = 0; i < vector_size(ci->entries); i++) {
+            if (!strncmp(ci->entries[i].hdr.part_name, selector,
+                    MTK_PART_NAME_LEN))
+            {
+                *o_index = i;
+                return &ci->entries[i];
+            }
+        }
+    }
+
+    char *end = NULL;
+    errno = 0;
+    const unsigned long long index = strtoull(selector, &end, 0);
+    if (errno || end == selector || *end != '\0' ||
+        index >= vector_size(ci->entries))
+    {
+        return NULL;
+    }
+
+    *o_index = index;
+    return &ci->entries[index];
+}
@@ -0,0 +1,36 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef CAT_H_
+#define CAT_H_
+
+#include <core/int.h>
+
+/* Writing a single partition's body to a file descriptor
+ * (`--cat NAME|INDEX`), e.g. to pipe it into another program.
+ *
+ * The body is moved with `io_copy_range()`, so when the output
+ * is a pipe or a regular file, the data never passes through user space. */
+
+/* Writes the body (without the alignment padding) of the entry of the chain
+ * in `path` selected by `selector` to `out_fd`. `selector` is either
+ * a partition name (the first entry with that name is used)
+ * or, if no entry has that name, the index of an entry
+ * (in decimal, or in hex with a "0x" prefix).
+ * Returns 0 on success and non-zero on failure. */
+i32 cat_part(const char *path, const char *selector, i32 out_fd);
+
+#endif /* CAT_H_ */
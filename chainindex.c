@@ -0,0 +1,113 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "chainindex.h"
+#include "mtkparthdr.h"
+#include "byteorder.h"
+#include "stats.h"
+#include "io.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/vector.h>
+#include <errno.h>
+#include <string.h>
+
+#define MODULE_NAME "chainindex"
+
+i32 chain_index_build(struct chain_index *out, i32 fd)
+{
+    u_check_params(out != NULL && fd >= 0);
+
+    /* Not `fstat()`, so that block devices work too */
+    const i64 file_size = io_get_size(fd);
+    if (file_size < 0) {
+        s_log_error("Failed to get the size of the file: %s",
+            strerror(errno));
+        memset(out, 0, sizeof(struct chain_index));
+        return 1;
+    }
+
+    return chain_index_build_range(out, fd, 0, file_size);
+}
+
+i32 chain_index_build_range(struct chain_index *out, i32 fd,
+    u64 start, u64 end)
+{
+    u_check_params(out != NULL && fd >= 0 && start <= end);
+    memset(out, 0, sizeof(struct chain_index));
+
+    out->file_size = end;
+    out->entries = vector_new(struct chain_entry);
+
+    mtk_part_header_parser_t parse_header = NULL;
+    u64 offset = start;
+    while (offset < end && end - offset >= MTK_PART_HEADER_SIZE) {
+        union mtk_partition_header raw;
+        const i64 n_read =
+            io_pread_full(fd, raw.buf_, MTK_PART_HEADER_SIZE, offset);
+        if (n_read != MTK_PART_HEADER_SIZE)
+            break;
+
+        if (parse_header == NULL) {
+            out->byte_order = mtk_part_detect_byte_order(&raw);
+            if (out->byte_order == MTK_PART_BYTE_ORDER_UNKNOWN)
+                break;
+            parse_header = mtk_part_get_header_parser(out->byte_order);
+        }
+
+        struct chain_entry e = { .hdr_offset = offset };
+        parse_header(&e.hdr, &raw);
+        if (e.hdr.magic != MTK_PART_MAGIC)
+            break;
+
+        stats_add(STATS_HEADERS, 1);
+
+        vector_push_back(&out->entries, e);
+
+        /* A body that doesn't fit in the range ends the chain,
+         * which is then incomplete */
+        const u64 body_size = get_full_aligned_part_size(&e.hdr);
+        if (body_size > end - offset - MTK_PART_HEADER_SIZE)
+            break;
+
+        if (e.hdr.ext.magic != MTK_PART_EXT_MAGIC ||
+            e.hdr.ext.is_image_list_end)
+        {
+            out->complete = true;
+            break;
+        }
+        offset += MTK_PART_HEADER_SIZE + body_size;
+    }
+
+    if (vector_size(out->entries) == 0) {
+        chain_index_destroy(out);
+        return 1;
+    }
+
+    return 0;
+}
+
+void chain_index_destroy(struct chain_index *ci)
+{
+    if (ci == NULL)
+        return;
+
+    if (ci->entries != NULL)
+        vector_destroy(&ci->entries);
+    memset(ci, 0, sizeof(struct chain_index));
+}
@@ -0,0 +1,68 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef CHAININDEX_H_
+#define CHAININDEX_H_
+
+#include "mtkparthdr.h"
+#include "byteorder.h"
+#include <core/int.h>
+#include <core/vector.h>
+#include <stdbool.h>
+
+/* An in-memory index of a file's header chain:
+ * where every header is and what it says (in host byte order).
+ *
+ * Building it costs one `pread()` per header; afterwards,
+ * listing the chain or finding an entry needs no I/O at all,
+ * which is what makes it worth caching (e.g. in `--serve` mode). */
+
+struct chain_entry {
+    u64 hdr_offset;
+    struct mtk_partition_header_data hdr;
+};
+
+struct chain_index {
+    enum mtk_part_byte_order byte_order;
+    VECTOR(struct chain_entry) entries;
+
+    /* The size of the file when the index was built
+     * (or the end of the range, for `chain_index_build_range`) */
+    u64 file_size;
+
+    /* Whether the chain ended properly (with `is_image_list_end`,
+     * or an entry without the extension), rather than with a read error,
+     * the end of the file, a body that doesn't fit or a bad magic */
+    bool complete;
+};
+
+/* Walks the chain in `fd` and stores its index in `out`.
+ * A chain that breaks off after at least one valid header
+ * is still indexed (with `complete` set to false).
+ *
+ * Returns 0 on success and non-zero if the file can't be read
+ * or doesn't start with a valid header. */
+i32 chain_index_build(struct chain_index *out, i32 fd);
+
+/* Same as `chain_index_build`, but for a chain that starts at `start`
+ * and must fit (bodies included) before `end`, e.g. one nested
+ * in the body of another entry */
+i32 chain_index_build_range(struct chain_index *out, i32 fd,
+    u64 start, u64 end);
+
+void chain_index_destroy(struct chain_index *ci);
+
+#endif /* CHAININDEX_H_ */
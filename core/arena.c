@@ -0,0 +1,246 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "arena.h"
+#include "int.h"
+#include "log.h"
+#include "util.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MODULE_NAME "arena"
+
+struct arena_block {
+    struct arena_block *next;
+    u64 size; /* The size of the whole mapping, including this header */
+    u64 used; /* Offset of the first free byte from the block start */
+    u64 last_alloc; /* Offset of the most recent allocation */
+};
+
+#define BLOCK_HEADER_SIZE \
+    ((sizeof(struct arena_block) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+static struct arena_block * block_create(u64 size, u32 flags);
+static void * block_alloc(struct arena_block *b, u64 size);
+static u64 round_up(u64 x, u64 align);
+
+struct arena * arena_create(u64 block_size, u32 flags)
+{
+    struct arena *a = calloc(1, sizeof(struct arena));
+    s_assert(a != NULL, "calloc() failed for arena");
+
+    a->flags = flags;
+    a->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    if (flags & ARENA_FLAG_HUGE_PAGES)
+        a->block_size = round_up(a->block_size, ARENA_HUGE_PAGE_SIZE);
+
+    a->first = a->current = block_create(a->block_size, flags);
+    if (a->first == NULL) {
+        s_log_error("Failed to create the first block");
+        u_nzfree(&a);
+        return NULL;
+    }
+
+    return a;
+}
+
+void * arena_alloc(struct arena *a, u64 size)
+{
+    u_check_params(a != NULL);
+    if (size == 0)
+        size = 1;
+
+    void *ret = block_alloc(a->current, size);
+    if (ret != NULL)
+        return ret;
+
+    /* Try the (already mapped) blocks left over from before a reset */
+    while (a->current->next != NULL) {
+        a->current = a->current->next;
+        ret = block_alloc(a->current, size);
+        if (ret != NULL)
+            return ret;
+    }
+
+    /* Map a new block, big enough for `size` */
+    u64 new_size = a->block_size;
+    if (size + BLOCK_HEADER_SIZE > new_size) {
+        new_size = round_up(size + BLOCK_HEADER_SIZE,
+            (a->flags & ARENA_FLAG_HUGE_PAGES) ? ARENA_HUGE_PAGE_SIZE : 4096);
+    }
+
+    struct arena_block *b = block_create(new_size, a->flags);
+    if (b == NULL)
+        return NULL;
+
+    a->current->next = b;
+    a->current = b;
+
+    return block_alloc(b, size);
+}
+
+void * arena_calloc(struct arena *a, u64 size)
+{
+    void *ret = arena_alloc(a, size);
+    if (ret != NULL)
+        memset(ret, 0, size);
+
+    return ret;
+}
+
+void * arena_realloc(struct arena *a, void *ptr, u64 old_size, u64 new_size)
+{
+    u_check_params(a != NULL);
+
+    if (ptr == NULL)
+        return arena_alloc(a, new_size);
+
+    struct arena_block *b = a->current;
+    u8 *const last = (u8 *)b + b->last_alloc;
+
+    /* Grow or shrink the most recent allocation in place */
+    if ((u8 *)ptr == last && b->last_alloc + new_size <= b->size) {
+        b->used = round_up(b->last_alloc + new_size, ARENA_ALIGNMENT);
+        return ptr;
+    }
+
+    if (new_size <= old_size)
+        return ptr;
+
+    void *new_ptr = arena_alloc(a, new_size);
+    if (new_ptr != NULL)
+        memcpy(new_ptr, ptr, old_size);
+
+    return new_ptr;
+}
+
+char * arena_sprintf(struct arena *a, const char *fmt, ...)
+{
+    u_check_params(a != NULL && fmt != NULL);
+
+    va_list vlist;
+    va_start(vlist, fmt);
+    const i32 size = vsnprintf(NULL, 0, fmt, vlist);
+    va_end(vlist);
+    if (size < 0)
+        return NULL;
+
+    char *buf = arena_alloc(a, size + 1);
+    if (buf == NULL)
+        return NULL;
+
+    va_start(vlist, fmt);
+    (void) vsnprintf(buf, size + 1, fmt, vlist);
+    va_end(vlist);
+
+    return buf;
+}
+
+void arena_reset(struct arena *a)
+{
+    if (a == NULL) return;
+
+    for (struct arena_block *b = a->first; b != NULL; b = b->next)
+        b->used = b->last_alloc = BLOCK_HEADER_SIZE;
+
+    a->current = a->first;
+}
+
+u64 arena_used(const struct arena *a)
+{
+    if (a == NULL) return 0;
+
+    u64 total = 0;
+    for (struct arena_block *b = a->first; b != NULL; b = b->next)
+        total += b->used - BLOCK_HEADER_SIZE;
+
+    return total;
+}
+
+void arena_destroy(struct arena **a_p)
+{
+    if (a_p == NULL || *a_p == NULL) return;
+    struct arena *a = *a_p;
+
+    struct arena_block *b = a->first;
+    while (b != NULL) {
+        struct arena_block *next = b->next;
+        if (munmap(b, b->size))
+            s_log_error("munmap() failed: %s", strerror(errno));
+        b = next;
+    }
+
+    u_nzfree(a_p);
+}
+
+static struct arena_block * block_create(u64 size, u32 flags)
+{
+    void *mem = MAP_FAILED;
+
+    if (flags & ARENA_FLAG_HUGE_PAGES) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (mem == MAP_FAILED) {
+            /* No explicit huge pages reserved - fall back to THP */
+            mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem != MAP_FAILED && madvise(mem, size, MADV_HUGEPAGE))
+                s_log_debug("madvise(MADV_HUGEPAGE) failed: %s", strerror(errno));
+        }
+    } else {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (mem == MAP_FAILED) {
+        s_log_error("Failed to map a %llu-byte block: %s",
+            (unsigned long long)size, strerror(errno));
+        return NULL;
+    }
+
+    struct arena_block *b = mem;
+    b->next = NULL;
+    b->size = size;
+    b->used = b->last_alloc = BLOCK_HEADER_SIZE;
+
+    return b;
+}
+
+static void * block_alloc(struct arena_block *b, u64 size)
+{
+    if (size > b->size - b->used)
+        return NULL;
+
+    const u64 offset = b->used;
+    b->used = round_up(offset + size, ARENA_ALIGNMENT);
+    if (b->used > b->size) /* Only the alignment padding didn't fit */
+        b->used = b->size;
+    b->last_alloc = offset;
+
+    return (u8 *)b + offset;
+}
+
+static u64 round_up(u64 x, u64 align)
+{
+    return (x + align - 1) & ~(align - 1);
+}
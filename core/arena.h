@@ -0,0 +1,94 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef U_ARENA_H_
+#define U_ARENA_H_
+#include "static-tests.h"
+
+#include "int.h"
+
+/* A bump allocator for short-lived allocations with a common lifetime
+ * (e.g. everything that's needed while processing a single file).
+ *
+ * Memory is handed out sequentially from large `mmap()`-ed blocks,
+ * and is never freed individually - instead, `arena_reset()` makes
+ * all of it available again at once (keeping the blocks mapped),
+ * so after warming up, an arena doesn't make any syscalls at all.
+ *
+ * An arena is NOT thread-safe; use one arena per thread. */
+
+/* The default size of a single block */
+#define ARENA_DEFAULT_BLOCK_SIZE (4ULL * 1024 * 1024)
+
+/* The alignment of all returned pointers */
+#define ARENA_ALIGNMENT 16ULL
+
+/* The size of a huge page (on x86_64 and aarch64 with 4K pages) */
+#define ARENA_HUGE_PAGE_SIZE (2ULL * 1024 * 1024)
+
+enum arena_flags {
+    /* Back the arena with huge pages. Explicit huge pages (`MAP_HUGETLB`)
+     * are tried first, then transparent huge pages (`MADV_HUGEPAGE`).
+     * Block sizes are rounded up to a multiple of `ARENA_HUGE_PAGE_SIZE`. */
+    ARENA_FLAG_HUGE_PAGES = 1 << 0,
+};
+
+struct arena_block;
+struct arena {
+    u64 block_size;
+    u32 flags;
+
+    /* All the blocks, in the order they're used in */
+    struct arena_block *first;
+    /* The block that allocations currently come from */
+    struct arena_block *current;
+};
+
+/* Creates a new arena with blocks of `block_size` bytes
+ * (or `ARENA_DEFAULT_BLOCK_SIZE` if it's 0).
+ * Returns `NULL` on failure. */
+struct arena * arena_create(u64 block_size, u32 flags);
+
+/* Returns a pointer to `size` bytes of uninitialized memory,
+ * or `NULL` on failure */
+void * arena_alloc(struct arena *a, u64 size);
+
+/* Same as `arena_alloc()`, but the memory is zeroed */
+void * arena_calloc(struct arena *a, u64 size);
+
+/* Resizes the allocation `ptr` (of `old_size` bytes) to `new_size` bytes.
+ * If `ptr` is the most recent allocation and the current block
+ * has enough room, it's resized in place; otherwise, the contents are copied
+ * over to a new allocation (and the old one is just abandoned).
+ * `ptr` may be `NULL`. Returns `NULL` on failure. */
+void * arena_realloc(struct arena *a, void *ptr, u64 old_size, u64 new_size);
+
+/* Formats a string with `printf()`-style `fmt` into the arena.
+ * Returns `NULL` on failure. */
+char * arena_sprintf(struct arena *a, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Marks all the memory in the arena as free, invalidating all pointers
+ * returned from it. The blocks themselves stay mapped for reuse. */
+void arena_reset(struct arena *a);
+
+/* Returns the number of bytes currently allocated from the arena */
+u64 arena_used(const struct arena *a);
+
+/* Unmaps all of `*a_p`'s memory, and sets `*a_p` to `NULL` */
+void arena_destroy(struct arena **a_p);
+
+#endif /* U_ARENA_H_ */
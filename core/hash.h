@@ -0,0 +1,347 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef U_HASH_H_
+#define U_HASH_H_
+#include "static-tests.h"
+
+#include "int.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HASH_BLOCK_HAVE_AVX2__
+#endif
+
+/* A fast, non-cryptographic 64-bit hash of arbitrary bytes.
+ *
+ * This is wyhash (final version 4, public domain, by Wang Yi),
+ * which processes 48 bytes per iteration with 64x64->128 bit multiplies
+ * and passes SMHasher. Not suitable for anything security-related. */
+
+#define HASH_DEFAULT_SEED 0x9e3779b97f4a7c15ULL
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 hash_u128__;
+#endif
+
+static const u64 hash_wyp__[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL,
+};
+
+/* Sets `*a` and `*b` to the low and high halves of `*a * *b` */
+static inline void hash_wymum__(u64 *a, u64 *b)
+{
+#ifdef __SIZEOF_INT128__
+    hash_u128__ r = *a;
+    r *= *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+#else
+    /* No 128-bit integers (32-bit targets) - multiply the 32-bit halves */
+    const u64 ha = *a >> 32, hb = *b >> 32;
+    const u64 la = (u32)*a, lb = (u32)*b;
+    const u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const u64 t = rl + (rm0 << 32);
+    u64 c = t < rl;
+    const u64 lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline u64 hash_wymix__(u64 a, u64 b)
+{
+    hash_wymum__(&a, &b);
+    return a ^ b;
+}
+
+static inline u64 hash_wyr8__(const u8 *p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u64 hash_wyr4__(const u8 *p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u64 hash_wyr3__(const u8 *p, u64 k)
+{
+    return ((u64)p[0] << 16) | ((u64)p[k >> 1] << 8) | p[k - 1];
+}
+
+/* Returns the 64-bit hash of the `len` bytes at `data` */
+static inline u64 hash_bytes(const void *data, u64 len, u64 seed)
+{
+    const u8 *p = data;
+    const u64 *s = hash_wyp__;
+    seed ^= hash_wymix__(seed ^ s[0], s[1]);
+
+    u64 a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (hash_wyr4__(p) << 32) | hash_wyr4__(p + ((len >> 3) << 2));
+            b = (hash_wyr4__(p + len - 4) << 32)
+                | hash_wyr4__(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = hash_wyr3__(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        u64 i = len;
+        if (i > 48) {
+            u64 see1 = seed, see2 = seed;
+            do {
+                seed = hash_wymix__(hash_wyr8__(p) ^ s[1],
+                    hash_wyr8__(p + 8) ^ seed);
+                see1 = hash_wymix__(hash_wyr8__(p + 16) ^ s[2],
+                    hash_wyr8__(p + 24) ^ see1);
+                see2 = hash_wymix__(hash_wyr8__(p + 32) ^ s[3],
+                    hash_wyr8__(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_wymix__(hash_wyr8__(p) ^ s[1],
+                hash_wyr8__(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = hash_wyr8__(p + i - 16);
+        b = hash_wyr8__(p + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+    hash_wymum__(&a, &b);
+    return hash_wymix__(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+/* Returns the 64-bit hash of the NUL-terminated string `str` */
+static inline u64 hash_string(const char *str)
+{
+    return hash_bytes(str, strlen(str), HASH_DEFAULT_SEED);
+}
+
+/* A second 64-bit hash, for long runs of bytes (e.g. 64 KiB blocks
+ * of partition bodies), where `hash_bytes` is limited by its
+ * serial 64x64->128 bit multiplies.
+ *
+ * It has the same structure as XXH3's long-input loop: 8 independent
+ * 64-bit lanes, each of which adds the 32x32->64 bit product of the
+ * two halves of (input ^ key) per 64-byte stripe, with the key sliding
+ * by one lane every stripe (so that reordered stripes hash differently)
+ * and the lanes scrambled every `HASH_BLOCK_ROUND_SIZE` bytes.
+ * That maps directly onto SIMD (`pmuludq`), so there are SSE2 and AVX2
+ * versions next to the portable one (the AVX2 one is picked at runtime
+ * on CPUs that have it); all of them produce the same results.
+ * The tail (< 64 bytes) and the final lanes are mixed in with `hash_bytes`.
+ *
+ * Like `hash_bytes`, the results depend on the host byte order. */
+
+#define HASH_BLOCK_N_LANES 8
+#define HASH_BLOCK_STRIPE_SIZE (HASH_BLOCK_N_LANES * sizeof(u64))
+#define HASH_BLOCK_STRIPES_PER_ROUND 16
+#define HASH_BLOCK_ROUND_SIZE \
+    (HASH_BLOCK_STRIPES_PER_ROUND * HASH_BLOCK_STRIPE_SIZE)
+
+/* The stripe keys (`[0, 23)`, a sliding window of 8 per stripe)
+ * and the scramble keys (`[16, 24)`), from splitmix64 */
+static const u64 hash_block_keys__[24] = {
+    0x2cb0f69f4abea221ULL, 0x9417034723148989ULL, 0xdd555950609dfe03ULL,
+    0xdbafb150deb12800ULL, 0x7e789b2e6c442cb6ULL, 0xf41e5636c7e4f8c4ULL,
+    0x0959d150f8fba7e4ULL, 0xa97316f13cdb9eeaULL, 0x74cd8258f9520068ULL,
+    0x55c74a62e116868bULL, 0xd2f4c799a2023cbdULL, 0xdf98cb79a37b51b9ULL,
+    0x396f5885524f3905ULL, 0xaf1d56386ca3b276ULL, 0xa9ffbe6b5104e85aULL,
+    0x6bd0c51b9fd533b3ULL, 0x980ce91c50ab4b56ULL, 0x28ac395780fe62c5ULL,
+    0x768912e3a6bcedc7ULL, 0x50b3e8c9332c7c88ULL, 0xce3bbfe520bd47daULL,
+    0xcba6c8e8e0bb7c4fULL, 0xbf194db8434a346dULL, 0x7d8f2a7b60416d7fULL,
+};
+#define HASH_BLOCK_SCRAMBLE_KEYS__ (hash_block_keys__ + 16)
+
+/* A 32-bit prime, so that the scramble multiply also works with `pmuludq` */
+#define HASH_BLOCK_PRIME32__ 0x9E3779B1U
+
+/* Accumulates the `n_stripes` 64-byte stripes at `p` into `acc`,
+ * scrambling it after every full round */
+static inline void hash_block_accumulate_scalar__(
+    u64 acc[HASH_BLOCK_N_LANES], const u8 *p, u64 n_stripes)
+{
+    for (u64 n = 0; n < n_stripes; n++) {
+        const u32 stripe = n % HASH_BLOCK_STRIPES_PER_ROUND;
+        const u64 *key = hash_block_keys__ + stripe;
+        for (u32 i = 0; i < HASH_BLOCK_N_LANES; i++) {
+            const u64 v = hash_wyr8__(p + i * sizeof(u64));
+            const u64 k = v ^ key[i];
+            acc[i ^ 1] += v;
+            acc[i] += (k & 0xFFFFFFFFULL) * (k >> 32);
+        }
+        p += HASH_BLOCK_STRIPE_SIZE;
+
+        if (stripe == HASH_BLOCK_STRIPES_PER_ROUND - 1) {
+            for (u32 i = 0; i < HASH_BLOCK_N_LANES; i++) {
+                u64 a = acc[i];
+                a ^= a >> 47;
+                a ^= HASH_BLOCK_SCRAMBLE_KEYS__[i];
+                acc[i] = a * HASH_BLOCK_PRIME32__;
+            }
+        }
+    }
+}
+
+#if defined(__SSE2__)
+/* `hash_block_accumulate_scalar__`, two lanes per register */
+static inline void hash_block_accumulate_sse2__(
+    u64 acc[HASH_BLOCK_N_LANES], const u8 *p, u64 n_stripes)
+{
+    __m128i a[HASH_BLOCK_N_LANES / 2];
+    for (u32 j = 0; j < HASH_BLOCK_N_LANES / 2; j++)
+        a[j] = _mm_loadu_si128((const __m128i *)(acc + 2 * j));
+
+    const __m128i prime = _mm_set1_epi32((i32)HASH_BLOCK_PRIME32__);
+    for (u64 n = 0; n < n_stripes; n++) {
+        const u32 stripe = n % HASH_BLOCK_STRIPES_PER_ROUND;
+        const u64 *key = hash_block_keys__ + stripe;
+        for (u32 j = 0; j < HASH_BLOCK_N_LANES / 2; j++) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)p + j);
+            const __m128i k = _mm_xor_si128(v,
+                _mm_loadu_si128((const __m128i *)(key + 2 * j)));
+            /* The high halves of `k`, moved to the low ones */
+            const __m128i k_hi = _mm_shuffle_epi32(k, _MM_SHUFFLE(3, 3, 1, 1));
+            /* `v` with its two 64-bit lanes swapped */
+            const __m128i v_swapped =
+                _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm_add_epi64(a[j], v_swapped);
+            a[j] = _mm_add_epi64(a[j], _mm_mul_epu32(k, k_hi));
+        }
+        p += HASH_BLOCK_STRIPE_SIZE;
+
+        if (stripe == HASH_BLOCK_STRIPES_PER_ROUND - 1) {
+            for (u32 j = 0; j < HASH_BLOCK_N_LANES / 2; j++) {
+                __m128i x = a[j];
+                x = _mm_xor_si128(x, _mm_srli_epi64(x, 47));
+                x = _mm_xor_si128(x, _mm_loadu_si128(
+                    (const __m128i *)(HASH_BLOCK_SCRAMBLE_KEYS__ + 2 * j)));
+                /* x * prime = lo(x) * prime + ((hi(x) * prime) << 32) */
+                const __m128i lo = _mm_mul_epu32(x, prime);
+                const __m128i hi = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+                a[j] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+            }
+        }
+    }
+
+    for (u32 j = 0; j < HASH_BLOCK_N_LANES / 2; j++)
+        _mm_storeu_si128((__m128i *)(acc + 2 * j), a[j]);
+}
+#endif /* __SSE2__ */
+
+#if defined(HASH_BLOCK_HAVE_AVX2__)
+/* `hash_block_accumulate_scalar__`, four lanes per register */
+__attribute__((target("avx2")))
+static inline void hash_block_accumulate_avx2__(
+    u64 acc[HASH_BLOCK_N_LANES], const u8 *p, u64 n_stripes)
+{
+    __m256i a[HASH_BLOCK_N_LANES / 4];
+    for (u32 j = 0; j < HASH_BLOCK_N_LANES / 4; j++)
+        a[j] = _mm256_loadu_si256((const __m256i *)(acc + 4 * j));
+
+    const __m256i prime = _mm256_set1_epi32((i32)HASH_BLOCK_PRIME32__);
+    for (u64 n = 0; n < n_stripes; n++) {
+        const u32 stripe = n % HASH_BLOCK_STRIPES_PER_ROUND;
+        const u64 *key = hash_block_keys__ + stripe;
+        for (u32 j = 0; j < HASH_BLOCK_N_LANES / 4; j++) {
+            const __m256i v = _mm256_loadu_si256((const __m256i *)p + j);
+            const __m256i k = _mm256_xor_si256(v,
+                _mm256_loadu_si256((const __m256i *)(key + 4 * j)));
+            const __m256i k_hi =
+                _mm256_shuffle_epi32(k, _MM_SHUFFLE(3, 3, 1, 1));
+            /* Swaps the 64-bit lanes within each 128-bit half,
+             * which is exactly `i ^ 1` */
+            const __m256i v_swapped =
+                _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm256_add_epi64(a[j], v_swapped);
+            a[j] = _mm256_add_epi64(a[j], _mm256_mul_epu32(k, k_hi));
+        }
+        p += HASH_BLOCK_STRIPE_SIZE;
+
+        if (stripe == HASH_BLOCK_STRIPES_PER_ROUND - 1) {
+            for (u32 j = 0; j < HASH_BLOCK_N_LANES / 4; j++) {
+                __m256i x = a[j];
+                x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 47));
+                x = _mm256_xor_si256(x, _mm256_loadu_si256(
+                    (const __m256i *)(HASH_BLOCK_SCRAMBLE_KEYS__ + 4 * j)));
+                const __m256i lo = _mm256_mul_epu32(x, prime);
+                const __m256i hi =
+                    _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+                a[j] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+            }
+        }
+    }
+
+    for (u32 j = 0; j < HASH_BLOCK_N_LANES / 4; j++)
+        _mm256_storeu_si256((__m256i *)(acc + 4 * j), a[j]);
+}
+#endif /* HASH_BLOCK_HAVE_AVX2__ */
+
+/* Returns the 64-bit `hash_block` hash of the `len` bytes at `data`,
+ * accumulating the stripes with `accumulate` */
+static inline u64 hash_block_with__(const void *data, u64 len, u64 seed,
+    void (*accumulate)(u64 *, const u8 *, u64))
+{
+    const u8 *p = data;
+    u64 acc[HASH_BLOCK_N_LANES];
+    for (u32 i = 0; i < HASH_BLOCK_N_LANES; i++)
+        acc[i] = seed ^ HASH_BLOCK_SCRAMBLE_KEYS__[i];
+
+    const u64 n_stripes = len / HASH_BLOCK_STRIPE_SIZE;
+    accumulate(acc, p, n_stripes);
+
+    const u64 tail_len = len - n_stripes * HASH_BLOCK_STRIPE_SIZE;
+    const u64 tail_hash =
+        hash_bytes(p + n_stripes * HASH_BLOCK_STRIPE_SIZE, tail_len, seed);
+
+    return hash_bytes(acc, sizeof(acc), seed ^ tail_hash ^ len);
+}
+
+/* Returns the 64-bit hash of the `len` bytes at `data`,
+ * optimized for long inputs. Not interchangeable with `hash_bytes`. */
+static inline u64 hash_block(const void *data, u64 len, u64 seed)
+{
+#if defined(HASH_BLOCK_HAVE_AVX2__)
+    if (__builtin_cpu_supports("avx2"))
+        return hash_block_with__(data, len, seed, hash_block_accumulate_avx2__);
+#endif
+#if defined(__SSE2__)
+    return hash_block_with__(data, len, seed, hash_block_accumulate_sse2__);
+#else
+    return hash_block_with__(data, len, seed, hash_block_accumulate_scalar__);
+#endif
+}
+
+#endif /* U_HASH_H_ */
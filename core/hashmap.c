@@ -15,90 +15,144 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>
 */
 #include "hashmap.h"
+#include "hash.h"
+#include "arena.h"
 #include "int.h"
 #include "log.h"
 #include "util.h"
-#include "linked-list.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
 #define MODULE_NAME "hashmap"
 
-static inline u32 hash(const char *key, u32 max);
-static struct ll_node * lookup_bucket_list_node(struct hashmap *map, const char *key);
+struct hashmap_key_chunk {
+    struct hashmap_key_chunk *next;
+    u64 size;
+    u64 used;
+    char data[];
+};
 
-struct hashmap * hashmap_create(u32 initial_length)
+static i32 insert_slot(struct hashmap *map, struct hashmap_slot s, bool copy_key);
+static i64 find_slot(const struct hashmap *map,
+    const void *key, u32 key_len, u64 hash);
+static i32 grow(struct hashmap *map);
+static const char * store_key(struct hashmap *map, const void *key, u32 key_len);
+static void * alloc_zeroed(struct arena *arena, u64 size);
+
+static inline bool slot_matches(const struct hashmap_slot *s,
+    const void *key, u32 key_len, u64 hash)
 {
-    struct hashmap *map = malloc(sizeof(struct hashmap));
-    s_assert(map != NULL, "malloc() failed for map");
+    return s->hash == hash && s->key_len == key_len &&
+        !memcmp(s->key, key, key_len);
+}
 
-    map->length = initial_length;
-    map->n_elements = 0;
+struct hashmap * hashmap_create(u32 initial_size)
+{
+    return hashmap_create_in(initial_size, NULL);
+}
 
-    map->bucket_lists = calloc(initial_length, sizeof(struct linked_list *));
-    if (map->bucket_lists == NULL) {
-        s_log_error("calloc() for map->bucket_lists failed!");
-        u_nzfree(&map);
+struct hashmap * hashmap_create_in(u32 initial_size, struct arena *arena)
+{
+    struct hashmap *map = alloc_zeroed(arena, sizeof(struct hashmap));
+    s_assert(map != NULL, "Failed to allocate memory for map");
+    map->arena = arena;
+
+    /* Enough slots to hold `initial_size` records without growing */
+    const u64 min_capacity = (u64)initial_size * 100 / HM_MAX_LOAD_PERCENT + 1;
+    u64 capacity = HM_MIN_CAPACITY;
+    while (capacity < min_capacity)
+        capacity *= 2;
+
+    if (capacity > UINT32_MAX / 2) {
+        s_log_error("Initial size %u is too large", initial_size);
+        if (arena == NULL) u_nzfree(&map);
+        return NULL;
+    }
+
+    map->capacity = capacity;
+    map->slots = alloc_zeroed(arena, capacity * sizeof(struct hashmap_slot));
+    if (map->slots == NULL) {
+        s_log_error("Failed to allocate memory for map->slots!");
+        if (arena == NULL) u_nzfree(&map);
         return NULL;
     }
 
     return map;
 }
 
-i32 hashmap_insert(struct hashmap *map, const char *key, const void *entry)
+i32 hashmap_insert(struct hashmap *map, const char *key, const void *value)
 {
-    if (map == NULL) return 1;
-
-    u32 index = hash(key, map->length);
-
-    struct hashmap_record *new_record = malloc(sizeof(struct hashmap_record));
-    s_assert(new_record != NULL, "malloc() for new record failed!");
+    if (key == NULL) return 1;
+    return hashmap_insert_bytes(map, key, strlen(key), value);
+}
 
-    new_record->value = (void *)entry;
-    strncpy(new_record->key, key, HM_MAX_KEY_LENGTH);
-    new_record->key[HM_MAX_KEY_LENGTH - 1] = '\0';
+i32 hashmap_insert_bytes(struct hashmap *map,
+    const void *key, u32 key_len, const void *value)
+{
+    if (map == NULL || (key == NULL && key_len > 0)) return 1;
 
-    if (map->bucket_lists[index] == NULL) {
-        map->bucket_lists[index] = linked_list_create(new_record);
-        if (map->bucket_lists[index] == NULL) {
-            s_log_error(
-                "hashmap_insert: linked_list_create() for bucket list @ index %i returned NULL!",
-                index
-            );
-            u_nzfree(&new_record);
+    if ((u64)(map->n_elements + 1) * 100 >
+        (u64)map->capacity * HM_MAX_LOAD_PERCENT)
+    {
+        if (grow(map))
             return 1;
-        }
-    } else {
-        map->bucket_lists[index]->head = linked_list_append(
-            map->bucket_lists[index]->head,
-            new_record
-        );
     }
 
-    map->n_elements++;
+    return insert_slot(map, (struct hashmap_slot) {
+        .psl = 1,
+        .key_len = key_len,
+        .hash = hash_bytes(key, key_len, HASH_DEFAULT_SEED),
+        .key = key,
+        .value = (void *)value,
+    }, true);
+}
 
-    return 0;
+void * hashmap_lookup_record(const struct hashmap *map, const char *key)
+{
+    if (key == NULL) return NULL;
+    return hashmap_lookup_bytes(map, key, strlen(key));
 }
 
-void * hashmap_lookup_record(struct hashmap *map, const char *key)
+void * hashmap_lookup_bytes(const struct hashmap *map,
+    const void *key, u32 key_len)
 {
-    struct ll_node *node = lookup_bucket_list_node(map, key);
+    if (map == NULL) return NULL;
 
-    if (node == NULL || node->content == NULL)
-        return NULL;
-    else
-        return ((struct hashmap_record *)(node->content))->value;
+    const i64 i = find_slot(map, key, key_len,
+        hash_bytes(key, key_len, HASH_DEFAULT_SEED));
+
+    return i >= 0 ? map->slots[i].value : NULL;
 }
 
 void hashmap_delete_record(struct hashmap *map, const char *key)
 {
-    struct ll_node *node = lookup_bucket_list_node(map, key);
-    if (node == NULL)
+    if (key == NULL) return;
+    hashmap_delete_bytes(map, key, strlen(key));
+}
+
+void hashmap_delete_bytes(struct hashmap *map, const void *key, u32 key_len)
+{
+    if (map == NULL) return;
+
+    i64 i = find_slot(map, key, key_len,
+        hash_bytes(key, key_len, HASH_DEFAULT_SEED));
+    if (i < 0)
         return;
 
-    u_nfree(&node->content);
-    linked_list_destroy_node(&node);
+    /* Shift the following records of the cluster back by one slot,
+     * until an empty slot or a record that's already in its home slot */
+    const u32 mask = map->capacity - 1;
+    u32 next = (i + 1) & mask;
+    while (map->slots[next].psl > 1) {
+        map->slots[i] = map->slots[next];
+        map->slots[i].psl--;
+        i = next;
+        next = (next + 1) & mask;
+    }
+    memset(&map->slots[i], 0, sizeof(struct hashmap_slot));
+
+    map->n_elements--;
 }
 
 void hashmap_destroy(struct hashmap **map_p)
@@ -106,39 +160,182 @@ void hashmap_destroy(struct hashmap **map_p)
     if (map_p == NULL || *map_p == NULL) return;
     struct hashmap *map = *map_p;
 
-    for (u32 i = 0; i < map->length; i++) {
-        if (map->bucket_lists[i] != NULL) {
-            linked_list_destroy(&map->bucket_lists[i], true);
-        }
+    /* Arena memory is only ever released all at once */
+    if (map->arena != NULL) {
+        *map_p = NULL;
+        return;
     }
-    free(map->bucket_lists);
+
+    struct hashmap_key_chunk *chunk = map->key_chunks;
+    while (chunk != NULL) {
+        struct hashmap_key_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(map->slots);
 
     u_nzfree(map_p);
 }
 
-static inline u32 hash(const char *key, u32 max)
+static i32 insert_slot(struct hashmap *map, struct hashmap_slot s, bool copy_key)
 {
-    return ((key[0] % max) * key[strlen(key) - 1]) % max;
+    const u32 mask = map->capacity - 1;
+    u32 i = s.hash & mask;
+
+    /* Until the new record takes some other record's place,
+     * an existing record with the same key could still come up */
+    bool displaced = !copy_key;
+
+    while (true) {
+        struct hashmap_slot *curr = &map->slots[i];
+
+        if (curr->psl == 0) {
+            if (!displaced) {
+                s.key = store_key(map, s.key, s.key_len);
+                if (s.key == NULL)
+                    return 1;
+            }
+            *curr = s;
+            map->n_elements++;
+            return 0;
+        }
+
+        if (!displaced && slot_matches(curr, s.key, s.key_len, s.hash)) {
+            curr->value = s.value;
+            return 0;
+        }
+
+        /* Robin Hood - take from the rich (records close to their home slot)
+         * and give to the poor (the one being inserted) */
+        if (curr->psl < s.psl) {
+            if (!displaced) {
+                s.key = store_key(map, s.key, s.key_len);
+                if (s.key == NULL)
+                    return 1;
+                displaced = true;
+            }
+            const struct hashmap_slot tmp = *curr;
+            *curr = s;
+            s = tmp;
+        }
+
+        s.psl++;
+        i = (i + 1) & mask;
+    }
 }
 
-static struct ll_node * lookup_bucket_list_node(struct hashmap *map, const char *key)
+static i64 find_slot(const struct hashmap *map,
+    const void *key, u32 key_len, u64 hash)
 {
-    u32 index = hash(key, map->length);
-
-    if (map->bucket_lists[index] == NULL) return NULL;
-
-    struct ll_node *curr_node = (map->bucket_lists[index])->tail;
-    while (curr_node != NULL) {
-        if (curr_node->content != NULL) {
-            /* Return the current node if the keys match */
-            if (!strncmp(
-                ((struct hashmap_record *)curr_node->content)->key,
-                key,
-                HM_MAX_KEY_LENGTH
-            )) return curr_node;
+    const u32 mask = map->capacity - 1;
+    u32 i = hash & mask;
+
+    for (u32 psl = 1; ; psl++) {
+        const struct hashmap_slot *curr = &map->slots[i];
+
+        /* If the key were present, it would have taken this slot */
+        if (curr->psl < psl)
+            return -1;
+
+        if (slot_matches(curr, key, key_len, hash))
+            return i;
+
+        i = (i + 1) & mask;
+    }
+}
+
+static i32 grow(struct hashmap *map)
+{
+    const u64 new_capacity = (u64)map->capacity * HM_GROWTH_FACTOR;
+    if (new_capacity > UINT32_MAX / 2) {
+        s_log_error("Can't grow the map past %u slots", map->capacity);
+        return 1;
+    }
+
+    struct hashmap_slot *new_slots =
+        alloc_zeroed(map->arena, new_capacity * sizeof(struct hashmap_slot));
+    if (new_slots == NULL) {
+        s_log_error("Failed to allocate memory for the new slot array");
+        return 1;
+    }
+
+    struct hashmap_slot *old_slots = map->slots;
+    const u32 old_capacity = map->capacity;
+
+    map->slots = new_slots;
+    map->capacity = new_capacity;
+    map->n_elements = 0;
+
+    /* The keys are already in the arena, so they're just moved over */
+    for (u32 i = 0; i < old_capacity; i++) {
+        if (old_slots[i].psl == 0)
+            continue;
+
+        struct hashmap_slot s = old_slots[i];
+        s.psl = 1;
+        (void) insert_slot(map, s, false);
+    }
+
+    if (map->arena == NULL)
+        free(old_slots);
+    return 0;
+}
+
+static const char * store_key(struct hashmap *map, const void *key, u32 key_len)
+{
+    /* Keys are stored with a NUL terminator
+     * so that string keys can be used directly */
+    const u64 size = (u64)key_len + 1;
+
+    if (map->arena != NULL) {
+        char *dst = arena_alloc(map->arena, size);
+        if (dst == NULL) {
+            s_log_error("Failed to allocate memory for a key");
+            return NULL;
+        }
+        if (key_len > 0)
+            memcpy(dst, key, key_len);
+        dst[key_len] = '\0';
+        return dst;
+    }
+
+    struct hashmap_key_chunk *chunk = map->key_chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        const u64 chunk_size = size > HM_KEY_CHUNK_SIZE
+            ? size : HM_KEY_CHUNK_SIZE;
+
+        struct hashmap_key_chunk *new_chunk =
+            malloc(sizeof(struct hashmap_key_chunk) + chunk_size);
+        if (new_chunk == NULL) {
+            s_log_error("malloc() failed for a new key chunk");
+            return NULL;
+        }
+        new_chunk->size = chunk_size;
+        new_chunk->used = 0;
+
+        /* Keep a partially used chunk at the head
+         * if the new one is just for a single oversized key */
+        if (chunk != NULL && chunk_size > HM_KEY_CHUNK_SIZE) {
+            new_chunk->next = chunk->next;
+            chunk->next = new_chunk;
+        } else {
+            new_chunk->next = chunk;
+            map->key_chunks = new_chunk;
         }
-        curr_node = curr_node->next;
+        chunk = new_chunk;
     }
 
-    return NULL;
+    char *dst = chunk->data + chunk->used;
+    if (key_len > 0)
+        memcpy(dst, key, key_len);
+    dst[key_len] = '\0';
+    chunk->used += size;
+
+    return dst;
+}
+
+static void * alloc_zeroed(struct arena *arena, u64 size)
+{
+    return arena != NULL ? arena_calloc(arena, size) : calloc(1, size);
 }
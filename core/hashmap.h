@@ -19,37 +19,84 @@
 #include "static-tests.h"
 
 #include "int.h"
-#include "linked-list.h"
 
-#define HM_TABLE_SIZE  10
+/* The minimum number of slots in the table */
+#define HM_MIN_CAPACITY 16
 
-#define HM_RESIZING_FACTOR 5
-#define HM_MAX_KEY_LENGTH 256
+/* The table grows (by `HM_GROWTH_FACTOR`)
+ * when it would become more than `HM_MAX_LOAD_PERCENT` full */
+#define HM_MAX_LOAD_PERCENT 85
+#define HM_GROWTH_FACTOR 2
 
-struct hashmap_record {
-    char key[HM_MAX_KEY_LENGTH];
+/* The size of a single chunk of the key arena */
+#define HM_KEY_CHUNK_SIZE (64 * 1024)
+
+struct hashmap_slot {
+    /* The probe sequence length (distance from the "home" slot) + 1,
+     * or 0 if the slot is empty */
+    u32 psl;
+    u32 key_len;
+    u64 hash;
+    const char *key; /* Points into the key arena */
     void *value;
 };
 
-/* Chained hash map
- * Collisions are resolved by chaining them together on a linked list
- */
+struct hashmap_key_chunk;
+struct arena;
+
+/* Open-addressing hash map with Robin Hood hashing.
+ *
+ * All records live in a single flat array of slots, and collisions are
+ * resolved by linear probing, with records that are further away
+ * from their home slot taking precedence over the closer ones.
+ * This keeps the probe sequences short and predictable even at high loads,
+ * and lets lookups of missing keys stop early.
+ * Deletions use backward shifting, so there are no tombstones.
+ *
+ * Keys are hashed with `hash_bytes()` (see `hash.h`) and copied into
+ * an append-only arena owned by the map. Memory of deleted keys
+ * is only reclaimed by `hashmap_destroy()`.
+ *
+ * Alternatively, a map can be created in a `core/arena` arena
+ * (`hashmap_create_in()`), in which case the map itself, its slots
+ * and its keys are all allocated from there. */
 struct hashmap {
-    u32 length;
+    u32 capacity; /* Always a power of 2 */
     u32 n_elements;
-    struct linked_list **bucket_lists;
+    struct hashmap_slot *slots;
+
+    struct hashmap_key_chunk *key_chunks;
+
+    /* The arena everything is allocated from, or `NULL` for the heap */
+    struct arena *arena;
 };
 
-/* I'm too lazy to write explanations, if you know how a hash map works,
- * you know how to use these functions */
+/* Creates a new map with room for at least `initial_size` records
+ * before it has to grow. Returns `NULL` on failure. */
+struct hashmap * hashmap_create(u32 initial_size);
+
+/* Same as `hashmap_create()`, but all the memory of the map
+ * is allocated from `arena`. The map must not outlive the arena
+ * (or its next reset); `hashmap_destroy()` doesn't free any memory. */
+struct hashmap * hashmap_create_in(u32 initial_size, struct arena *arena);
 
-struct hashmap * hashmap_create(u32 intial_size);
+/* Inserts `value` under the NUL-terminated string `key`,
+ * replacing the old value if `key` is already present.
+ * Returns 0 on success and non-zero on failure. */
+i32 hashmap_insert(struct hashmap *map, const char *key, const void *value);
 
-i32 hashmap_insert(struct hashmap *map, const char *key, const void *entry);
+/* Same as `hashmap_insert()`, but with a `key_len`-byte binary key */
+i32 hashmap_insert_bytes(struct hashmap *map,
+    const void *key, u32 key_len, const void *value);
 
-void * hashmap_lookup_record(struct hashmap *map, const char *key);
+/* Returns the value stored under `key`, or `NULL` if there is none */
+void * hashmap_lookup_record(const struct hashmap *map, const char *key);
+void * hashmap_lookup_bytes(const struct hashmap *map,
+    const void *key, u32 key_len);
 
+/* Removes the record stored under `key`, if there is one */
 void hashmap_delete_record(struct hashmap *map, const char *key);
+void hashmap_delete_bytes(struct hashmap *map, const void *key, u32 key_len);
 
 void hashmap_destroy(struct hashmap **map);
 
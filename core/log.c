@@ -20,6 +20,7 @@
 #include "math.h"
 #include "spinlock.h"
 #include "ringbuffer.h"
+#include "trace.h"
 #include "ansi-esc-sequences.h"
 #include <errno.h>
 #include <stdio.h>
@@ -210,9 +211,12 @@ void s_log(enum s_log_level level, const char *module_name,
     switch (output->type) {
     case S_LOG_OUTPUT_FILE:
     case S_LOG_OUTPUT_FILEPATH:
+        /* Writing to the stream is where stdio flushes its buffer */
+        trace_begin("log", "log flush", module_name);
         write_msg_to_file(output->fp,
             linefmt_string, module_name, fmt, fmt_list,
             output->strip_esc_sequences);
+        trace_end("log", "log flush");
         break;
     case S_LOG_OUTPUT_MEMORYBUF:
         write_msg_to_membuf(output->membuf,
@@ -14,27 +14,222 @@
  * You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>
 */
+#define _GNU_SOURCE
+#define SPINLOCK_COUNTER_LIST_DEF__
 #include "spinlock.h"
+#undef SPINLOCK_COUNTER_LIST_DEF__
 #include "int.h"
 #include <stdatomic.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define X_(name, desc) desc,
+static const char *const g_counter_names[SPINLOCK_N_COUNTERS_] = {
+    SPINLOCK_COUNTER_LIST
+};
+#undef X_
+#undef SPINLOCK_COUNTER_LIST
+
+static _Atomic u64 g_counters[SPINLOCK_N_COUNTERS_];
+
+/* 0 - not checked yet, 1 - single CPU, 2 - multiple CPUs */
+static _Atomic u32 g_cpu_mode;
+
+static inline void count(enum spinlock_counter counter, u64 n)
+{
+    atomic_fetch_add_explicit(&g_counters[counter], n, memory_order_relaxed);
+}
+
+/* Spinning is pointless when the lock holder can't run meanwhile */
+static bool is_single_cpu(void)
+{
+    u32 mode = atomic_load_explicit(&g_cpu_mode, memory_order_relaxed);
+    if (mode == 0) {
+        mode = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 2 : 1;
+        atomic_store_explicit(&g_cpu_mode, mode, memory_order_relaxed);
+    }
+
+    return mode == 1;
+}
+
+/* Busy-waits for `*backoff` CPU relax hints (doubling it for next time),
+ * or yields the CPU if the thread has been waiting for long enough
+ * (or if there is only one CPU) */
+static void backoff_wait(u32 *backoff, u32 *total)
+{
+    if (*total >= SPINLOCK_YIELD_THRESHOLD__ || is_single_cpu()) {
+        count(SPINLOCK_COUNTER_YIELDS, 1);
+        (void) sched_yield();
+        return;
+    }
+
+    for (u32 i = 0; i < *backoff; i++)
+        spinlock_cpu_relax();
+
+    *total += *backoff;
+    if (*backoff < SPINLOCK_MAX_BACKOFF__)
+        *backoff *= 2;
+}
 
 void spinlock_init(spinlock_t *lock)
 {
-    *lock = (atomic_flag)ATOMIC_FLAG_INIT;
+    atomic_init(lock, 0);
 }
 
 void spinlock_acquire(spinlock_t *lock)
 {
-    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
-        ;
+    /* Fast path */
+    if (!atomic_exchange_explicit(lock, 1, memory_order_acquire))
+        return;
+
+    count(SPINLOCK_COUNTER_CONTENDED, 1);
+    u32 backoff = 1, total = 0, n_spins = 0;
+    do {
+        /* Wait with plain loads until the lock looks free,
+         * so that the cache line isn't bounced around by failed RMWs */
+        while (atomic_load_explicit(lock, memory_order_relaxed)) {
+            backoff_wait(&backoff, &total);
+            n_spins++;
+        }
+    } while (atomic_exchange_explicit(lock, 1, memory_order_acquire));
+
+    count(SPINLOCK_COUNTER_SPINS, n_spins);
 }
 
 void spinlock_release(spinlock_t *lock)
 {
-    atomic_flag_clear_explicit(lock, memory_order_release);
+    atomic_store_explicit(lock, 0, memory_order_release);
 }
 
 i32 spinlock_try_acquire(spinlock_t *lock)
 {
-    return atomic_flag_test_and_set_explicit(lock, memory_order_acquire);
+    if (atomic_load_explicit(lock, memory_order_relaxed))
+        return 1;
+
+    return atomic_exchange_explicit(lock, 1, memory_order_acquire);
+}
+
+void ticketlock_init(ticketlock_t *lock)
+{
+    atomic_init(&lock->next_ticket, 0);
+    atomic_init(&lock->now_serving, 0);
+}
+
+void ticketlock_acquire(ticketlock_t *lock)
+{
+    const u32 ticket = atomic_fetch_add_explicit(&lock->next_ticket, 1,
+        memory_order_relaxed);
+
+    u32 serving = atomic_load_explicit(&lock->now_serving, memory_order_acquire);
+    if (serving == ticket)
+        return;
+
+    count(SPINLOCK_COUNTER_CONTENDED, 1);
+    u32 total = 0, n_spins = 0;
+    while (serving != ticket) {
+        /* Back off proportionally to our position in the queue */
+        u32 backoff = (ticket - serving) * 64;
+        if (backoff > SPINLOCK_MAX_BACKOFF__)
+            backoff = SPINLOCK_MAX_BACKOFF__;
+        backoff_wait(&backoff, &total);
+        n_spins++;
+
+        serving = atomic_load_explicit(&lock->now_serving, memory_order_acquire);
+    }
+
+    count(SPINLOCK_COUNTER_SPINS, n_spins);
+}
+
+void ticketlock_release(ticketlock_t *lock)
+{
+    /* Only the holder ever writes `now_serving` */
+    const u32 next = atomic_load_explicit(&lock->now_serving,
+        memory_order_relaxed) + 1;
+    atomic_store_explicit(&lock->now_serving, next, memory_order_release);
+}
+
+static void futex_wait(_Atomic u32 *addr, u32 expected)
+{
+    count(SPINLOCK_COUNTER_FUTEX_WAITS, 1);
+    (void) syscall(SYS_futex, (u32 *)addr, FUTEX_WAIT_PRIVATE, expected,
+        NULL, NULL, 0);
+}
+
+static void futex_wake_one(_Atomic u32 *addr)
+{
+    count(SPINLOCK_COUNTER_FUTEX_WAKES, 1);
+    (void) syscall(SYS_futex, (u32 *)addr, FUTEX_WAKE_PRIVATE, 1,
+        NULL, NULL, 0);
+}
+
+void hybridlock_init(hybridlock_t *lock)
+{
+    atomic_init(&lock->state, 0);
+}
+
+void hybridlock_acquire(hybridlock_t *lock)
+{
+    u32 expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&lock->state, &expected, 1,
+            memory_order_acquire, memory_order_relaxed))
+        return;
+
+    count(SPINLOCK_COUNTER_CONTENDED, 1);
+
+    /* Spin for a while first, as the lock is usually held only briefly
+     * (unless there's no other CPU the holder could be running on) */
+    u32 backoff = 1, total = 0, n_spins = 0;
+    while (total < HYBRIDLOCK_SPIN_BUDGET && !is_single_cpu()) {
+        backoff_wait(&backoff, &total);
+        n_spins++;
+
+        expected = 0;
+        if (atomic_load_explicit(&lock->state, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_strong_explicit(&lock->state, &expected, 1,
+                memory_order_acquire, memory_order_relaxed))
+        {
+            count(SPINLOCK_COUNTER_SPINS, n_spins);
+            return;
+        }
+    }
+    count(SPINLOCK_COUNTER_SPINS, n_spins);
+
+    /* Then sleep, marking the lock as having waiters (2), so that
+     * the holder knows it has to wake someone up when releasing it.
+     * Since we can't know whether we were the last waiter,
+     * the lock is always re-acquired in state 2. */
+    while (atomic_exchange_explicit(&lock->state, 2, memory_order_acquire) != 0)
+        futex_wait(&lock->state, 2);
+}
+
+void hybridlock_release(hybridlock_t *lock)
+{
+    if (atomic_exchange_explicit(&lock->state, 0, memory_order_release) == 2)
+        futex_wake_one(&lock->state);
+}
+
+i32 hybridlock_try_acquire(hybridlock_t *lock)
+{
+    u32 expected = 0;
+    return !atomic_compare_exchange_strong_explicit(&lock->state, &expected, 1,
+        memory_order_acquire, memory_order_relaxed);
+}
+
+u64 spinlock_get_counter(enum spinlock_counter counter)
+{
+    if (counter < 0 || counter >= SPINLOCK_N_COUNTERS_)
+        return 0;
+
+    return atomic_load_explicit(&g_counters[counter], memory_order_relaxed);
+}
+
+const char * spinlock_get_counter_name(enum spinlock_counter counter)
+{
+    if (counter < 0 || counter >= SPINLOCK_N_COUNTERS_)
+        return "N/A";
+
+    return g_counter_names[counter];
 }
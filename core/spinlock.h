@@ -20,13 +20,105 @@
 #include "int.h"
 #include <stdatomic.h>
 
-typedef atomic_flag spinlock_t;
-#define SPINLOCK_INIT ATOMIC_FLAG_INIT
+/* Locks for short critical sections.
+ *
+ * - `spinlock_t` is a test-and-test-and-set lock with exponential backoff
+ *   (`pause`-style CPU hints, doubling up to `SPINLOCK_MAX_BACKOFF__`
+ *   per attempt, and `sched_yield()` once the waiter has been spinning
+ *   for `SPINLOCK_YIELD_THRESHOLD__` hints).
+ *   Cheapest when uncontended, but unfair.
+ *
+ * - `ticketlock_t` hands the lock out in FIFO order, which prevents
+ *   starvation when many threads hammer on the same lock.
+ *
+ * - `hybridlock_t` spins for a while (`HYBRIDLOCK_SPIN_BUDGET`)
+ *   and then parks the thread in the kernel with `futex(2)`,
+ *   so that long waits don't burn CPU time.
+ *
+ * Only the contended (slow) paths update the contention counters,
+ * so uncontended locking costs a single atomic RMW as before. */
+
+/* The maximum number of CPU relax hints between two attempts */
+#define SPINLOCK_MAX_BACKOFF__ 256U
+
+/* The number of CPU relax hints after which a waiter
+ * starts giving up the CPU (`sched_yield()`) between attempts.
+ * On single-CPU systems, waiters yield right away,
+ * as the holder can't make progress while they spin. */
+#define SPINLOCK_YIELD_THRESHOLD__ (4U * 1024U)
+
+/* The number of CPU relax hints a `hybridlock_t` waiter spins for
+ * before going to sleep */
+#define HYBRIDLOCK_SPIN_BUDGET (2U * 1024U)
+
+typedef _Atomic u32 spinlock_t;
+#define SPINLOCK_INIT 0
 void spinlock_init(spinlock_t *lock);
 
 void spinlock_acquire(spinlock_t *lock);
 void spinlock_release(spinlock_t *lock);
 
+/* Returns 0 if the lock was acquired, non-zero if it's already held */
 i32 spinlock_try_acquire(spinlock_t *lock);
 
+typedef struct ticketlock {
+    _Atomic u32 next_ticket;
+    _Atomic u32 now_serving;
+} ticketlock_t;
+#define TICKETLOCK_INIT { 0, 0 }
+void ticketlock_init(ticketlock_t *lock);
+
+void ticketlock_acquire(ticketlock_t *lock);
+void ticketlock_release(ticketlock_t *lock);
+
+typedef struct hybridlock {
+    /* 0 - unlocked, 1 - locked, 2 - locked and (possibly) has sleepers */
+    _Atomic u32 state;
+} hybridlock_t;
+#define HYBRIDLOCK_INIT { 0 }
+void hybridlock_init(hybridlock_t *lock);
+
+void hybridlock_acquire(hybridlock_t *lock);
+void hybridlock_release(hybridlock_t *lock);
+
+/* Returns 0 if the lock was acquired, non-zero if it's already held */
+i32 hybridlock_try_acquire(hybridlock_t *lock);
+
+/* Process-wide contention counters (summed over all locks) */
+#define SPINLOCK_COUNTER_LIST                                               \
+    X_(CONTENDED, "contended")                                              \
+    X_(SPINS, "spins")                                                      \
+    X_(YIELDS, "yields")                                                    \
+    X_(FUTEX_WAITS, "futex waits")                                          \
+    X_(FUTEX_WAKES, "futex wakes")                                          \
+
+#define X_(name, desc) SPINLOCK_COUNTER_##name,
+enum spinlock_counter {
+    SPINLOCK_COUNTER_LIST
+    SPINLOCK_N_COUNTERS_
+};
+#undef X_
+
+/* Returns the current value of `counter` */
+u64 spinlock_get_counter(enum spinlock_counter counter);
+
+/* Returns a human-readable description of `counter` */
+const char * spinlock_get_counter_name(enum spinlock_counter counter);
+
+/* A CPU hint that the current thread is busy-waiting */
+static inline void spinlock_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+#ifndef SPINLOCK_COUNTER_LIST_DEF__
+#undef SPINLOCK_COUNTER_LIST
+#endif /* SPINLOCK_COUNTER_LIST_DEF__ */
+
 #endif /* SPINLOCK_H_ */
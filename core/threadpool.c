@@ -0,0 +1,637 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "threadpool.h"
+#include "int.h"
+#include "log.h"
+#include "util.h"
+#include "math.h"
+#include "spinlock.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+
+#define MODULE_NAME "threadpool"
+
+struct task {
+    threadpool_task_fn_t fn;
+    void *arg;
+    struct threadpool_group *group;
+
+    /* The next task in the injection queue */
+    struct task *next;
+};
+
+/* The circular buffer of a deque. When a deque grows, its old array
+ * can still be read by thieves, so it's only freed with the whole pool. */
+struct deque_array {
+    i64 capacity; /* Always a power of 2 */
+    struct deque_array *prev;
+    _Atomic(struct task *) buf[];
+};
+
+/* A Chase-Lev work-stealing deque (with the C11 memory orderings from
+ * "Correct and Efficient Work-Stealing for Weak Memory Models",
+ * Lê et al., 2013). Only the owner pushes and takes at the bottom;
+ * anyone can steal from the top. */
+struct deque {
+    _Atomic i64 top;
+    u8 pad_[64 - sizeof(_Atomic i64)]; /* Keep thieves off the owner's line */
+    _Atomic i64 bottom;
+    _Atomic(struct deque_array *) array;
+};
+
+enum steal_result {
+    STEAL_OK,
+    STEAL_EMPTY,
+    STEAL_LOST_RACE,
+};
+
+struct worker {
+    struct threadpool *tp;
+    u32 index;
+    u64 rng_state;
+    struct deque deque;
+};
+
+struct threadpool {
+    u32 flags;
+    u32 n_workers;
+    u32 n_started;
+    struct worker *workers;
+    pthread_t *threads;
+
+    /* Tasks submitted from outside of the pool */
+    hybridlock_t inject_lock;
+    struct task *inject_head, *inject_tail;
+    _Atomic u64 n_injected;
+
+    /* Idle workers (and waiters) sleep on `sleep_cond` for as long as
+     * `work_epoch` stays the same. Every submission (and every finished
+     * group) bumps the epoch and wakes up the sleepers, if there are any. */
+    pthread_mutex_t sleep_mutex;
+    pthread_cond_t sleep_cond;
+    _Atomic u64 work_epoch;
+    _Atomic u32 n_sleeping;
+
+    _Atomic bool stop;
+};
+
+static _Thread_local struct worker *tl_worker = NULL;
+static _Thread_local u64 tl_rng_state = 0;
+
+static void deque_init(struct deque *d);
+static void deque_push(struct deque *d, struct task *t);
+static struct task * deque_take(struct deque *d);
+static enum steal_result deque_steal(struct deque *d, struct task **out);
+static void deque_destroy(struct deque *d);
+
+static void * worker_main(void *arg);
+static struct worker * current_worker(const struct threadpool *tp);
+static struct task * find_task(struct threadpool *tp, struct worker *self);
+static void run_task(struct threadpool *tp, struct task *t);
+static void idle_wait(struct threadpool *tp, u64 epoch,
+    const struct threadpool_group *group);
+static void notify(struct threadpool *tp, bool all);
+static void pin_workers(struct threadpool *tp);
+
+struct threadpool * threadpool_create(u32 n_workers, u32 flags)
+{
+    u_check_params(n_workers <= THREADPOOL_MAX_WORKERS);
+
+    struct threadpool *tp = calloc(1, sizeof(struct threadpool));
+    s_assert(tp != NULL, "calloc() failed for the thread pool");
+
+    tp->flags = flags;
+    tp->n_workers = n_workers;
+    hybridlock_init(&tp->inject_lock);
+    atomic_init(&tp->n_injected, 0);
+    atomic_init(&tp->work_epoch, 0);
+    atomic_init(&tp->n_sleeping, 0);
+    atomic_init(&tp->stop, false);
+    if (pthread_mutex_init(&tp->sleep_mutex, NULL)) {
+        free(tp);
+        s_log_error("Failed to initialize the sleep mutex");
+        return NULL;
+    }
+    if (pthread_cond_init(&tp->sleep_cond, NULL)) {
+        (void) pthread_mutex_destroy(&tp->sleep_mutex);
+        free(tp);
+        s_log_error("Failed to initialize the sleep condition variable");
+        return NULL;
+    }
+
+    if (n_workers == 0)
+        return tp;
+
+    tp->workers = calloc(n_workers, sizeof(struct worker));
+    s_assert(tp->workers != NULL, "calloc() failed for the workers");
+    tp->threads = calloc(n_workers, sizeof(pthread_t));
+    s_assert(tp->threads != NULL, "calloc() failed for the thread handles");
+
+    /* All the deques must exist before any worker starts stealing */
+    for (u32 i = 0; i < n_workers; i++) {
+        tp->workers[i].tp = tp;
+        tp->workers[i].index = i;
+        tp->workers[i].rng_state = 0x9E3779B97F4A7C15ULL * (i + 1);
+        deque_init(&tp->workers[i].deque);
+    }
+
+    /* Workers inherit the signal mask, and they should never be the ones
+     * to handle a signal - leave that to the application's own threads */
+    sigset_t all_signals, old_signals;
+    sigfillset(&all_signals);
+    (void) pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+    for (u32 i = 0; i < n_workers; i++) {
+        if (pthread_create(&tp->threads[i], NULL, worker_main,
+                &tp->workers[i]))
+        {
+            /* The deques of the missing workers just stay empty */
+            s_log_warn("Failed to create worker thread %u; "
+                "continuing with %u workers", i, tp->n_started);
+            break;
+        }
+        tp->n_started++;
+    }
+
+    (void) pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (flags & THREADPOOL_FLAG_PIN_CPUS)
+        pin_workers(tp);
+
+    return tp;
+}
+
+void threadpool_submit(struct threadpool *tp, struct threadpool_group *group,
+    threadpool_task_fn_t fn, void *arg)
+{
+    u_check_params(tp != NULL && group != NULL && fn != NULL);
+
+    struct task *t = malloc(sizeof(struct task));
+    s_assert(t != NULL, "malloc() failed for a task");
+    t->fn = fn;
+    t->arg = arg;
+    t->group = group;
+    t->next = NULL;
+
+    /* The submitter is either the waiting thread or a task of the same
+     * group, so the counter can't drop to 0 in the meantime */
+    atomic_fetch_add_explicit(&group->n_pending, 1, memory_order_relaxed);
+
+    struct worker *self = current_worker(tp);
+    if (self != NULL) {
+        deque_push(&self->deque, t);
+    } else {
+        hybridlock_acquire(&tp->inject_lock);
+        if (tp->inject_tail != NULL)
+            tp->inject_tail->next = t;
+        else
+            tp->inject_head = t;
+        tp->inject_tail = t;
+        atomic_fetch_add_explicit(&tp->n_injected, 1, memory_order_release);
+        hybridlock_release(&tp->inject_lock);
+    }
+
+    notify(tp, false);
+}
+
+void threadpool_group_init(struct threadpool_group *group)
+{
+    atomic_init(&group->n_pending, 0);
+}
+
+void threadpool_group_wait(struct threadpool *tp,
+    struct threadpool_group *group)
+{
+    u_check_params(tp != NULL && group != NULL);
+
+    struct worker *self = current_worker(tp);
+    u32 idle_rounds = 0;
+
+    while (atomic_load_explicit(&group->n_pending, memory_order_acquire) > 0) {
+        const u64 epoch = atomic_load(&tp->work_epoch);
+
+        struct task *t = find_task(tp, self);
+        if (t != NULL) {
+            run_task(tp, t);
+            idle_rounds = 0;
+        } else if (++idle_rounds < THREADPOOL_IDLE_SPIN_ROUNDS) {
+            spinlock_cpu_relax();
+        } else {
+            /* The remaining tasks are all running on other threads */
+            idle_wait(tp, epoch, group);
+            idle_rounds = 0;
+        }
+    }
+}
+
+struct parallel_for_ctx {
+    struct threadpool *tp;
+    struct threadpool_group group;
+    threadpool_for_fn_t fn;
+    void *arg;
+    u64 grain;
+};
+
+struct parallel_for_range {
+    struct parallel_for_ctx *ctx;
+    u64 begin, end;
+};
+
+static void parallel_for_task(void *arg)
+{
+    struct parallel_for_range *r = arg;
+    struct parallel_for_ctx *ctx = r->ctx;
+
+    /* Keep the lower half, and offer the upper half to thieves */
+    while (r->end - r->begin > ctx->grain) {
+        const u64 mid = r->begin + (r->end - r->begin) / 2;
+
+        struct parallel_for_range *upper =
+            malloc(sizeof(struct parallel_for_range));
+        s_assert(upper != NULL, "malloc() failed for a range");
+        *upper = (struct parallel_for_range) {
+            .ctx = ctx,
+            .begin = mid,
+            .end = r->end,
+        };
+        threadpool_submit(ctx->tp, &ctx->group, parallel_for_task, upper);
+
+        r->end = mid;
+    }
+
+    const u32 slot = threadpool_get_slot(ctx->tp);
+    for (u64 i = r->begin; i < r->end; i++)
+        ctx->fn(ctx->arg, i, slot);
+
+    free(r);
+}
+
+void threadpool_parallel_for(struct threadpool *tp, u64 n_items, u64 grain,
+    threadpool_for_fn_t fn, void *arg)
+{
+    u_check_params(tp != NULL && fn != NULL);
+    if (n_items == 0)
+        return;
+
+    /* Aim for ~8 pieces per thread, so that uneven items even out */
+    if (grain == 0)
+        grain = u_max(n_items / (8ULL * (tp->n_workers + 1)), 1);
+
+    struct parallel_for_ctx ctx = {
+        .tp = tp,
+        .group = THREADPOOL_GROUP_INIT,
+        .fn = fn,
+        .arg = arg,
+        .grain = grain,
+    };
+
+    struct parallel_for_range *r = malloc(sizeof(struct parallel_for_range));
+    s_assert(r != NULL, "malloc() failed for a range");
+    *r = (struct parallel_for_range) {
+        .ctx = &ctx,
+        .begin = 0,
+        .end = n_items,
+    };
+    threadpool_submit(tp, &ctx.group, parallel_for_task, r);
+    threadpool_group_wait(tp, &ctx.group);
+}
+
+u32 threadpool_get_n_workers(const struct threadpool *tp)
+{
+    u_check_params(tp != NULL);
+    return tp->n_workers;
+}
+
+u32 threadpool_get_slot(const struct threadpool *tp)
+{
+    u_check_params(tp != NULL);
+
+    const struct worker *self = current_worker(tp);
+    return self != NULL ? self->index : tp->n_workers;
+}
+
+void threadpool_destroy(struct threadpool **tp_p)
+{
+    if (tp_p == NULL || *tp_p == NULL)
+        return;
+
+    struct threadpool *tp = *tp_p;
+
+    /* `stop` is set before taking the mutex, so a worker
+     * can't miss it between its check and `pthread_cond_wait` */
+    atomic_store_explicit(&tp->stop, true, memory_order_release);
+    (void) pthread_mutex_lock(&tp->sleep_mutex);
+    (void) pthread_cond_broadcast(&tp->sleep_cond);
+    (void) pthread_mutex_unlock(&tp->sleep_mutex);
+
+    for (u32 i = 0; i < tp->n_started; i++)
+        (void) pthread_join(tp->threads[i], NULL);
+
+    for (u32 i = 0; i < tp->n_workers; i++)
+        deque_destroy(&tp->workers[i].deque);
+
+    s_assert(tp->inject_head == NULL,
+        "the thread pool was destroyed with pending tasks");
+
+    (void) pthread_cond_destroy(&tp->sleep_cond);
+    (void) pthread_mutex_destroy(&tp->sleep_mutex);
+    u_nfree(&tp->threads);
+    u_nfree(&tp->workers);
+    u_nfree(tp_p);
+}
+
+static struct deque_array * deque_array_new(i64 capacity)
+{
+    struct deque_array *a = malloc(sizeof(struct deque_array)
+        + capacity * sizeof(_Atomic(struct task *)));
+    s_assert(a != NULL, "malloc() failed for a deque array");
+    a->capacity = capacity;
+    a->prev = NULL;
+    return a;
+}
+
+static void deque_init(struct deque *d)
+{
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(&d->array,
+        deque_array_new(THREADPOOL_DEQUE_INITIAL_CAPACITY));
+}
+
+static void deque_push(struct deque *d, struct task *t)
+{
+    const i64 b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    const i64 top = atomic_load_explicit(&d->top, memory_order_acquire);
+    struct deque_array *a =
+        atomic_load_explicit(&d->array, memory_order_relaxed);
+
+    if (b - top > a->capacity - 1) {
+        struct deque_array *new_a = deque_array_new(a->capacity * 2);
+        for (i64 i = top; i < b; i++) {
+            atomic_store_explicit(&new_a->buf[i & (new_a->capacity - 1)],
+                atomic_load_explicit(&a->buf[i & (a->capacity - 1)],
+                    memory_order_relaxed),
+                memory_order_relaxed);
+        }
+        new_a->prev = a;
+        atomic_store_explicit(&d->array, new_a, memory_order_release);
+        a = new_a;
+    }
+
+    atomic_store_explicit(&a->buf[b & (a->capacity - 1)], t,
+        memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+static struct task * deque_take(struct deque *d)
+{
+    const i64 b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    struct deque_array *a =
+        atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    i64 top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (top > b) {
+        /* Empty */
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    struct task *t = atomic_load_explicit(&a->buf[b & (a->capacity - 1)],
+        memory_order_relaxed);
+    if (top == b) {
+        /* The last task - race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+        {
+            t = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return t;
+}
+
+static enum steal_result deque_steal(struct deque *d, struct task **out)
+{
+    i64 top = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    const i64 b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (top >= b)
+        return STEAL_EMPTY;
+
+    struct deque_array *a =
+        atomic_load_explicit(&d->array, memory_order_acquire);
+    struct task *t = atomic_load_explicit(&a->buf[top & (a->capacity - 1)],
+        memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+    {
+        return STEAL_LOST_RACE;
+    }
+
+    *out = t;
+    return STEAL_OK;
+}
+
+static void deque_destroy(struct deque *d)
+{
+    struct deque_array *a =
+        atomic_load_explicit(&d->array, memory_order_relaxed);
+    while (a != NULL) {
+        struct deque_array *prev = a->prev;
+        free(a);
+        a = prev;
+    }
+    atomic_store_explicit(&d->array, NULL, memory_order_relaxed);
+}
+
+static void * worker_main(void *arg)
+{
+    struct worker *self = arg;
+    struct threadpool *tp = self->tp;
+    tl_worker = self;
+
+    u32 idle_rounds = 0;
+    while (!atomic_load_explicit(&tp->stop, memory_order_acquire)) {
+        const u64 epoch = atomic_load(&tp->work_epoch);
+
+        struct task *t = find_task(tp, self);
+        if (t != NULL) {
+            run_task(tp, t);
+            idle_rounds = 0;
+        } else if (++idle_rounds < THREADPOOL_IDLE_SPIN_ROUNDS) {
+            spinlock_cpu_relax();
+        } else {
+            idle_wait(tp, epoch, NULL);
+            idle_rounds = 0;
+        }
+    }
+
+    tl_worker = NULL;
+    return NULL;
+}
+
+static struct worker * current_worker(const struct threadpool *tp)
+{
+    return tl_worker != NULL && tl_worker->tp == tp ? tl_worker : NULL;
+}
+
+/* xorshift64 */
+static u32 next_random(u64 *state)
+{
+    if (*state == 0)
+        *state = 0x2545F4914F6CDD1DULL ^ (u64)(uintptr_t)state;
+
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (u32)(*state >> 32);
+}
+
+static struct task * find_task(struct threadpool *tp, struct worker *self)
+{
+    struct task *t = NULL;
+
+    /* 1. Our own deque (newest first) */
+    if (self != NULL && (t = deque_take(&self->deque)) != NULL)
+        return t;
+
+    /* 2. The injection queue (oldest first) */
+    if (atomic_load_explicit(&tp->n_injected, memory_order_acquire) > 0) {
+        hybridlock_acquire(&tp->inject_lock);
+        t = tp->inject_head;
+        if (t != NULL) {
+            tp->inject_head = t->next;
+            if (tp->inject_head == NULL)
+                tp->inject_tail = NULL;
+            atomic_fetch_sub_explicit(&tp->n_injected, 1,
+                memory_order_relaxed);
+        }
+        hybridlock_release(&tp->inject_lock);
+        if (t != NULL)
+            return t;
+    }
+
+    /* 3. Someone else's deque (oldest first), starting at a random victim */
+    if (tp->n_workers == 0)
+        return NULL;
+
+    u64 *rng = self != NULL ? &self->rng_state : &tl_rng_state;
+    const u32 start = next_random(rng) % tp->n_workers;
+    for (u32 i = 0; i < tp->n_workers; i++) {
+        struct worker *victim = &tp->workers[(start + i) % tp->n_workers];
+        if (victim == self)
+            continue;
+
+        enum steal_result ret;
+        while (ret = deque_steal(&victim->deque, &t), ret == STEAL_LOST_RACE)
+            spinlock_cpu_relax();
+
+        if (ret == STEAL_OK)
+            return t;
+    }
+
+    return NULL;
+}
+
+static void run_task(struct threadpool *tp, struct task *t)
+{
+    struct threadpool_group *group = t->group;
+    t->fn(t->arg);
+    free(t);
+
+    if (atomic_fetch_sub_explicit(&group->n_pending, 1,
+            memory_order_acq_rel) == 1)
+    {
+        /* Wake up whoever is waiting for the group */
+        notify(tp, true);
+    }
+}
+
+static void idle_wait(struct threadpool *tp, u64 epoch,
+    const struct threadpool_group *group)
+{
+    /* Paired with `notify`: either the notifier sees `n_sleeping > 0`
+     * and signals us, or we see the new epoch and don't go to sleep */
+    atomic_fetch_add(&tp->n_sleeping, 1);
+
+    (void) pthread_mutex_lock(&tp->sleep_mutex);
+    while (atomic_load(&tp->work_epoch) == epoch
+        && !atomic_load(&tp->stop)
+        && (group == NULL || atomic_load(&group->n_pending) > 0))
+    {
+        (void) pthread_cond_wait(&tp->sleep_cond, &tp->sleep_mutex);
+    }
+    (void) pthread_mutex_unlock(&tp->sleep_mutex);
+
+    atomic_fetch_sub(&tp->n_sleeping, 1);
+}
+
+static void notify(struct threadpool *tp, bool all)
+{
+    atomic_fetch_add(&tp->work_epoch, 1);
+    if (atomic_load(&tp->n_sleeping) == 0)
+        return;
+
+    (void) pthread_mutex_lock(&tp->sleep_mutex);
+    if (all)
+        (void) pthread_cond_broadcast(&tp->sleep_cond);
+    else
+        (void) pthread_cond_signal(&tp->sleep_cond);
+    (void) pthread_mutex_unlock(&tp->sleep_mutex);
+}
+
+static void pin_workers(struct threadpool *tp)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        s_log_warn("Failed to get the CPU affinity mask; "
+            "not pinning the workers");
+        return;
+    }
+
+    const i32 n_cpus = CPU_COUNT(&allowed);
+    if (n_cpus <= 0)
+        return;
+
+    i32 cpu = -1;
+    for (u32 i = 0; i < tp->n_started; i++) {
+        /* Find the next allowed CPU (wrapping around) */
+        do {
+            cpu = (cpu + 1) % CPU_SETSIZE;
+        } while (!CPU_ISSET(cpu, &allowed));
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(tp->threads[i], sizeof(set), &set))
+            s_log_warn("Failed to pin worker %u to CPU %d", i, cpu);
+        else
+            s_log_debug("Pinned worker %u to CPU %d", i, cpu);
+    }
+}
@@ -0,0 +1,117 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+#include "static-tests.h"
+
+#include "int.h"
+#include <stdatomic.h>
+
+/* `core/threadpool` - a work-stealing thread pool.
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops tasks
+ * at the bottom of its own deque (LIFO, cache-friendly),
+ * while idle workers steal from the top of the others' deques (FIFO).
+ * Tasks submitted from outside of the pool go to a shared,
+ * lock-protected injection queue, which the workers also poll.
+ *
+ * Tasks are tracked with task groups. A thread waiting for a group
+ * doesn't just sleep - it keeps running tasks (its own, injected
+ * or stolen ones) until the group is done, so tasks can submit
+ * and wait for sub-tasks, and a pool with 0 workers still works
+ * (everything then runs on the waiting thread).
+ *
+ * Workers with nothing to do spin for a little while
+ * and then go to sleep until new tasks are submitted.
+ * They block all signals, so signals always go to the application's
+ * own threads. */
+
+/* The initial capacity of each worker's deque (grows as needed) */
+#define THREADPOOL_DEQUE_INITIAL_CAPACITY 256
+
+/* The number of failed attempts to find a task
+ * after which an idle worker goes to sleep */
+#define THREADPOOL_IDLE_SPIN_ROUNDS 64
+
+/* The maximum number of worker threads in one pool */
+#define THREADPOOL_MAX_WORKERS 1024
+
+enum threadpool_flags {
+    /* Pin worker no. `i` to the `i`-th CPU the process is allowed
+     * to run on (wrapping around if there are more workers than CPUs) */
+    THREADPOOL_FLAG_PIN_CPUS = 1 << 0,
+};
+
+typedef void (*threadpool_task_fn_t)(void *arg);
+
+/* Tracks the completion of a set of tasks.
+ * Must be initialized with `threadpool_group_init` (or `THREADPOOL_GROUP_INIT`)
+ * and must not be reused until `threadpool_group_wait` returns. */
+struct threadpool_group {
+    _Atomic u64 n_pending;
+};
+#define THREADPOOL_GROUP_INIT { 0 }
+
+struct threadpool;
+
+/* Creates a pool with `n_workers` worker threads (0 is allowed).
+ * `flags` is a combination of `THREADPOOL_FLAG_...` values.
+ *
+ * If some of the threads can't be created, the pool runs
+ * with fewer workers (and a warning is logged).
+ * Returns `NULL` on failure. */
+struct threadpool * threadpool_create(u32 n_workers, u32 flags);
+
+/* Queues `fn(arg)` to be run by the pool as part of `group`.
+ * When called from one of the pool's workers (i.e. from inside a task),
+ * the task goes to that worker's own deque. */
+void threadpool_submit(struct threadpool *tp, struct threadpool_group *group,
+    threadpool_task_fn_t fn, void *arg);
+
+void threadpool_group_init(struct threadpool_group *group);
+
+/* Runs tasks until all the tasks in `group`
+ * (including those submitted while waiting) have finished */
+void threadpool_group_wait(struct threadpool *tp,
+    struct threadpool_group *group);
+
+/* The function called for every item in `threadpool_parallel_for`.
+ * `slot` is the result of `threadpool_get_slot` for the running thread. */
+typedef void (*threadpool_for_fn_t)(void *arg, u64 index, u32 slot);
+
+/* Runs `fn(arg, i, slot)` for every `i` in [0, `n_items`) and waits for
+ * all of them to finish. The range is split in halves recursively
+ * until the pieces have at most `grain` items (0 means pick automatically),
+ * so that idle workers can steal the unstarted halves. */
+void threadpool_parallel_for(struct threadpool *tp, u64 n_items, u64 grain,
+    threadpool_for_fn_t fn, void *arg);
+
+/* Returns the number of worker threads in the pool */
+u32 threadpool_get_n_workers(const struct threadpool *tp);
+
+/* Returns the index of the calling thread in `tp`:
+ * [0, n_workers) for the pool's workers,
+ * and `n_workers` for any other thread.
+ * Useful for indexing per-thread state (of size n_workers + 1),
+ * as long as only one outside thread waits on the pool at a time. */
+u32 threadpool_get_slot(const struct threadpool *tp);
+
+/* Stops and joins all the workers and frees the pool.
+ * All task groups must have been waited for. */
+void threadpool_destroy(struct threadpool **tp_p);
+
+#endif /* THREADPOOL_H_ */
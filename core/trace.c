@@ -0,0 +1,264 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include "int.h"
+#include "log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define MODULE_NAME "trace"
+
+#define EVENTS_PER_CHUNK 4096
+
+struct trace_event {
+    u64 ts_ns;
+    const char *category;
+    const char *name;
+    char phase; /* 'B' or 'E' */
+    char detail[TRACE_DETAIL_MAX_LEN + 1];
+};
+
+struct trace_chunk {
+    struct trace_chunk *next;
+    u32 n_events;
+    struct trace_event events[EVENTS_PER_CHUNK];
+};
+
+/* A per-thread event buffer. Only ever written to by its owner thread. */
+struct trace_buffer {
+    struct trace_buffer *next; /* In the global list */
+    u32 tid;
+    u64 n_events;
+    u64 n_dropped;
+    struct trace_chunk *head, *tail;
+};
+
+static _Atomic bool g_enabled = ATOMIC_VAR_INIT(false);
+static _Atomic u64 g_start_ns = ATOMIC_VAR_INIT(0);
+static _Atomic u32 g_next_tid = ATOMIC_VAR_INIT(1);
+
+/* Lock-free (push-only) list of all the registered thread buffers */
+static struct trace_buffer *_Atomic g_buffers = ATOMIC_VAR_INIT(NULL);
+
+static _Thread_local struct trace_buffer *tl_buffer = NULL;
+
+static u64 now_ns(void);
+static struct trace_buffer * get_thread_buffer(void);
+static void record_event(char phase, const char *category, const char *name,
+    const char *detail);
+static void write_json_string(FILE *fp, const char *str);
+
+void trace_enable(void)
+{
+    atomic_store(&g_start_ns, now_ns());
+    atomic_store(&g_enabled, true);
+}
+
+bool trace_enabled(void)
+{
+    return atomic_load_explicit(&g_enabled, memory_order_relaxed);
+}
+
+void trace_begin(const char *category, const char *name, const char *detail)
+{
+    if (!atomic_load_explicit(&g_enabled, memory_order_relaxed))
+        return;
+
+    record_event('B', category, name, detail);
+}
+
+void trace_end(const char *category, const char *name)
+{
+    if (!atomic_load_explicit(&g_enabled, memory_order_relaxed))
+        return;
+
+    record_event('E', category, name, NULL);
+}
+
+i32 trace_write_json(const char *path)
+{
+    atomic_store(&g_enabled, false);
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        s_log_error("Failed to open trace output file \"%s\": %s",
+            path, strerror(errno));
+        return 1;
+    }
+
+    const u64 start_ns = atomic_load(&g_start_ns);
+    bool first = true;
+    u64 n_dropped = 0;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    struct trace_buffer *buf = atomic_exchange(&g_buffers, NULL);
+    while (buf != NULL) {
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+            first ? "" : ",", buf->tid, buf->tid);
+        first = false;
+
+        struct trace_chunk *chunk = buf->head;
+        while (chunk != NULL) {
+            for (u32 i = 0; i < chunk->n_events; i++) {
+                const struct trace_event *ev = &chunk->events[i];
+                const u64 rel_ns = ev->ts_ns > start_ns ?
+                    ev->ts_ns - start_ns : 0;
+
+                fprintf(fp, ",\n{\"name\":");
+                write_json_string(fp, ev->name);
+                fprintf(fp, ",\"cat\":");
+                write_json_string(fp, ev->category);
+                fprintf(fp, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%llu.%03llu",
+                    ev->phase, buf->tid,
+                    (unsigned long long)(rel_ns / 1000),
+                    (unsigned long long)(rel_ns % 1000));
+                if (ev->detail[0] != '\0') {
+                    fprintf(fp, ",\"args\":{\"detail\":");
+                    write_json_string(fp, ev->detail);
+                    fprintf(fp, "}");
+                }
+                fprintf(fp, "}");
+            }
+
+            struct trace_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+
+        n_dropped += buf->n_dropped;
+        struct trace_buffer *next = buf->next;
+        free(buf);
+        buf = next;
+    }
+    tl_buffer = NULL;
+
+    fprintf(fp, "\n]}\n");
+
+    if (n_dropped > 0) {
+        s_log_warn("%llu trace events were dropped "
+            "(more than %u events on a single thread)",
+            (unsigned long long)n_dropped, TRACE_MAX_EVENTS_PER_THREAD);
+    }
+
+    if (ferror(fp)) {
+        s_log_error("Failed to write to trace output file \"%s\": %s",
+            path, strerror(errno));
+        (void) fclose(fp);
+        return 1;
+    }
+
+    if (fclose(fp)) {
+        s_log_error("Failed to close trace output file \"%s\": %s",
+            path, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+static u64 now_ns(void)
+{
+    struct timespec ts = { 0 };
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u64)ts.tv_sec * 1000000000ULL) + (u64)ts.tv_nsec;
+}
+
+static struct trace_buffer * get_thread_buffer(void)
+{
+    if (tl_buffer != NULL)
+        return tl_buffer;
+
+    struct trace_buffer *buf = calloc(1, sizeof(struct trace_buffer));
+    if (buf == NULL)
+        return NULL;
+
+    buf->tid = atomic_fetch_add(&g_next_tid, 1);
+
+    /* Push onto the global list */
+    buf->next = atomic_load(&g_buffers);
+    while (!atomic_compare_exchange_weak(&g_buffers, &buf->next, buf))
+        ;
+
+    tl_buffer = buf;
+    return buf;
+}
+
+static void record_event(char phase, const char *category, const char *name,
+    const char *detail)
+{
+    struct trace_buffer *buf = get_thread_buffer();
+    if (buf == NULL)
+        return;
+
+    if (buf->n_events >= TRACE_MAX_EVENTS_PER_THREAD) {
+        buf->n_dropped++;
+        return;
+    }
+
+    if (buf->tail == NULL || buf->tail->n_events == EVENTS_PER_CHUNK) {
+        struct trace_chunk *chunk = malloc(sizeof(struct trace_chunk));
+        if (chunk == NULL) {
+            buf->n_dropped++;
+            return;
+        }
+        chunk->next = NULL;
+        chunk->n_events = 0;
+
+        if (buf->tail != NULL)
+            buf->tail->next = chunk;
+        else
+            buf->head = chunk;
+        buf->tail = chunk;
+    }
+
+    struct trace_event *ev = &buf->tail->events[buf->tail->n_events++];
+    ev->ts_ns = now_ns();
+    ev->category = category;
+    ev->name = name;
+    ev->phase = phase;
+    if (detail != NULL) {
+        (void) strncpy(ev->detail, detail, TRACE_DETAIL_MAX_LEN);
+        ev->detail[TRACE_DETAIL_MAX_LEN] = '\0';
+    } else {
+        ev->detail[0] = '\0';
+    }
+
+    buf->n_events++;
+}
+
+static void write_json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (const u8 *c = (const u8 *)str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(fp, "\\%c", *c);
+        else if (*c < 0x20 || *c >= 0x7f) /* Keep the output valid UTF-8 */
+            fprintf(fp, "\\u%04x", *c);
+        else
+            fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
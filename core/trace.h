@@ -0,0 +1,66 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef TRACE_H_
+#define TRACE_H_
+#include "static-tests.h"
+
+#include "int.h"
+#include <stdbool.h>
+
+/* `core/trace` - a minimal timeline event recorder
+ * that writes Chrome trace event JSON (viewable in `chrome://tracing`,
+ * Perfetto UI, or any other compatible trace viewer).
+ *
+ * Every thread records its events into its own buffer,
+ * so recording is lock-free and never contends with other threads.
+ * The buffers are registered in a global list on first use
+ * and are only read by `trace_write_json()`,
+ * which must not be called while other threads are still recording.
+ *
+ * When tracing isn't enabled, `trace_begin`/`trace_end` cost
+ * a single relaxed atomic load. */
+
+/* The maximum length of an event's detail string
+ * (longer strings are truncated) */
+#define TRACE_DETAIL_MAX_LEN 63
+
+/* The maximum number of events recorded by a single thread.
+ * Any events above this limit are dropped (and counted). */
+#define TRACE_MAX_EVENTS_PER_THREAD (1024 * 1024)
+
+/* Starts recording events */
+void trace_enable(void);
+
+/* Returns whether events are being recorded */
+bool trace_enabled(void);
+
+/* Records the beginning of a span named `name` in category `category`.
+ * `name` and `category` must be string literals (or otherwise outlive
+ * the call to `trace_write_json`), while `detail` (which can be `NULL`)
+ * is copied and shown in the viewer as the `detail` argument. */
+void trace_begin(const char *category, const char *name, const char *detail);
+
+/* Records the end of the last span named `name` on the calling thread */
+void trace_end(const char *category, const char *name);
+
+/* Writes all recorded events to `path` as Chrome trace JSON
+ * and frees all the event buffers.
+ *
+ * Returns 0 on success and non-zero on failure. */
+i32 trace_write_json(const char *path);
+
+#endif /* TRACE_H_ */
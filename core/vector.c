@@ -15,6 +15,7 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>
 */
 #include "vector.h"
+#include "arena.h"
 #include "int.h"
 #include "log.h"
 #include "math.h"
@@ -22,41 +23,56 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct vector_metadata__ {
-    u32 n_items;
+    u64 n_items;
+    u64 capacity;
     u32 item_size;
-    u32 capacity;
     u32 dummy_;
+
+    /* The arena the storage is allocated from, or `NULL` for the heap */
+    struct arena *arena;
 } vector_meta_t;
 
 static_assert(sizeof(struct vector_metadata__) == VECTOR_METADATA_SIZE__,
     "The size of struct vector_metadata must be equal to "
-    "VECTOR_METADATA_SIZE__ (16 bytes)");
+    "VECTOR_METADATA_SIZE__ (32 bytes)");
 
 #define MODULE_NAME "vector"
 
 #define get_metadata_ptr(v) \
     ((vector_meta_t *)(((u8 *)v) - sizeof(vector_meta_t)))
 
-#define element_at(v, at) (((u8 *)v) + (at * get_metadata_ptr(v)->item_size))
+#define element_at(v, at) (((u8 *)v) + ((at) * get_metadata_ptr(v)->item_size))
+
+static_assert(offsetof(struct vector_metadata__, n_items)
+    == VECTOR_METADATA_N_ITEMS_OFFSET__,
+    "`n_items` must be at VECTOR_METADATA_N_ITEMS_OFFSET__");
 
-static void * vector_realloc(void *v, u32 new_capacity);
-static void vector_increase_size(void **v_p);
-static void vector_memmove(void *v, u32 src_index, u32 dst_index, u32 nmemb);
+static void * vector_realloc(void *v, u64 new_capacity);
+static void vector_increase_size(void **v_p, u64 n);
+static void vector_memmove(void *v, u64 src_index, u64 dst_index, u64 nmemb);
 
 void * vector_init(u32 item_size)
 {
-    const u32 total_size = sizeof(vector_meta_t) +
-        (item_size * VECTOR_MINIMUM_CAPACITY__);
-    void *v = malloc(total_size);
-    s_assert(v != NULL, "malloc() failed for vector");
+    return vector_init_in(item_size, NULL);
+}
+
+void * vector_init_in(u32 item_size, struct arena *arena)
+{
+    const u64 total_size = sizeof(vector_meta_t) +
+        ((u64)item_size * VECTOR_MINIMUM_CAPACITY__);
+    void *v = arena ? arena_alloc(arena, total_size) : malloc(total_size);
+    s_assert(v != NULL, "Failed to allocate memory for vector");
     memset(v, 0, total_size);
 
     vector_meta_t *metadata_ptr = (vector_meta_t *)v;
     metadata_ptr->item_size = item_size;
     metadata_ptr->n_items = 0;
     metadata_ptr->capacity = VECTOR_MINIMUM_CAPACITY__;
+    metadata_ptr->arena = arena;
 
     u8 *const vector_base = ((u8 *)v) + sizeof(vector_meta_t);
     return vector_base;
@@ -67,7 +83,20 @@ void vector_push_back_prepare__(void **v_p)
     u_check_params(v_p != NULL && *v_p != NULL);
 
     /* Allocate memory for the new item */
-    vector_increase_size(v_p);
+    vector_increase_size(v_p, 1);
+}
+
+void vector_push_back_n__(void **v_p, const void *items, u64 n)
+{
+    u_check_params(v_p != NULL && *v_p != NULL && (items != NULL || n == 0));
+    if (n == 0)
+        return;
+
+    const u64 old_size = get_metadata_ptr(*v_p)->n_items;
+    vector_increase_size(v_p, n);
+
+    const vector_meta_t *meta = get_metadata_ptr(*v_p);
+    memcpy(element_at(*v_p, old_size), items, n * meta->item_size);
 }
 
 void vector_pop_back__(void **v_p)
@@ -76,21 +105,17 @@ void vector_pop_back__(void **v_p)
 
     vector_meta_t *meta = get_metadata_ptr(*v_p);
 
+    s_assert(meta->n_items > 0, "Attempt to pop from an empty vector");
     meta->n_items--;
     memset(element_at(*v_p, meta->n_items), 0, meta->item_size);
-
-    if (meta->n_items <= (meta->capacity / 2) &&
-        meta->n_items >= VECTOR_MINIMUM_CAPACITY__) {
-        *v_p = vector_realloc(*v_p, meta->capacity / 2);
-    }
 }
 
-void * vector_insert_prepare__(void **v_p, u32 at)
+void * vector_insert_prepare__(void **v_p, u64 at)
 {
     u_check_params(v_p != NULL && *v_p != NULL && at < vector_size(*v_p));
 
     /* Expand the vector by one */
-    vector_increase_size(v_p);
+    vector_increase_size(v_p, 1);
 
     /* Move everything after and including `at` one spot to the right */
     vector_memmove(*v_p, at, at + 1, vector_size(*v_p) - at);
@@ -103,7 +128,7 @@ bool vector_empty(void *v)
     return v == NULL ? true : get_metadata_ptr(v)->n_items == 0;
 }
 
-u32 vector_capacity(void *v)
+u64 vector_capacity(void *v)
 {
     return v == NULL ? 0 : get_metadata_ptr(v)->capacity;
 }
@@ -133,7 +158,14 @@ void vector_clear__(void **v_p)
     meta->n_items = 0;
 }
 
-void vector_erase__(void **v_p, u32 index)
+void vector_clear_nozero__(void **v_p)
+{
+    u_check_params(v_p != NULL && *v_p != NULL);
+
+    get_metadata_ptr(*v_p)->n_items = 0;
+}
+
+void vector_erase__(void **v_p, u64 index)
 {
     u_check_params(v_p != NULL && *v_p != NULL);
 
@@ -141,7 +173,8 @@ void vector_erase__(void **v_p, u32 index)
 
     s_assert(index < meta->n_items,
         "Attempt to erase element outside of array bounds "
-        "(index: %u, n_items: %u", index, meta->n_items);
+        "(index: %llu, n_items: %llu)",
+        (unsigned long long)index, (unsigned long long)meta->n_items);
 
     /* Move all memory after `index` one spot to the left,
      * and then deallocate the last (now unused) spot */
@@ -149,7 +182,7 @@ void vector_erase__(void **v_p, u32 index)
     vector_pop_back__(v_p);
 }
 
-void vector_reserve__(void **v_p, u32 count)
+void vector_reserve__(void **v_p, u64 count)
 {
     u_check_params(v_p != NULL && *v_p != NULL);
 
@@ -158,7 +191,7 @@ void vector_reserve__(void **v_p, u32 count)
         *v_p = vector_realloc(*v_p, count);
 }
 
-void vector_resize__(void **v_p, u32 new_size)
+void vector_resize__(void **v_p, u64 new_size)
 {
     u_check_params(v_p != NULL && *v_p != NULL);
 
@@ -182,7 +215,7 @@ void * vector_clone(void *v)
 
     vector_meta_t *meta_p = get_metadata_ptr(v);
 
-    void *new_v = vector_init(meta_p->item_size);
+    void *new_v = vector_init_in(meta_p->item_size, meta_p->arena);
 
     new_v = vector_realloc(new_v, meta_p->capacity);
 
@@ -199,14 +232,21 @@ void vector_destroy__(void **v_p)
 
     vector_meta_t *meta_ptr = get_metadata_ptr(*v_p);
 
+    /* Arena memory is only ever released all at once */
+    if (meta_ptr->arena != NULL) {
+        *v_p = NULL;
+        return;
+    }
+
     /* Reset the entire vector, including the metadata */
-    memset(meta_ptr, 0, sizeof(vector_meta_t) + meta_ptr->capacity);
+    memset(meta_ptr, 0, sizeof(vector_meta_t)
+        + (meta_ptr->capacity * meta_ptr->item_size));
     free(meta_ptr);
 
     *v_p = NULL;
 }
 
-static void * vector_realloc(void *v, u32 new_cap)
+static void * vector_realloc(void *v, u64 new_cap)
 {
     /* Unfortunately if `v` is NULL we do not know the element size,
      * and so we cannot make it work like realloc(NULL, size) would */
@@ -219,8 +259,17 @@ static void * vector_realloc(void *v, u32 new_cap)
         new_cap = VECTOR_MINIMUM_CAPACITY__;
 
     vector_meta_t *meta_p = get_metadata_ptr(v);
-    new_v = realloc(meta_p,
-        (new_cap * meta_p->item_size) + sizeof(vector_meta_t));
+    s_assert(new_cap <= (UINT64_MAX - sizeof(vector_meta_t)) / meta_p->item_size,
+        "Vector capacity overflow");
+    const u64 new_size = (new_cap * meta_p->item_size)
+        + sizeof(vector_meta_t);
+    if (meta_p->arena != NULL) {
+        const u64 old_size = (meta_p->capacity * meta_p->item_size)
+            + sizeof(vector_meta_t);
+        new_v = arena_realloc(meta_p->arena, meta_p, old_size, new_size);
+    } else {
+        new_v = realloc(meta_p, new_size);
+    }
 
 
     s_assert(new_v != NULL, "realloc() failed!");
@@ -230,30 +279,31 @@ static void * vector_realloc(void *v, u32 new_cap)
     return ((u8 *)new_v) + sizeof(vector_meta_t);
 }
 
-static void vector_increase_size(void **v_p)
+static void vector_increase_size(void **v_p, u64 n)
 {
     u_check_params(v_p != NULL && *v_p != NULL);
 
     vector_meta_t *meta = get_metadata_ptr(*v_p);
+    s_assert(n <= UINT64_MAX - meta->n_items, "Vector size overflow");
+    const u64 new_size = meta->n_items + n;
 
-    if (meta->n_items >= meta->capacity) {
-        u32 new_cap = meta->capacity;
-        if (new_cap > 0)
-            new_cap *= 2;
-        else
-            new_cap++;
+    if (new_size > meta->capacity) {
+        /* Grow geometrically so that appends are amortized O(1),
+         * or straight to `new_size` if even that isn't enough */
+        u64 new_cap = meta->capacity / VECTOR_GROWTH_DEN__ * VECTOR_GROWTH_NUM__;
+        if (new_cap < new_size)
+            new_cap = new_size;
 
         *v_p = vector_realloc(*v_p, new_cap);
 
         /* `meta` might have been moved by `realloc()` */
         meta = get_metadata_ptr(*v_p);
-        meta->capacity = new_cap;
     }
 
-    meta->n_items++;
+    meta->n_items = new_size;
 }
 
-static void vector_memmove(void *v, u32 src_index, u32 dst_index, u32 nmemb)
+static void vector_memmove(void *v, u64 src_index, u64 dst_index, u64 nmemb)
 {
     u_check_params(v != NULL);
 
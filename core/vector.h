@@ -25,9 +25,16 @@
 #include <stdlib.h>
 
 #define VECTOR_MINIMUM_CAPACITY__ 8U
-#define VECTOR_METADATA_SIZE__ 16U
+#define VECTOR_METADATA_SIZE__ 32U
 #define VECTOR_METADATA_N_ITEMS_OFFSET__ 0U
 
+/* When a vector runs out of capacity, it grows to
+ * `capacity * VECTOR_GROWTH_NUM__ / VECTOR_GROWTH_DEN__`
+ * (or more, if that's still not enough for a bulk append).
+ * Vectors never shrink on their own - see `vector_shrink_to_fit()`. */
+#define VECTOR_GROWTH_NUM__ 3U
+#define VECTOR_GROWTH_DEN__ 2U
+
 /* Used for a cleaner declaration of vector variables */
 #define VECTOR(T) T *
 
@@ -35,6 +42,13 @@
 #define vector_new(T) ((T *)vector_init(sizeof(T)))
 void * vector_init(u32 item_size);
 
+/* Create a new vector of type `T` with its storage allocated from `arena`.
+ * Such a vector must not outlive the arena (or its next reset),
+ * and `vector_destroy()` doesn't free any memory. */
+struct arena;
+#define vector_new_in(T, arena) ((T *)vector_init_in(sizeof(T), (arena)))
+void * vector_init_in(u32 item_size, struct arena *arena);
+
 /* Get the element at `index` from `v` */
 #define vector_at(v, index) ((v) != NULL && (index) < vector_size((v))      \
     ? (v)[(index)]                                                          \
@@ -49,7 +63,19 @@ void * vector_init(u32 item_size);
 } while (0)
 void vector_push_back_prepare__(void **v_p);
 
-/* Remove the last element from `*v_p` */
+/* Append `n` items from the array `items` to `*v_p` (with a single copy).
+ * `items` must point to items of the same type as the vector's. */
+#define vector_push_back_n(v_p, items, n) do {                              \
+    (void)sizeof((*(v_p))[0] = (items)[0]); /* Type check */               \
+    vector_push_back_n__((void **)((void)**v_p, v_p), (items), (n));        \
+} while (0)
+void vector_push_back_n__(void **v_p, const void *items, u64 n);
+
+/* Append the items in the range [`begin`, `end`) to `*v_p` */
+#define vector_append_range(v_p, begin, end) \
+    vector_push_back_n((v_p), (begin), (u64)((end) - (begin)))
+
+/* Remove the last element from `*v_p` (without shrinking the capacity) */
 #define vector_pop_back(v_p) vector_pop_back__((void **)((void)**v_p, v_p))
 void vector_pop_back__(void **v_p);
 
@@ -58,11 +84,11 @@ void vector_pop_back__(void **v_p);
     vector_insert_prepare__((void **)((void)**v_p, v_p), (at));             \
     (*(v_p))[at] = __VA_ARGS__;                                             \
 } while (0)
-void * vector_insert_prepare__(void **v_p, u32 at);
+void * vector_insert_prepare__(void **v_p, u64 at);
 
 /* Remove element from `v` at index `at` */
 #define vector_erase(v_p, at) vector_erase__((void **)((void)**v_p, v_p), at)
-void vector_erase__(void **v_p, u32 at);
+void vector_erase__(void **v_p, u64 at);
 
 /* Return the pointer to the first element of `v` */
 #define vector_begin(v) (vector_size(v) > 0 ? v : NULL)
@@ -80,12 +106,12 @@ void * vector_end(void *v);
 bool vector_empty(void *v);
 
 /* Return the size of `v` (number of elements) */
-#define vector_size(v) ((u32)(*((u32 *)(                                    \
+#define vector_size(v) ((u64)(*((u64 *)(                                    \
     ((u8 *)(v)) - VECTOR_METADATA_SIZE__ + VECTOR_METADATA_N_ITEMS_OFFSET__)\
 )))
 
 /* Return the allocated capacity of `v` */
-u32 vector_capacity(void *v);
+u64 vector_capacity(void *v);
 
 /* Shrink `capacity` to `size` */
 #define vector_shrink_to_fit(v_p) \
@@ -97,17 +123,23 @@ void vector_shrink_to_fit__(void **v_p);
 #define vector_clear(v_p) vector_clear__((void **)((void)**v_p, v_p))
 void vector_clear__(void **v_p);
 
+/* Same as `vector_clear()`, but without zeroing the old elements.
+ * This is O(1) regardless of the size of the vector. */
+#define vector_clear_nozero(v_p) \
+    vector_clear_nozero__((void **)((void)**v_p, v_p))
+void vector_clear_nozero__(void **v_p);
+
 /* Increase the capacity of `v` to `count`
  * (if `count` is greater than the capacity of `v`) */
 #define vector_reserve(v_p, count) \
     vector_reserve__((void **)((void)**v_p, v_p), count)
-void vector_reserve__(void **v_p, u32 count);
+void vector_reserve__(void **v_p, u64 count);
 
 /* Resize `v` to `new_size`,
  * cutting off any elements at index greater than `new_size` */
 #define vector_resize(v_p, new_size) \
     vector_resize__((void **)((void)**v_p, v_p), new_size)
-void vector_resize__(void **v_p, u32 new_size);
+void vector_resize__(void **v_p, u64 new_size);
 
 #define vector_copy vector_clone
 void * vector_clone(void *v);
@@ -0,0 +1,446 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "diff.h"
+#include "analyze.h"
+#include "chainindex.h"
+#include "mtkparthdr.h"
+#include "byteorder.h"
+#include "io.h"
+#include "stats.h"
+#include "bufpool.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <core/hash.h>
+#include <core/trace.h>
+#include <core/vector.h>
+#include <core/hashmap.h>
+#include <core/threadpool.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MODULE_NAME "diff"
+
+static_assert(DIFF_BLOCK_SIZE == ANALYZE_BLOCK_SIZE,
+    "The analysis reuses the diff blocks");
+static_assert(DIFF_BLOCK_SIZE <= BUFPOOL_BUF_SIZE,
+    "A block must fit in a pool buffer");
+
+#define DIFF_SIDE_OLD 0
+#define DIFF_SIDE_NEW 1
+#define DIFF_N_SIDES 2
+
+struct diff_side {
+    const char *path;
+    i32 fd;
+    struct chain_index ci;
+};
+
+/* Two entries with the same name (and occurrence).
+ * Either one is `NULL` if the entry was added or removed. */
+struct diff_pair {
+    const struct chain_entry *entries[DIFF_N_SIDES];
+
+    /* The part of the body that can actually be read from the file */
+    u64 body_sizes[DIFF_N_SIDES];
+
+    /* This pair's blocks in `diff_ctx.hashes` */
+    u64 first_block;
+    u64 n_blocks;
+};
+
+/* Identifies an entry by its name and how many entries
+ * with the same name come before it in the chain */
+struct diff_key {
+    char name[MTK_PART_NAME_LEN];
+    u32 occurrence;
+};
+
+struct diff_ctx {
+    struct diff_side sides[DIFF_N_SIDES];
+    VECTOR(struct diff_pair) pairs;
+
+    /* For every block: the pair it belongs to, and its hash in each file */
+    u32 *block_pairs;
+    u64 *hashes[DIFF_N_SIDES];
+
+    /* With `--analyze`: the byte histogram of every block of the new file */
+    bool analyze;
+    u32 (*block_hists)[ANALYZE_N_BYTE_VALUES];
+
+    _Atomic u32 n_read_errors;
+};
+
+static i32 open_side(struct diff_side *side, const char *path);
+static void match_entries(struct diff_ctx *ctx);
+static void add_pair(struct diff_ctx *ctx, const struct chain_entry *old_e,
+    const struct chain_entry *new_e);
+static void hash_block_task(void *arg, u64 index, u32 slot);
+static bool report_pair(const struct diff_ctx *ctx, const struct diff_pair *p);
+static void report_analysis(const struct diff_ctx *ctx,
+    const struct diff_pair *p);
+
+i32 diff_files(const char *old_path, const char *new_path,
+    struct threadpool *tp, bool analyze)
+{
+    u_check_params(old_path != NULL && new_path != NULL && tp != NULL);
+
+    struct diff_ctx ctx = { .analyze = analyze };
+    i32 ret = -1;
+    ctx.sides[DIFF_SIDE_OLD].fd = ctx.sides[DIFF_SIDE_NEW].fd = -1;
+
+    if (open_side(&ctx.sides[DIFF_SIDE_OLD], old_path) ||
+        open_side(&ctx.sides[DIFF_SIDE_NEW], new_path))
+    {
+        goto out;
+    }
+
+    /* 1. Match the entries up */
+    ctx.pairs = vector_new(struct diff_pair);
+    match_entries(&ctx);
+
+    /* 2. Hash all the blocks of all the matched bodies */
+    u64 n_blocks = 0;
+    for (u64 i = 0; i < vector_size(ctx.pairs); i++) {
+        ctx.pairs[i].first_block = n_blocks;
+        n_blocks += ctx.pairs[i].n_blocks;
+    }
+
+    if (n_blocks > 0) {
+        ctx.block_pairs = malloc(n_blocks * sizeof(u32));
+        ctx.hashes[DIFF_SIDE_OLD] = malloc(n_blocks * sizeof(u64));
+        ctx.hashes[DIFF_SIDE_NEW] = malloc(n_blocks * sizeof(u64));
+        s_assert(ctx.block_pairs != NULL && ctx.hashes[DIFF_SIDE_OLD] != NULL
+            && ctx.hashes[DIFF_SIDE_NEW] != NULL,
+            "malloc() failed for the block hashes");
+        if (analyze) {
+            ctx.block_hists = calloc(n_blocks, sizeof(*ctx.block_hists));
+            s_assert(ctx.block_hists != NULL,
+                "calloc() failed for the block histograms");
+        }
+
+        for (u64 i = 0; i < vector_size(ctx.pairs); i++) {
+            for (u64 b = 0; b < ctx.pairs[i].n_blocks; b++)
+                ctx.block_pairs[ctx.pairs[i].first_block + b] = i;
+        }
+
+        threadpool_parallel_for(tp, n_blocks, 0, hash_block_task, &ctx);
+    }
+
+    if (atomic_load(&ctx.n_read_errors) > 0) {
+        s_log_error("Failed to read %u blocks",
+            atomic_load(&ctx.n_read_errors));
+        goto out;
+    }
+
+    /* 3. Report the differences, in the order of the new chain */
+    s_log_info("DIFF %s -> %s", old_path, new_path);
+    if (ctx.sides[DIFF_SIDE_OLD].ci.byte_order !=
+        ctx.sides[DIFF_SIDE_NEW].ci.byte_order)
+    {
+        s_log_info("    byte order: %s -> %s",
+            mtk_part_byte_order_string(ctx.sides[DIFF_SIDE_OLD].ci.byte_order),
+            mtk_part_byte_order_string(ctx.sides[DIFF_SIDE_NEW].ci.byte_order));
+    }
+
+    u32 n_changed = 0, n_added = 0, n_removed = 0, n_unchanged = 0;
+    for (u64 i = 0; i < vector_size(ctx.pairs); i++) {
+        const struct diff_pair *p = &ctx.pairs[i];
+        const bool changed = report_pair(&ctx, p);
+        if (changed && analyze && p->entries[DIFF_SIDE_NEW] != NULL)
+            report_analysis(&ctx, p);
+        if (p->entries[DIFF_SIDE_OLD] == NULL)
+            n_added++;
+        else if (p->entries[DIFF_SIDE_NEW] == NULL)
+            n_removed++;
+        else if (changed)
+            n_changed++;
+        else
+            n_unchanged++;
+    }
+    s_log_info("%u unchanged, %u changed, %u added, %u removed",
+        n_unchanged, n_changed, n_added, n_removed);
+
+    ret = n_changed + n_added + n_removed;
+
+out:
+    u_nfree(&ctx.block_pairs);
+    u_nfree(&ctx.hashes[DIFF_SIDE_OLD]);
+    u_nfree(&ctx.hashes[DIFF_SIDE_NEW]);
+    u_nfree(&ctx.block_hists);
+    if (ctx.pairs != NULL)
+        vector_destroy(&ctx.pairs);
+    for (u32 i = 0; i < DIFF_N_SIDES; i++) {
+        if (ctx.sides[i].fd >= 0) {
+            chain_index_destroy(&ctx.sides[i].ci);
+            (void) close(ctx.sides[i].fd);
+        }
+    }
+    return ret;
+}
+
+static i32 open_side(struct diff_side *side, const char *path)
+{
+    side->path = path;
+    stats_add(STATS_SYSCALLS, 1);
+    side->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (side->fd < 0) {
+        s_log_error("Failed to open \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+    stats_add(STATS_FILES_PROCESSED, 1);
+
+    trace_begin("file", "diff walk", path);
+    const i32 ret = chain_index_build(&side->ci, side->fd);
+    trace_end("file", "diff walk");
+    if (ret) {
+        s_log_error("\"%s\" doesn't start with a valid partition header",
+            path);
+        (void) close(side->fd);
+        side->fd = -1;
+        return 1;
+    }
+    stats_add(STATS_HEADERS, vector_size(side->ci.entries));
+
+    return 0;
+}
+
+static void make_key(struct diff_key *o_key, const struct hashmap *map,
+    const struct chain_entry *e)
+{
+    memset(o_key, 0, sizeof(struct diff_key));
+    strncpy(o_key->name, e->hdr.part_name, MTK_PART_NAME_LEN);
+
+    while (hashmap_lookup_bytes(map, o_key, sizeof(struct diff_key)) != NULL)
+        o_key->occurrence++;
+}
+
+static void match_entries(struct diff_ctx *ctx)
+{
+    const struct chain_index *old_ci = &ctx->sides[DIFF_SIDE_OLD].ci;
+    const struct chain_index *new_ci = &ctx->sides[DIFF_SIDE_NEW].ci;
+
+    struct hashmap *old_map = hashmap_create(0);
+    struct hashmap *new_map = hashmap_create(0);
+    s_assert(old_map != NULL && new_map != NULL, "Failed to create a hashmap");
+    bool *matched = calloc(vector_size(old_ci->entries) + 1, sizeof(bool));
+    s_assert(matched != NULL, "calloc() failed for the match flags");
+
+    struct diff_key key;
+    for (u64 i = 0; i < vector_size(old_ci->entries); i++) {
+        make_key(&key, old_map, &old_ci->entries[i]);
+        if (hashmap_insert_bytes(old_map, &key, sizeof(key),
+                &old_ci->entries[i]))
+        {
+            s_log_fatal("Failed to insert into the hashmap");
+        }
+    }
+
+    for (u64 i = 0; i < vector_size(new_ci->entries); i++) {
+        const struct chain_entry *new_e = &new_ci->entries[i];
+        make_key(&key, new_map, new_e);
+        if (hashmap_insert_bytes(new_map, &key, sizeof(key), new_e))
+            s_log_fatal("Failed to insert into the hashmap");
+
+        const struct chain_entry *old_e =
+            hashmap_lookup_bytes(old_map, &key, sizeof(key));
+        if (old_e != NULL)
+            matched[old_e - old_ci->entries] = true;
+        add_pair(ctx, old_e, new_e);
+    }
+
+    /* The removed entries go last */
+    for (u64 i = 0; i < vector_size(old_ci->entries); i++) {
+        if (!matched[i])
+            add_pair(ctx, &old_ci->entries[i], NULL);
+    }
+
+    u_nfree(&matched);
+    hashmap_destroy(&new_map);
+    hashmap_destroy(&old_map);
+}
+
+static void add_pair(struct diff_ctx *ctx, const struct chain_entry *old_e,
+    const struct chain_entry *new_e)
+{
+    struct diff_pair p = { .entries = { old_e, new_e } };
+
+    for (u32 s = 0; s < DIFF_N_SIDES; s++) {
+        const struct chain_entry *e = p.entries[s];
+        if (e == NULL)
+            continue;
+
+        /* Don't try to read past the end of a truncated file */
+        const u64 body_offset = e->hdr_offset + MTK_PART_HEADER_SIZE;
+        const u64 file_size = ctx->sides[s].ci.file_size;
+        const u64 available =
+            body_offset < file_size ? file_size - body_offset : 0;
+        p.body_sizes[s] = u_min(get_full_part_size(&e->hdr), available);
+    }
+
+    /* Only the bodies of entries present in both files are compared,
+     * but the added ones are still read when they need to be analyzed */
+    if (new_e != NULL && (old_e != NULL || ctx->analyze)) {
+        const u64 size = u_max(p.body_sizes[DIFF_SIDE_OLD],
+            p.body_sizes[DIFF_SIDE_NEW]);
+        p.n_blocks = (size + DIFF_BLOCK_SIZE - 1) / DIFF_BLOCK_SIZE;
+    }
+
+    vector_push_back(&ctx->pairs, p);
+}
+
+static void hash_block_task(void *arg, u64 index, u32 slot)
+{
+    struct diff_ctx *ctx = arg;
+    const struct diff_pair *p = &ctx->pairs[ctx->block_pairs[index]];
+    const u64 block_offset = (index - p->first_block) * DIFF_BLOCK_SIZE;
+
+    (void) slot;
+
+    u8 *buf = bufpool_get();
+    if (buf == NULL) {
+        atomic_fetch_add(&ctx->n_read_errors, 1);
+        return;
+    }
+
+    for (u32 s = 0; s < DIFF_N_SIDES; s++) {
+        /* A block past the end of a body is hashed as an empty one */
+        u64 len = 0;
+        if (block_offset < p->body_sizes[s])
+            len = u_min(DIFF_BLOCK_SIZE, p->body_sizes[s] - block_offset);
+
+        if (len > 0) {
+            const u64 offset = p->entries[s]->hdr_offset
+                + MTK_PART_HEADER_SIZE + block_offset;
+            const i64 n_read =
+                io_pread_full(ctx->sides[s].fd, buf, len, offset);
+            if (n_read < 0 || (u64)n_read != len) {
+                atomic_fetch_add(&ctx->n_read_errors, 1);
+                len = 0;
+            }
+        }
+
+        ctx->hashes[s][index] = hash_block(buf, len, HASH_DEFAULT_SEED);
+        if (s == DIFF_SIDE_NEW && ctx->analyze)
+            analyze_histogram(ctx->block_hists[index], buf, len);
+    }
+
+    bufpool_put(buf);
+}
+
+/* Logs the differences between the entries in `p`.
+ * Returns whether there were any. */
+static bool report_pair(const struct diff_ctx *ctx, const struct diff_pair *p)
+{
+    const struct chain_entry *old_e = p->entries[DIFF_SIDE_OLD];
+    const struct chain_entry *new_e = p->entries[DIFF_SIDE_NEW];
+    const struct chain_entry *e = new_e != NULL ? new_e : old_e;
+
+    if (old_e == NULL || new_e == NULL) {
+        s_log_info("  %c %.*s: %s (%llu bytes)", old_e == NULL ? '+' : '-',
+            MTK_PART_NAME_LEN, e->hdr.part_name,
+            old_e == NULL ? "added" : "removed",
+            (unsigned long long)get_full_part_size(&e->hdr));
+        return true;
+    }
+
+    /* Find the changed header fields and body blocks first,
+     * so that unchanged entries take up a single line */
+    u32 n_fields_changed = 0;
+#define X_(field) n_fields_changed += old_e->hdr.field != new_e->hdr.field;
+    MTK_PART_HEADER_U32_FIELD_LIST
+#undef X_
+
+    const u64 *old_hashes = ctx->hashes[DIFF_SIDE_OLD] + p->first_block;
+    const u64 *new_hashes = ctx->hashes[DIFF_SIDE_NEW] + p->first_block;
+    u64 n_blocks_changed = 0;
+    for (u64 b = 0; b < p->n_blocks; b++)
+        n_blocks_changed += old_hashes[b] != new_hashes[b];
+
+    if (n_fields_changed == 0 && n_blocks_changed == 0) {
+        s_log_verbose("  = %.*s: unchanged (%llu bytes)",
+            MTK_PART_NAME_LEN, e->hdr.part_name,
+            (unsigned long long)p->body_sizes[DIFF_SIDE_NEW]);
+        return false;
+    }
+
+    s_log_info("  ~ %.*s: %u header fields and %llu of %llu blocks changed",
+        MTK_PART_NAME_LEN, e->hdr.part_name, n_fields_changed,
+        (unsigned long long)n_blocks_changed, (unsigned long long)p->n_blocks);
+
+#define X_(field)                                                           \
+    if (old_e->hdr.field != new_e->hdr.field) {                             \
+        s_log_info("        %s: %#x -> %#x", #field,                        \
+            old_e->hdr.field, new_e->hdr.field);                            \
+    }
+    MTK_PART_HEADER_U32_FIELD_LIST
+#undef X_
+
+    /* Merge runs of changed blocks into ranges */
+    const u64 body_end = u_max(p->body_sizes[DIFF_SIDE_OLD],
+        p->body_sizes[DIFF_SIDE_NEW]);
+    u32 n_ranges = 0;
+    for (u64 b = 0; b < p->n_blocks; b++) {
+        if (old_hashes[b] == new_hashes[b])
+            continue;
+
+        const u64 first = b;
+        while (b + 1 < p->n_blocks && old_hashes[b + 1] != new_hashes[b + 1])
+            b++;
+
+        if (n_ranges++ < DIFF_MAX_PRINTED_RANGES) {
+            const u64 start = first * DIFF_BLOCK_SIZE;
+            const u64 end = u_min((b + 1) * DIFF_BLOCK_SIZE, body_end);
+            s_log_info("        body %#llx-%#llx (%llu bytes)",
+                (unsigned long long)start, (unsigned long long)end,
+                (unsigned long long)(end - start));
+        }
+    }
+    if (n_ranges > DIFF_MAX_PRINTED_RANGES) {
+        s_log_info("        ... and %u more changed ranges",
+            n_ranges - DIFF_MAX_PRINTED_RANGES);
+    }
+
+    return true;
+}
+
+static void report_analysis(const struct diff_ctx *ctx,
+    const struct diff_pair *p)
+{
+    struct part_analysis analysis;
+    part_analysis_init(&analysis, p->body_sizes[DIFF_SIDE_NEW]);
+
+    for (u64 b = 0; b < p->n_blocks; b++) {
+        const u64 offset = b * DIFF_BLOCK_SIZE;
+        if (offset >= p->body_sizes[DIFF_SIDE_NEW])
+            break;
+
+        part_analysis_add_block(&analysis, ctx->block_hists[p->first_block + b],
+            u_min(DIFF_BLOCK_SIZE, p->body_sizes[DIFF_SIDE_NEW] - offset));
+    }
+
+    part_analysis_report(&analysis);
+    part_analysis_destroy(&analysis);
+}
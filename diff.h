@@ -0,0 +1,55 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <core/int.h>
+#include <core/threadpool.h>
+#include <stdbool.h>
+
+/* Chain diff between two versions of a file (`--diff OLD NEW`).
+ *
+ * The entries of the two chains are matched by name (the n-th "cert1"
+ * in OLD with the n-th "cert1" in NEW) and their headers are compared
+ * field by field. The bodies of the matched entries are split into
+ * `DIFF_BLOCK_SIZE` blocks, and every block of both versions is hashed
+ * (`hash_block`) in parallel on the thread pool, one block per task.
+ * Entries whose block hashes all match are reported as unchanged
+ * without ever comparing their bytes, and for the rest, the ranges
+ * of the differing blocks are reported.
+ *
+ * With `--analyze`, the new versions of the changed and added entries
+ * are also analyzed (see `analyze.h`) from the blocks read for hashing. */
+
+/* The granularity of the body comparison (and of the reported ranges) */
+#define DIFF_BLOCK_SIZE (64 * 1024)
+
+/* The maximum number of changed ranges printed per entry */
+#define DIFF_MAX_PRINTED_RANGES 32
+
+/* Compares the chains in `old_path` and `new_path`, running the block
+ * hashing on `tp` (the calling thread helps out while waiting),
+ * and logs the differences (and, if `analyze` is set,
+ * the analysis of the new changed and added entries).
+ *
+ * Returns the number of entries that changed, were added or were removed
+ * (so 0 means that the chains are identical), or -1 if either file
+ * couldn't be read or doesn't start with a valid header. */
+i32 diff_files(const char *old_path, const char *new_path,
+    struct threadpool *tp, bool analyze);
+
+#endif /* DIFF_H_ */
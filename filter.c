@@ -0,0 +1,153 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "filter.h"
+#include "mtkparthdr.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/vector.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define MODULE_NAME "filter"
+
+static i32 parse_img_type(const char *str, u32 *o);
+
+i32 part_filter_init(struct part_filter *f,
+    const char *names, const char *types)
+{
+    memset(f, 0, sizeof(struct part_filter));
+    f->name_patterns = vector_new(char *);
+    f->img_types = vector_new(u32);
+
+    if (names != NULL) {
+        char *tmp = strdup(names);
+        s_assert(tmp != NULL, "strdup() failed");
+
+        char *save_p = NULL;
+        for (char *tok = strtok_r(tmp, ",", &save_p); tok != NULL;
+            tok = strtok_r(NULL, ",", &save_p))
+        {
+            char *pattern = strdup(tok);
+            s_assert(pattern != NULL, "strdup() failed");
+            vector_push_back(&f->name_patterns, pattern);
+        }
+        u_nfree(&tmp);
+    }
+
+    if (types != NULL) {
+        char *tmp = strdup(types);
+        s_assert(tmp != NULL, "strdup() failed");
+
+        char *save_p = NULL;
+        for (char *tok = strtok_r(tmp, ",", &save_p); tok != NULL;
+            tok = strtok_r(NULL, ",", &save_p))
+        {
+            u32 img_type = 0;
+            if (parse_img_type(tok, &img_type)) {
+                s_log_error("Unknown image type \"%s\"", tok);
+                u_nfree(&tmp);
+                part_filter_destroy(f);
+                return 1;
+            }
+            vector_push_back(&f->img_types, img_type);
+        }
+        u_nfree(&tmp);
+    }
+
+    return 0;
+}
+
+bool part_filter_match(const struct part_filter *f,
+    const struct mtk_partition_header_data *hdr)
+{
+    if (f == NULL)
+        return true;
+
+    if (!vector_empty(f->name_patterns)) {
+        char name[MTK_PART_NAME_LEN + 1] = { 0 };
+        memcpy(name, hdr->part_name, MTK_PART_NAME_LEN);
+
+        bool name_matched = false;
+        for (u32 i = 0; i < vector_size(f->name_patterns); i++) {
+            if (!fnmatch(f->name_patterns[i], name, 0)) {
+                name_matched = true;
+                break;
+            }
+        }
+        if (!name_matched)
+            return false;
+    }
+
+    if (!vector_empty(f->img_types)) {
+        /* Without the extension there's no image type to match */
+        if (hdr->ext.magic != MTK_PART_EXT_MAGIC)
+            return false;
+
+        bool type_matched = false;
+        for (u32 i = 0; i < vector_size(f->img_types); i++) {
+            if (f->img_types[i] == hdr->ext.img_type) {
+                type_matched = true;
+                break;
+            }
+        }
+        if (!type_matched)
+            return false;
+    }
+
+    return true;
+}
+
+void part_filter_destroy(struct part_filter *f)
+{
+    if (f == NULL) return;
+
+    if (f->name_patterns != NULL) {
+        for (u32 i = 0; i < vector_size(f->name_patterns); i++)
+            u_nfree(&f->name_patterns[i]);
+        vector_destroy(&f->name_patterns);
+    }
+    if (f->img_types != NULL)
+        vector_destroy(&f->img_types);
+}
+
+static i32 parse_img_type(const char *str, u32 *o)
+{
+    if (!strncasecmp(str, "IMG_TYPE_", u_strlen("IMG_TYPE_")))
+        str += u_strlen("IMG_TYPE_");
+
+#define X_(name, value)                 \
+    if (!strcasecmp(str, #name)) {      \
+        *o = value;                     \
+        return 0;                       \
+    }
+
+    MTK_PART_EXT_IMG_TYPE_LIST
+#undef X_
+
+    /* Not a known name; maybe a raw numeric value */
+    char *end = NULL;
+    const unsigned long val = strtoul(str, &end, 0);
+    if (str[0] == '\0' || end == NULL || *end != '\0' || val > 0xFFFFFFFFUL)
+        return 1;
+
+    *o = (u32)val;
+    return 0;
+}
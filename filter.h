@@ -0,0 +1,52 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include "mtkparthdr.h"
+#include <core/int.h>
+#include <core/vector.h>
+#include <stdbool.h>
+
+/* Selects which entries of a chain get processed
+ * (`--only` and `--type`).
+ *
+ * An entry is selected when its name matches any of the name patterns
+ * (shell-style globs, see `fnmatch(3)`) AND its image type is any of the
+ * given types. An empty list matches everything. */
+struct part_filter {
+    VECTOR(char *) name_patterns;
+    VECTOR(u32) img_types;
+};
+
+/* Initializes `f` from the comma-separated lists in
+ * `names` (e.g. "md1rom,cert*") and `types` (e.g. "IMG_TYPE_MODEM_LTE,CERT1"
+ * - the `IMG_TYPE_` prefix is optional, and numeric values are accepted too).
+ * Either one can be `NULL`.
+ *
+ * Returns 0 on success and non-zero on failure (e.g. an unknown type). */
+i32 part_filter_init(struct part_filter *f,
+    const char *names, const char *types);
+
+/* Returns whether the entry described by `hdr` is selected by `f`.
+ * A `NULL` filter selects everything. */
+bool part_filter_match(const struct part_filter *f,
+    const struct mtk_partition_header_data *hdr);
+
+void part_filter_destroy(struct part_filter *f);
+
+#endif /* FILTER_H_ */
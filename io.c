@@ -0,0 +1,238 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "io.h"
+#include "stats.h"
+#include <core/int.h>
+#include <core/math.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+
+/* `sendfile()` and `splice()` won't move more than about 2 GiB at once */
+#define IO_COPY_MAX_CHUNK (1ULL << 30)
+
+/* A single `read()`/`write()` can't return more than `SSIZE_MAX`,
+ * which on 32-bit platforms is less than a partition can be */
+#define IO_RW_MAX_CHUNK ((u64)SSIZE_MAX)
+
+static_assert(sizeof(off_t) == sizeof(u64),
+    "off_t must be 64-bit (build with -D_FILE_OFFSET_BITS=64)");
+
+static _Atomic bool g_cache_friendly = ATOMIC_VAR_INIT(false);
+
+static bool cache_hint_wanted(u64 offset, u64 size);
+
+i64 io_pread_full(i32 fd, void *buf, u64 size, u64 offset)
+{
+    u64 end;
+    if (!io_offset_add(offset, size, &end)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    u64 n_read = 0;
+    while (n_read < size) {
+        const u64 left = size - n_read;
+        const ssize_t ret = pread(fd, (u8 *)buf + n_read,
+            u_min(left, IO_RW_MAX_CHUNK), (off_t)(offset + n_read));
+        stats_add(STATS_SYSCALLS, 1);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+        else if (ret < 0)
+            return -1;
+        else if (ret == 0) /* EOF */
+            break;
+
+        n_read += ret;
+    }
+
+    stats_add(STATS_BYTES_READ, n_read);
+    return (i64)n_read;
+}
+
+i64 io_get_size(i32 fd)
+{
+    struct stat st;
+    if (fstat(fd, &st))
+        return -1;
+    stats_add(STATS_SYSCALLS, 1);
+
+    if (S_ISBLK(st.st_mode)) {
+        u64 size = 0;
+        if (ioctl(fd, BLKGETSIZE64, &size))
+            return -1;
+        stats_add(STATS_SYSCALLS, 1);
+        return (i64)u_min(size, IO_OFFSET_MAX);
+    }
+
+    return (i64)st.st_size;
+}
+
+i32 io_write_full(i32 fd, const void *buf, u64 size)
+{
+    u64 n_written = 0;
+    while (n_written < size) {
+        const u64 left = size - n_written;
+        const ssize_t ret = write(fd, (const u8 *)buf + n_written,
+            u_min(left, IO_RW_MAX_CHUNK));
+        stats_add(STATS_SYSCALLS, 1);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+        else if (ret < 0)
+            break;
+
+        n_written += ret;
+    }
+
+    stats_add(STATS_BYTES_WRITTEN, n_written);
+    return n_written == size ? 0 : -1;
+}
+
+i64 io_copy_range(i32 out_fd, i32 in_fd, u64 offset, u64 size,
+    void *buf, u64 buf_size)
+{
+    u64 end;
+    if (!io_offset_add(offset, size, &end)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    struct stat st;
+    const bool out_is_pipe = fstat(out_fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    stats_add(STATS_SYSCALLS, 1);
+
+    u64 n_copied = 0;
+    bool zero_copy = true;
+    while (zero_copy && n_copied < size) {
+        const u64 left = size - n_copied;
+        const size_t chunk = u_min(left, IO_COPY_MAX_CHUNK);
+
+        ssize_t ret;
+        if (out_is_pipe) {
+            loff_t off = offset + n_copied;
+            ret = splice(in_fd, &off, out_fd, NULL, chunk, SPLICE_F_MORE);
+        } else {
+            off_t off = (off_t)(offset + n_copied);
+            ret = sendfile(out_fd, in_fd, &off, chunk);
+        }
+        stats_add(STATS_SYSCALLS, 1);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            /* Not supported for this pair of files */
+            zero_copy = false;
+        } else if (ret < 0) {
+            return -1;
+        } else if (ret == 0) { /* EOF */
+            break;
+        } else {
+            stats_add(STATS_BYTES_READ, ret);
+            stats_add(STATS_BYTES_WRITTEN, ret);
+            n_copied += ret;
+        }
+    }
+
+    if (zero_copy)
+        return (i64)n_copied;
+
+    while (n_copied < size) {
+        const u64 left = size - n_copied;
+        const u64 chunk = u_min(left, buf_size);
+
+        const i64 n_read = io_pread_full(in_fd, buf, chunk, offset + n_copied);
+        if (n_read < 0)
+            return -1;
+        if (io_write_full(out_fd, buf, n_read))
+            return -1;
+
+        n_copied += n_read;
+        if ((u64)n_read != chunk) /* EOF */
+            break;
+    }
+
+    return (i64)n_copied;
+}
+
+void io_cache_friendly_enable(bool enable)
+{
+    atomic_store_explicit(&g_cache_friendly, enable, memory_order_relaxed);
+}
+
+bool io_cache_friendly_enabled(void)
+{
+    return atomic_load_explicit(&g_cache_friendly, memory_order_relaxed);
+}
+
+void io_cache_will_read(i32 fd, u64 offset, u64 size)
+{
+    if (!cache_hint_wanted(offset, size))
+        return;
+
+    (void) posix_fadvise(fd, offset, size, POSIX_FADV_SEQUENTIAL);
+    (void) posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED);
+    stats_add(STATS_SYSCALLS, 2);
+}
+
+void io_cache_done_reading(i32 fd, u64 offset, u64 size)
+{
+    if (!cache_hint_wanted(offset, size))
+        return;
+
+    (void) posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+    stats_add(STATS_SYSCALLS, 1);
+}
+
+void io_cache_start_writeback(i32 fd, u64 offset, u64 size)
+{
+    if (!cache_hint_wanted(offset, size))
+        return;
+
+    (void) sync_file_range(fd, offset, size, SYNC_FILE_RANGE_WRITE);
+    stats_add(STATS_SYSCALLS, 1);
+}
+
+void io_cache_done_writing(i32 fd, u64 offset, u64 size)
+{
+    if (!cache_hint_wanted(offset, size))
+        return;
+
+    /* Dirty pages can't be dropped, so they have to hit the disk first */
+    (void) sync_file_range(fd, offset, size, SYNC_FILE_RANGE_WAIT_BEFORE |
+        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    (void) posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+    stats_add(STATS_SYSCALLS, 2);
+}
+
+static bool cache_hint_wanted(u64 offset, u64 size)
+{
+    /* A range that doesn't fit in an `off_t` would be taken as
+     * a negative offset (or "until the end of the file") */
+    u64 end;
+    return io_cache_friendly_enabled() && size != 0 &&
+        io_offset_add(offset, size, &end);
+}
@@ -0,0 +1,99 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef IO_H_
+#define IO_H_
+
+#include <core/int.h>
+#include <stdbool.h>
+
+/* Small wrappers around the raw I/O syscalls
+ * that handle short reads/writes and `EINTR`,
+ * and account everything in `--stats`. */
+
+/* The largest file offset that the syscalls can take
+ * (`off_t` is signed, and always 64-bit - see the `Makefile`) */
+#define IO_OFFSET_MAX ((u64)INT64_MAX)
+
+/* Stores `offset + n` in `*out` and returns true,
+ * unless the sum would go past `IO_OFFSET_MAX`, in which case
+ * returns false (leaving `*out` alone). All the arithmetic on offsets
+ * that come from the file itself should go through here. */
+static inline bool io_offset_add(u64 offset, u64 n, u64 *out)
+{
+    if (offset > IO_OFFSET_MAX || n > IO_OFFSET_MAX - offset)
+        return false;
+
+    *out = offset + n;
+    return true;
+}
+
+/* Reads up to `size` bytes from `fd` at `offset` into `buf`.
+ * Returns the number of bytes read (which is less than `size`
+ * only if the end of file was reached),
+ * or -1 on failure (with `errno` set accordingly;
+ * `EOVERFLOW` if the range goes past `IO_OFFSET_MAX`). */
+i64 io_pread_full(i32 fd, void *buf, u64 size, u64 offset);
+
+/* Returns the size of the file open in `fd` (which can also be a block
+ * device, like a raw flash dump still on its card), without touching
+ * its file offset, or -1 on failure (with `errno` set accordingly) */
+i64 io_get_size(i32 fd);
+
+/* Writes all `size` bytes from `buf` to `fd`.
+ * Returns 0 on success or -1 on failure (with `errno` set accordingly). */
+i32 io_write_full(i32 fd, const void *buf, u64 size);
+
+/* Copies `size` bytes at `offset` in `in_fd` to `out_fd` (at its current
+ * file offset), without the data passing through user space if possible:
+ * with `splice()` if `out_fd` is a pipe, and `sendfile()` otherwise.
+ * If the kernel can't do that for these two files, the rest is copied
+ * with `pread()`/`write()` through `buf` (of `buf_size` bytes).
+ * Returns the number of bytes copied (which is less than `size`
+ * only if the end of `in_fd` was reached),
+ * or -1 on failure (with `errno` set accordingly;
+ * `EOVERFLOW` if the range goes past `IO_OFFSET_MAX`). */
+i64 io_copy_range(i32 out_fd, i32 in_fd, u64 offset, u64 size,
+    void *buf, u64 buf_size);
+
+/* Page cache hygiene (`--cache-friendly`).
+ *
+ * Bulk extraction streams far more data through the page cache
+ * than anything will ever read again, evicting everyone else's
+ * working set on the way. When enabled, the input ranges are read ahead
+ * and dropped as soon as they've been consumed, and the output ranges
+ * are written back and dropped as soon as they've been written.
+ * When disabled (the default), all of the following are no-ops.
+ * Failures are ignored, as these are only hints. */
+void io_cache_friendly_enable(bool enable);
+bool io_cache_friendly_enabled(void);
+
+/* The `size` bytes at `offset` in `fd` are about to be read sequentially */
+void io_cache_will_read(i32 fd, u64 offset, u64 size);
+
+/* The `size` bytes at `offset` in `fd` have been read
+ * and won't be needed again */
+void io_cache_done_reading(i32 fd, u64 offset, u64 size);
+
+/* Starts the writeback of the `size` bytes at `offset` in `fd`,
+ * without waiting for it */
+void io_cache_start_writeback(i32 fd, u64 offset, u64 size);
+
+/* Waits for the writeback of the `size` bytes at `offset` in `fd`
+ * to complete (starting it if needed) and drops them from the page cache */
+void io_cache_done_writing(i32 fd, u64 offset, u64 size);
+
+#endif /* IO_H_ */
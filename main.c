@@ -14,26 +14,63 @@
  * You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>
 */
+#define _GNU_SOURCE
 #include "arg.h"
 #include "mtkpartdump.h"
+#include "verify.h"
+#include "outdir.h"
+#include "treewalk.h"
+#include "watch.h"
+#include "serve.h"
+#include "diff.h"
+#include "tar.h"
+#include "cat.h"
+#include "stats.h"
+#include "io.h"
+#include "bufpool.h"
 #include <core/log.h>
+#include <core/trace.h>
 #include <core/int.h>
 #include <core/util.h>
 #include <core/vector.h>
+#include <core/threadpool.h>
+#include <core/math.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define MODULE_NAME "main"
 
 static i32 setup_log(void);
+static i32 redirect_stdout_log(void);
 static void print_usage(void);
 static void print_version(void);
+static void write_trace(const char *path);
+static i32 parse_jobs(const char *str, u32 *o_n_jobs);
+static i32 parse_size(const char *str, u64 *o_size);
+static i32 open_tar_output(const char *path, i32 *o_fd);
+
+/* Everything needed to dump a single input file */
+struct dump_ctx {
+    u32 flags;
+    const struct mtkpart_dump_cfg *cfg;
+    struct outdir *outdir;
+};
+static i32 dump_one_file(const struct dump_ctx *ctx, const char *path);
+static i32 dump_watched_file(void *arg, const char *path);
 
 i32 main(i32 argc, char **argv)
 {
     VECTOR(const char *) file_paths = NULL;
     u32 flags = 0;
+    const char *arg_values[ARG_MAX_] = { 0 };
+    struct part_filter filter = { 0 };
+    struct outdir outdir = { .root_fd = -1 };
+    struct threadpool *tp = NULL;
+    struct treewalk treewalk = { 0 };
+    struct tar_writer tar = { .fd = -1 };
 
     if (setup_log()) {
         fprintf(stderr, "Log setup failed. Stop.\n");
@@ -42,7 +79,7 @@ i32 main(i32 argc, char **argv)
 
     s_log_debug("mtkpartdump");
 
-    if (arg_parse(argc, argv, &file_paths, &flags)) {
+    if (arg_parse(argc, argv, &file_paths, &flags, arg_values)) {
         print_usage();
         goto err;
     }
@@ -55,7 +92,9 @@ i32 main(i32 argc, char **argv)
 
     if (exit_early) {
         goto cleanup;
-    } else if (!exit_early && vector_size(file_paths) == 0) {
+    } else if (!exit_early && vector_size(file_paths) == 0 &&
+        !(flags & (ARG_FLAG_WATCH | ARG_FLAG_SERVE)))
+    {
         s_log_error("No files were specified");
         goto err;
     }
@@ -63,33 +102,209 @@ i32 main(i32 argc, char **argv)
     if (flags & ARG_FLAG_VERBOSE)
         s_configure_log_level(S_LOG_DEBUG);
 
-    for (u32 i = 0; i < vector_size(file_paths); i++) {
-        const char *path = file_paths[i];
+    /* The tar stream or the partition body takes over stdout,
+     * so all the logs go to stderr */
+    const bool data_to_stdout = (flags & ARG_FLAG_CAT) ||
+        ((flags & ARG_FLAG_TAR) && !strcmp(arg_values[ARG_OPT_TAR], "-"));
+    if (data_to_stdout && redirect_stdout_log())
+        goto err;
+
+    if (flags & ARG_FLAG_STATS)
+        stats_enable(true);
+
+    if (flags & ARG_FLAG_CACHE_FRIENDLY)
+        io_cache_friendly_enable(true);
+
+    u64 mem_limit = 0;
+    if ((flags & ARG_FLAG_MEM_LIMIT) &&
+        parse_size(arg_values[ARG_OPT_MEM_LIMIT], &mem_limit))
+    {
+        s_log_error("Invalid memory limit: \"%s\"",
+            arg_values[ARG_OPT_MEM_LIMIT]);
+        goto err;
+    }
+    if (bufpool_init(mem_limit, flags & ARG_FLAG_HUGE_PAGES))
+        goto err;
+
+    if (flags & ARG_FLAG_TRACE_OUT)
+        trace_enable();
+
+    const bool use_filter = flags & (ARG_FLAG_ONLY | ARG_FLAG_TYPE);
+    if (use_filter && part_filter_init(&filter,
+            arg_values[ARG_OPT_ONLY], arg_values[ARG_OPT_TYPE]))
+    {
+        s_log_error("Invalid partition filter");
+        goto err;
+    }
+
+    if (flags & (ARG_FLAG_VERIFY | ARG_FLAG_RECURSIVE | ARG_FLAG_SERVE |
+        ARG_FLAG_DIFF | ARG_FLAG_RECURSE_PAYLOADS))
+    {
+        u32 n_jobs = 0;
+        if (parse_jobs(arg_values[ARG_OPT_JOBS], &n_jobs)) {
+            s_log_error("Invalid number of jobs: \"%s\"",
+                arg_values[ARG_OPT_JOBS]);
+            goto err;
+        }
+
+        /* The main thread works too while it waits for the results,
+         * except in `--serve` mode, where it's busy with the event loop */
+        const u32 n_workers = (flags & ARG_FLAG_SERVE) ? n_jobs : n_jobs - 1;
+        tp = threadpool_create(n_workers,
+            (flags & ARG_FLAG_PIN_THREADS) ? THREADPOOL_FLAG_PIN_CPUS : 0);
+        if (tp == NULL) {
+            s_log_error("Failed to create the thread pool");
+            goto err;
+        }
+    }
+
+    if ((flags & ARG_FLAG_RECURSIVE) &&
+        treewalk_expand(&treewalk, tp, &file_paths))
+    {
+        s_log_error("Failed to walk the input directories");
+        goto err;
+    }
+
+    if (flags & ARG_FLAG_SERVE) {
+        if (serve_run(arg_values[ARG_OPT_SERVE], tp))
+            goto err;
+        if (flags & ARG_FLAG_STATS)
+            stats_print_summary("all requests", NULL);
+        goto cleanup;
+    }
+
+    if (flags & ARG_FLAG_DIFF) {
+        if (vector_size(file_paths) != 2) {
+            s_log_error("--diff takes exactly two files (OLD and NEW)");
+            goto err;
+        }
+
+        const i32 n_diffs = diff_files(file_paths[0], file_paths[1], tp,
+            flags & ARG_FLAG_ANALYZE);
+        if (flags & ARG_FLAG_STATS)
+            stats_print_summary("all files", NULL);
+
+        /* Like diff(1), fail if there are any differences */
+        if (n_diffs != 0)
+            goto err;
+        goto cleanup;
+    }
 
-        FILE *fp = fopen(path, "rb");
-        if (fp == NULL) {
-            s_log_error("Failed to open \"%s\": %s", path, strerror(errno));
+    if (flags & ARG_FLAG_CAT) {
+        if (vector_size(file_paths) != 1) {
+            s_log_error("--cat takes exactly one file");
             goto err;
         }
-        s_log_verbose("Processing file \"%s\"...", path);
 
-        mtkpart_dump_file(fp, flags);
+        if (cat_part(file_paths[0], arg_values[ARG_OPT_CAT], STDOUT_FILENO))
+            goto err;
+        if (flags & ARG_FLAG_STATS)
+            stats_print_summary("all files", NULL);
+        goto cleanup;
+    }
+
+    if (flags & ARG_FLAG_VERIFY) {
+        const u32 n_failed = verify_files(file_paths, tp);
+        if (flags & ARG_FLAG_STATS)
+            stats_print_summary("all files", NULL);
 
-        s_log_verbose("Done processing \"%s\"", path);
-        if (fclose(fp)) {
-            s_log_error("Failed to close \"%s\": %s", path, strerror(errno));
+        if (n_failed > 0) {
+            s_log_error("%u of %llu files failed verification",
+                n_failed, (unsigned long long)vector_size(file_paths));
             goto err;
         }
+        goto cleanup;
+    }
+
+    if ((flags & ARG_FLAG_OUTDIR) &&
+        outdir_init(&outdir, arg_values[ARG_OPT_OUTDIR]))
+    {
+        goto err;
+    }
+
+    if (flags & ARG_FLAG_TAR) {
+        if (flags & ARG_FLAG_OUTDIR) {
+            s_log_error("--tar and --outdir can't be used together");
+            goto err;
+        }
+
+        i32 tar_fd = -1;
+        if (open_tar_output(arg_values[ARG_OPT_TAR], &tar_fd) ||
+            tar_writer_init(&tar, tar_fd))
+        {
+            goto err;
+        }
+
+        /* Without `-e` or `-s`, there would be nothing to put in it */
+        if (!(flags & (ARG_FLAG_EXTRACT_PART | ARG_FLAG_SAVE_HDR)))
+            flags |= ARG_FLAG_EXTRACT_PART;
     }
 
+    /* There's nothing to pick up again after a single header */
+    if (flags & ARG_FLAG_RESYNC)
+        flags |= ARG_FLAG_CHAIN;
+
+    const struct mtkpart_dump_cfg dump_cfg = {
+        .flags = flags,
+        .filter = use_filter ? &filter : NULL,
+        .tp = tp,
+        .tar = (flags & ARG_FLAG_TAR) ? &tar : NULL,
+    };
+
+    struct dump_ctx dump_ctx = {
+        .flags = flags,
+        .cfg = &dump_cfg,
+        .outdir = &outdir,
+    };
+
+    for (u32 i = 0; i < vector_size(file_paths); i++) {
+        if (dump_one_file(&dump_ctx, file_paths[i]))
+            goto err;
+    }
+
+    if (flags & ARG_FLAG_WATCH) {
+        if (watch_dir(arg_values[ARG_OPT_WATCH], dump_watched_file, &dump_ctx))
+            goto err;
+    }
+
+    if (flags & ARG_FLAG_TAR) {
+        if (tar_writer_finish(&tar))
+            goto err;
+
+        const i32 tar_fd = tar.fd;
+        tar.fd = -1;
+        if (tar_fd != STDOUT_FILENO && close(tar_fd)) {
+            s_log_error("Failed to close the tar output: %s", strerror(errno));
+            goto err;
+        }
+    }
+
+    if (flags & ARG_FLAG_STATS)
+        stats_print_summary("all files", NULL);
+
 cleanup:
     if (file_paths != NULL) vector_destroy(&file_paths);
+    part_filter_destroy(&filter);
+    outdir_destroy(&outdir);
+    bufpool_destroy();
+    treewalk_destroy(&treewalk);
+    threadpool_destroy(&tp);
+    if (flags & ARG_FLAG_TRACE_OUT)
+        write_trace(arg_values[ARG_OPT_TRACE_OUT]);
     s_log_verbose("Exiting with code EXIT_SUCCESS");
     s_log_cleanup_all();
     return EXIT_SUCCESS;
 
 err:
     if (file_paths != NULL) vector_destroy(&file_paths);
+    part_filter_destroy(&filter);
+    outdir_destroy(&outdir);
+    bufpool_destroy();
+    treewalk_destroy(&treewalk);
+    threadpool_destroy(&tp);
+    if (tar.fd >= 0 && tar.fd != STDOUT_FILENO) (void) close(tar.fd);
+    if (flags & ARG_FLAG_TRACE_OUT)
+        write_trace(arg_values[ARG_OPT_TRACE_OUT]);
     s_log_error("Exiting with code EXIT_FAILURE");
     s_log_cleanup_all();
     return EXIT_FAILURE;
@@ -118,6 +333,22 @@ static i32 setup_log(void) {
     return 0;
 }
 
+static i32 redirect_stdout_log(void)
+{
+    const struct s_log_output_cfg cfg = {
+        .type = S_LOG_OUTPUT_FILE,
+        .out.file = stderr,
+        .flags = S_LOG_CONFIG_FLAG_COPY
+    };
+
+    if (s_configure_log_outputs(S_LOG_STDOUT_MASKS, &cfg)) {
+        fprintf(stderr, "Failed to redirect the stdout log outputs\n");
+        return 1;
+    }
+
+    return 0;
+}
+
 static void print_usage(void)
 {
     s_log_info("Usage: mtkpartdump [OPTIONS...] <FILE1> [FILE2 FILE3 ...]");
@@ -139,3 +370,143 @@ static void print_version(void)
     s_log_info("License GPLv3+: GNU GPL version 3 or later "
         "<https://gnu.org/licenses/gpl.html>");
 }
+
+static void write_trace(const char *path)
+{
+    s_log_verbose("Writing the trace to \"%s\"...", path);
+    if (trace_write_json(path))
+        s_log_error("Failed to write the trace to \"%s\"", path);
+}
+
+static i32 parse_jobs(const char *str, u32 *o_n_jobs)
+{
+    /* Not given or 0 - use one thread per online CPU */
+    if (str == NULL || !strcmp(str, "0")) {
+        const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        *o_n_jobs = n_cpus > 0 ?
+            u_min((u32)n_cpus, THREADPOOL_MAX_WORKERS) : 1;
+        return 0;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    const unsigned long val = strtoul(str, &end, 10);
+    if (errno || end == str || *end != '\0' ||
+        val == 0 || val > THREADPOOL_MAX_WORKERS)
+        return 1;
+
+    *o_n_jobs = val;
+    return 0;
+}
+
+static i32 parse_size(const char *str, u64 *o_size)
+{
+    char *end = NULL;
+    errno = 0;
+    const unsigned long long val = strtoull(str, &end, 10);
+    if (errno || end == str || str[0] == '-')
+        return 1;
+
+    u32 shift = 0;
+    switch (*end) {
+        case '\0': break;
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        default: return 1;
+    }
+    if (*end != '\0' || val > (UINT64_MAX >> shift))
+        return 1;
+
+    *o_size = (u64)val << shift;
+    return 0;
+}
+
+static i32 dump_one_file(const struct dump_ctx *ctx, const char *path)
+{
+    struct stats_snapshot file_stats_start = { 0 };
+    stats_snapshot(&file_stats_start);
+
+    const u64 open_start = stats_phase_begin();
+    const i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+    stats_phase_end(STATS_PHASE_FILE_OPEN, open_start);
+    stats_add(STATS_SYSCALLS, 1);
+    if (fd < 0) {
+        s_log_error("Failed to open \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+    s_log_verbose("Processing file \"%s\"...", path);
+
+    i32 out_dirfd = AT_FDCWD;
+    if (ctx->flags & ARG_FLAG_OUTDIR) {
+        out_dirfd = outdir_open_subdir(ctx->outdir, path);
+        if (out_dirfd < 0) {
+            (void) close(fd);
+            return 1;
+        }
+    }
+
+    /* Every input file gets its own directory in the tar stream,
+     * just like with `--outdir` */
+    if (ctx->cfg->tar != NULL) {
+        const char *base_name = strrchr(path, '/');
+        base_name = base_name != NULL ? base_name + 1 : path;
+        if (tar_set_dir(ctx->cfg->tar, base_name)) {
+            (void) close(fd);
+            return 1;
+        }
+    }
+
+    trace_begin("file", "file", path);
+    mtkpart_dump_file(fd, out_dirfd, ctx->cfg);
+    trace_end("file", "file");
+
+    if (out_dirfd != AT_FDCWD)
+        (void) close(out_dirfd);
+
+    s_log_verbose("Done processing \"%s\"", path);
+    const u64 close_start = stats_phase_begin();
+    const i32 ret = close(fd);
+    stats_phase_end(STATS_PHASE_FILE_CLOSE, close_start);
+    stats_add(STATS_SYSCALLS, 1);
+    stats_add(STATS_FILES_PROCESSED, 1);
+    if (ret) {
+        s_log_error("Failed to close \"%s\": %s", path, strerror(errno));
+        return 1;
+    }
+
+    /* With `-v`, also print the statistics of every single file */
+    if ((ctx->flags & ARG_FLAG_STATS) && (ctx->flags & ARG_FLAG_VERBOSE))
+        stats_print_summary(path, &file_stats_start);
+
+    return 0;
+}
+
+static i32 dump_watched_file(void *arg, const char *path)
+{
+    return dump_one_file(arg, path);
+}
+
+static i32 open_tar_output(const char *path, i32 *o_fd)
+{
+    if (!strcmp(path, "-")) {
+        /* Like tar(1), don't spew binary data onto a terminal */
+        if (isatty(STDOUT_FILENO)) {
+            s_log_error("Refusing to write a tar stream to a terminal");
+            return 1;
+        }
+        *o_fd = STDOUT_FILENO;
+        return 0;
+    }
+
+    *o_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    stats_add(STATS_SYSCALLS, 1);
+    if (*o_fd < 0) {
+        s_log_error("Failed to open \"%s\" for writing: %s",
+            path, strerror(errno));
+        return 1;
+    }
+    stats_add(STATS_FILES_CREATED, 1);
+
+    return 0;
+}
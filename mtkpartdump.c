@@ -14,18 +14,28 @@
  * You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>
 */
+#define _GNU_SOURCE
 #include "mtkpartdump.h"
 #include "mtkparthdr.h"
+#include "byteorder.h"
 #include "arg.h"
+#include "stats.h"
+#include "io.h"
+#include "payload.h"
+#include "resync.h"
 #include <core/log.h>
+#include <core/trace.h>
 #include <core/util.h>
 #include <core/math.h>
+#include <core/vector.h>
 #include <assert.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #define MODULE_NAME "mtkpartdump"
 
@@ -36,26 +46,47 @@ static void print_part_header(const struct mtk_partition_header_data *hdr,
     u32 hdr_index);
 static void print_ext_part_header(const struct mtk_part_header_extension *ext);
 
-static i32 do_save_header(union mtk_partition_header *hdr, u32 hdr_index);
-static i32 do_extract_part(FILE *in_fp, size_t n_bytes, const char *out_path);
-
-static u32 get_aligned_part_size(const struct mtk_partition_header_data *hdr);
-static u64 get_full_part_size(const struct mtk_partition_header_data *hdr);
-static u64 get_full_aligned_part_size(
-    const struct mtk_partition_header_data *hdr
-);
-static void * get_full_memory_address(
+static i32 do_save_header(i32 out_dirfd, struct tar_writer *tar,
+    const union mtk_partition_header *raw_hdr, const char *part_name,
+    u32 hdr_index);
+static i32 do_extract_part(i32 in_fd, u64 offset, u64 n_bytes,
+    i32 out_dirfd, const char *out_name, u8 buf[MTKPART_EXTRACT_BUF_SIZE],
+    struct part_analysis *analysis);
+static i32 do_extract_part_to_tar(i32 in_fd, u64 offset, u64 n_bytes,
+    struct tar_writer *tar, const char *out_name,
+    u8 buf[MTKPART_EXTRACT_BUF_SIZE], struct part_analysis *analysis);
+static i32 do_analyze_part(i32 in_fd, u64 offset, u64 n_bytes,
+    u8 buf[MTKPART_EXTRACT_BUF_SIZE], struct part_analysis *analysis);
+
+static u64 get_full_memory_address(
     const struct mtk_partition_header_data *hdr
 );
-static const char *get_img_type_string(u32 img_type);
 
-static char * get_out_filename_from_part_name(
+/* The `--resync` state of one walk */
+struct resync_state {
+    bool enabled;
+    u64 file_size;
+
+    u32 n_gaps;
+    u64 n_bytes_skipped;
+};
+static bool resync_chain(struct resync_state *rs, i32 fd, u64 gap_start,
+    u64 scan_from, enum mtk_part_byte_order order, u8 **buf, u64 *o_offset);
+
+/* "<part name>.extracted_0xffffffff.bin" + '\0' */
+#define OUT_FILENAME_BUF_SIZE (MTK_PART_NAME_LEN + 32)
+static void get_out_filename_from_part_name(
+    char o_buf[OUT_FILENAME_BUF_SIZE],
     const char part_name[MTK_PART_NAME_LEN],
     bool is_header, u32 index
 );
+static i32 open_out_file(i32 out_dirfd, const char *name);
+static i32 close_out_file(i32 fd, const char *name);
 
-void mtkpart_dump_file(FILE *fp, u32 flags)
+void mtkpart_dump_file(i32 fd, i32 out_dirfd,
+    const struct mtkpart_dump_cfg *cfg)
 {
+    const u32 flags = cfg->flags;
     bool chain = flags & ARG_FLAG_CHAIN;
 
     s_log_debug("chain: %d, save: %d, extract: %d",
@@ -66,81 +97,313 @@ void mtkpart_dump_file(FILE *fp, u32 flags)
 
     u32 index = 0;
 
-    union mtk_partition_header hdr = { 0 };
+    /* The chain is walked with positional reads (exactly one 512-byte
+     * `pread()` per header), so skipping over a partition's contents
+     * is just a matter of advancing `offset` - no seeks,
+     * and no stdio read-ahead around every header. */
+    u64 offset = 0;
+
+    /* `raw` is the header exactly as stored in the file
+     * (that's what gets saved with `-s`), `hdr` is `raw` in host byte order */
+    union mtk_partition_header raw = { 0 };
+    struct mtk_partition_header_data hdr = { 0 };
+    enum mtk_part_byte_order order = MTK_PART_BYTE_ORDER_UNKNOWN;
+    mtk_part_header_parser_t parse_header = NULL;
+
+    /* The copy buffer for extraction is borrowed once per file,
+     * and only when it's first needed */
+    u8 *extract_buf = NULL;
+
+    /* The entries whose bodies get scanned for nested payloads
+     * once the whole chain has been dumped */
+    const bool recurse = flags & ARG_FLAG_RECURSE_PAYLOADS;
+    VECTOR(struct payload_root) payload_roots = NULL;
+    if (recurse)
+        payload_roots = vector_new(struct payload_root);
+
+    /* With `--resync`, a broken chain is picked up again
+     * at the next valid header, instead of ending the walk */
+    struct resync_state rs = { .enabled = flags & ARG_FLAG_RESYNC };
+    if (rs.enabled) {
+        const i64 file_size = io_get_size(fd);
+        if (file_size < 0) {
+            s_log_error("Failed to get the size of the file: %s. "
+                "Resyncing won't be possible", strerror(errno));
+            rs.enabled = false;
+        } else {
+            rs.file_size = file_size;
+        }
+    }
+
     do {
         s_log_verbose("Processing header no. %u...", index);
-
-        i32 ret = fread(&hdr.buf_, 1, MTK_PART_HEADER_SIZE, fp);
-        if (ret != MTK_PART_HEADER_SIZE && ferror(fp)) {
-            s_log_error("Failed to fread() the header intro: %s",
-                strerror(errno));
-            return;
-        } else if (ret != MTK_PART_HEADER_SIZE && feof(fp)) {
-            s_log_error("File is too small (end of file reached)");
-            return;
+        trace_begin("header", "header", NULL);
+        const u64 hdr_offset = offset;
+
+        const u64 hdr_read_start = stats_phase_begin();
+        const i64 ret = io_pread_full(fd, raw.buf_, MTK_PART_HEADER_SIZE, offset);
+        stats_phase_end(STATS_PHASE_HDR_READ, hdr_read_start);
+        if (ret < 0) {
+            s_log_error("Failed to read the header at offset %#llx: %s",
+                (unsigned long long)offset, strerror(errno));
+            trace_end("header", "header");
+            if (resync_chain(&rs, fd, hdr_offset,
+                    hdr_offset + MTK_PART_HEADER_SIZE, order,
+                    &extract_buf, &offset))
+            {
+                continue;
+            }
+            goto chain_end;
         } else if (ret != MTK_PART_HEADER_SIZE) {
-            s_log_error("Read an incorrect number of bytes from the input file "
-                "(read: %#x, expected: %#x)", ret, MTK_PART_HEADER_SIZE);
-            return;
+            s_log_error("File is too small (end of file reached)");
+            trace_end("header", "header");
+            goto chain_end;
+        }
+        offset += MTK_PART_HEADER_SIZE;
+
+        /* The byte order is detected from the first header,
+         * and all the others in the chain must use the same one */
+        if (parse_header == NULL) {
+            order = mtk_part_detect_byte_order(&raw);
+            if (order == MTK_PART_BYTE_ORDER_UNKNOWN) {
+                s_log_error("Invalid magic: 0x%.8x (expected: 0x%.8x)",
+                    raw.data.magic, MTK_PART_MAGIC);
+                trace_end("header", "header");
+                if (resync_chain(&rs, fd, hdr_offset, hdr_offset + 1, order,
+                        &extract_buf, &offset))
+                {
+                    continue;
+                }
+                goto chain_end;
+            }
+            s_log_verbose("Byte order: %s", mtk_part_byte_order_string(order));
+            parse_header = mtk_part_get_header_parser(order);
         }
 
-        if (hdr.data.magic != MTK_PART_MAGIC) {
+        parse_header(&hdr, &raw);
+        if (hdr.magic != MTK_PART_MAGIC) {
             s_log_error("Invalid magic: 0x%.8x (expected: 0x%.8x)",
-                hdr.data.magic, MTK_PART_MAGIC);
-            return;
+                hdr.magic, MTK_PART_MAGIC);
+            trace_end("header", "header");
+            if (resync_chain(&rs, fd, hdr_offset, hdr_offset + 1, order,
+                    &extract_buf, &offset))
+            {
+                continue;
+            }
+            goto chain_end;
+        }
+        stats_add(STATS_HEADERS, 1);
+
+        const bool selected = part_filter_match(cfg->filter, &hdr);
+        if (selected) {
+            const u64 print_start = stats_phase_begin();
+            print_part_header(&hdr, index);
+            stats_phase_end(STATS_PHASE_PARSE_PRINT, print_start);
+        } else {
+            s_log_verbose("Skipping \"%.32s\" (not selected)",
+                hdr.part_name);
         }
 
-        print_part_header(&hdr.data, index);
-
-        if (flags & ARG_FLAG_SAVE_HDR) {
-            if (do_save_header(&hdr, index)) {
+        if (selected && (flags & ARG_FLAG_SAVE_HDR)) {
+            if (do_save_header(out_dirfd, cfg->tar, &raw, hdr.part_name,
+                    index))
+            {
                 s_log_error("Failed to save the partition header!");
                 /* A failure here doesn't really impact anything
                  * further down the line */
             }
         }
 
-        const u64 full_part_size = get_full_aligned_part_size(&hdr.data);
-        if (flags & ARG_FLAG_EXTRACT_PART) {
-
-            char *out_path = get_out_filename_from_part_name(
-                hdr.data.part_name, false, index
-            );
+        if (selected && recurse) {
+            const struct payload_root root = {
+                .index = index,
+                .hdr_offset = offset - MTK_PART_HEADER_SIZE,
+                .hdr = hdr,
+            };
+            vector_push_back(&payload_roots, root);
+        }
 
-            i32 ret = do_extract_part(fp, full_part_size, out_path);
+        /* A corrupted `part_size_hi` easily puts the next header
+         * somewhere no file can reach, and must not wrap around */
+        const u64 full_part_size = get_full_aligned_part_size(&hdr);
+        u64 next_offset;
+        if (!io_offset_add(offset, full_part_size, &next_offset)) {
+            s_log_error("The contents of \"%.32s\" (%#llx bytes at %#llx) "
+                "go past the largest possible file offset. %s",
+                hdr.part_name, (unsigned long long)full_part_size,
+                (unsigned long long)offset, rs.enabled ? "Resyncing..." :
+                    "Terminating chain unconditionally!");
+            trace_end("header", "header");
+            if (resync_chain(&rs, fd, hdr_offset, hdr_offset + 1, order,
+                    &extract_buf, &offset))
+            {
+                continue;
+            }
+            goto chain_end;
+        }
 
-            u_nfree(&out_path);
+        /* Whether the chain can't be followed past this entry */
+        bool broken = false;
+
+        const bool extract = selected && (flags & ARG_FLAG_EXTRACT_PART);
+        const bool analyze = selected && (flags & ARG_FLAG_ANALYZE);
+        if (extract || analyze) {
+            if (extract_buf == NULL)
+                extract_buf = bufpool_get();
+
+            /* The analysis rides along with the extraction if there is one,
+             * so that the body is only read once */
+            struct part_analysis analysis;
+            if (analyze)
+                part_analysis_init(&analysis, get_full_part_size(&hdr));
+
+            i32 ret = 1;
+            if (extract_buf == NULL) {
+                s_log_error("Failed to get a copy buffer");
+            } else if (extract && cfg->tar != NULL) {
+                char out_name[OUT_FILENAME_BUF_SIZE];
+                get_out_filename_from_part_name(out_name, hdr.part_name,
+                    false, index);
+                ret = do_extract_part_to_tar(fd, offset, full_part_size,
+                    cfg->tar, out_name, extract_buf,
+                    analyze ? &analysis : NULL);
+            } else if (extract) {
+                ret = mtkpart_extract_part(fd, offset - MTK_PART_HEADER_SIZE,
+                    &hdr, index, out_dirfd, extract_buf,
+                    analyze ? &analysis : NULL);
+            } else {
+                ret = do_analyze_part(fd, offset, full_part_size,
+                    extract_buf, &analysis);
+            }
 
             if (ret) {
-                s_log_error("Failed to extract the partition contents "
-                    "from \"%.32s\". Terminating chain uncoditionally!",
-                    hdr.data.part_name);
-                chain = false;
+                s_log_error("Failed to %s the partition contents "
+                    "from \"%.32s\". %s", extract ? "extract" : "read",
+                    hdr.part_name, rs.enabled ? "Resyncing..." :
+                        "Terminating chain uncoditionally!");
+                broken = true;
+            } else if (analyze) {
+                part_analysis_finish(&analysis);
+                part_analysis_report(&analysis);
             }
 
-        /* If we aren't extracting the content of the partition,
-         * just advance past it */
-        } else if (chain && fseek(fp, full_part_size, SEEK_CUR)) {
-            s_log_error("Failed to seek to the next header in the chain "
-                "(%llu bytes forward): %s. "
-                "Terminating chain uncoditionally!",
-                full_part_size, strerror(errno)
-            );
-            chain = false;
-        }
+            if (analyze)
+                part_analysis_destroy(&analysis);
 
-        if (chain && hdr.data.ext.magic != MTK_PART_EXT_MAGIC) {
-            s_log_verbose("ext magic mismatch: 0x%.8x (expected 0x%.8x); "
-                "terminating chain uncoditionally",
-                hdr.data.ext.magic, MTK_PART_EXT_MAGIC);
-            chain = false;
-        } else if (chain && hdr.data.ext.is_image_list_end) {
+        /* If we aren't extracting or analyzing the content of the partition,
+         * just advance past it without reading anything */
+        } else {
+            stats_add(STATS_BYTES_SKIPPED, full_part_size);
+        }
+        offset = next_offset;
+
+        if (chain && !broken && hdr.ext.magic != MTK_PART_EXT_MAGIC) {
+            s_log_verbose("ext magic mismatch: 0x%.8x (expected 0x%.8x); %s",
+                hdr.ext.magic, MTK_PART_EXT_MAGIC, rs.enabled ? "resyncing" :
+                    "terminating chain uncoditionally");
+            broken = true;
+        } else if (chain && !broken && hdr.ext.is_image_list_end) {
             s_log_verbose("End of chain reached");
             chain = false;
         }
 
+        trace_end("header", "header");
         index++;
+
+        if (broken) {
+            /* The next header should still be right after the body,
+             * unless the body's size is bogus */
+            const u64 from = next_offset < rs.file_size ?
+                next_offset : hdr_offset + MTK_PART_HEADER_SIZE;
+            chain = resync_chain(&rs, fd, from, from, order,
+                &extract_buf, &offset);
+        }
     } while (chain);
+
+chain_end:
+    if (rs.n_gaps > 0) {
+        s_log_warn("Gaps in the chain: %u (%llu bytes skipped in total)",
+            rs.n_gaps, (unsigned long long)rs.n_bytes_skipped);
+    }
+
+    /* The payload scan tasks need buffers of their own */
+    bufpool_put(extract_buf);
+    extract_buf = NULL;
+
+    if (recurse) {
+        s_assert(cfg->tp != NULL, "No thread pool for the payload scan");
+        /* Any failures have already been logged. Nested entries are
+         * extracted by parallel tasks, which can't share the tar stream. */
+        (void) payload_scan(fd, payload_roots, vector_size(payload_roots),
+            cfg->tp, out_dirfd,
+            (flags & ARG_FLAG_EXTRACT_PART) && cfg->tar == NULL);
+        vector_destroy(&payload_roots);
+    }
+}
+
+static bool resync_chain(struct resync_state *rs, i32 fd, u64 gap_start,
+    u64 scan_from, enum mtk_part_byte_order order, u8 **buf, u64 *o_offset)
+{
+    if (!rs->enabled)
+        return false;
+
+    /* The copy buffer isn't in use between entries */
+    if (*buf == NULL)
+        *buf = bufpool_get();
+    if (*buf == NULL) {
+        s_log_error("Failed to get a buffer to resync with");
+        return false;
+    }
+
+    trace_begin("header", "resync", NULL);
+    const u64 found = resync_find_header(fd, scan_from, rs->file_size, order,
+        *buf, MTKPART_EXTRACT_BUF_SIZE);
+    trace_end("header", "resync");
+
+    const u64 gap = found > gap_start ? found - gap_start : 0;
+    if (gap > 0) {
+        rs->n_gaps++;
+        rs->n_bytes_skipped += gap;
+        stats_add(STATS_BYTES_RESYNCED, gap);
+    }
+
+    if (found >= rs->file_size) {
+        if (gap > 0) {
+            s_log_warn("No valid header found in the last %llu bytes "
+                "of the file (%#llx - %#llx)", (unsigned long long)gap,
+                (unsigned long long)gap_start, (unsigned long long)found);
+        }
+        return false;
+    }
+
+    if (gap > 0) {
+        s_log_warn("Skipped %llu bytes (%#llx - %#llx); "
+            "resuming at the header at %#llx", (unsigned long long)gap,
+            (unsigned long long)gap_start, (unsigned long long)found,
+            (unsigned long long)found);
+    } else {
+        s_log_warn("Resuming at the header at %#llx",
+            (unsigned long long)found);
+    }
+
+    *o_offset = found;
+    return true;
+}
+
+i32 mtkpart_extract_part(i32 in_fd, u64 hdr_offset,
+    const struct mtk_partition_header_data *hdr, u32 index,
+    i32 out_dirfd, u8 buf[MTKPART_EXTRACT_BUF_SIZE],
+    struct part_analysis *analysis)
+{
+    char out_name[OUT_FILENAME_BUF_SIZE];
+    get_out_filename_from_part_name(out_name, hdr->part_name, false, index);
+
+    trace_begin("extract", "extract", out_name);
+    const i32 ret = do_extract_part(in_fd, hdr_offset + MTK_PART_HEADER_SIZE,
+        get_full_aligned_part_size(hdr), out_dirfd, out_name, buf, analysis);
+    trace_end("extract", "extract");
+
+    return ret;
 }
 
 #define log_magic(prepend_str, magic) s_log_info(                   \
@@ -158,23 +421,25 @@ static void print_part_header(const struct mtk_partition_header_data *hdr,
     s_configure_log_line(S_LOG_VERBOSE, "%s\n", &old_line_verbose);
     s_configure_log_line(S_LOG_INFO, "%s\n", &old_line_info);
 
-    char *hdr_name =
-        get_out_filename_from_part_name(hdr->part_name, true, hdr_index);
+    char hdr_name[OUT_FILENAME_BUF_SIZE];
+    get_out_filename_from_part_name(hdr_name,
+        hdr->part_name, true, hdr_index);
 
     s_log_verbose("===== Begin Mediatek partition header dump =====");
     s_log_info("union mtk_partition_header %s = {", hdr_name);
     s_log_info("    .data = {");
     log_magic ("        .magic = ", hdr->magic);
     s_log_info("        .part_size = %#x, "
-        "// aligned: %#x, full: %#x, aligned full: %#x",
+        "// aligned: %#x, full: %#llx, aligned full: %#llx",
         hdr->part_size,
         get_aligned_part_size(hdr),
-        get_full_part_size(hdr),
-        get_full_aligned_part_size(hdr)
+        (unsigned long long)get_full_part_size(hdr),
+        (unsigned long long)get_full_aligned_part_size(hdr)
     );
     s_log_info("        .part_name = \"%.32s\",", hdr->part_name);
-    s_log_info("        .memory_address = %p, // full: %p",
-        hdr->memory_address, get_full_memory_address(hdr));
+    s_log_info("        .memory_address = %#x, // full: %#llx",
+        hdr->memory_address,
+        (unsigned long long)get_full_memory_address(hdr));
     s_log_info("        .memory_address_mode = %#x,", hdr->memory_address_mode);
     s_log_info("        .ext = {");
     print_ext_part_header(&hdr->ext);
@@ -183,7 +448,6 @@ static void print_part_header(const struct mtk_partition_header_data *hdr,
     s_log_info("};");
     s_log_verbose("=====  End Mediatek partition header dump  =====");
 
-    u_nfree(&hdr_name);
 
     s_configure_log_line(S_LOG_VERBOSE, old_line_verbose, NULL);
     s_configure_log_line(S_LOG_INFO, old_line_info, NULL);
@@ -205,7 +469,7 @@ static void print_ext_part_header(const struct mtk_part_header_extension *ext)
     s_log_info("            .hdr_size = %#x,", ext->hdr_size);
     s_log_info("            .hdr_version = %#x,", ext->hdr_version);
     s_log_info("            .img_type = %#x, // (%s)", ext->img_type,
-            get_img_type_string(ext->img_type));
+            mtkpart_img_type_string(ext->img_type));
     s_log_info("            .is_image_list_end = %#x,",
             ext->is_image_list_end);
     s_log_info("            .size_alignment_bytes = %#x,",
@@ -218,53 +482,19 @@ static void print_ext_part_header(const struct mtk_part_header_extension *ext)
     s_configure_log_line(S_LOG_INFO, old_line_info, NULL);
 }
 
-static u32 get_aligned_part_size(const struct mtk_partition_header_data *hdr)
-{
-    if (hdr->ext.magic == MTK_PART_EXT_MAGIC &&
-        hdr->ext.size_alignment_bytes != 0)
-    {
-        /* Round up to the next multiple of `align` */
-        const u32 size = hdr->part_size;
-        const u32 align = hdr->ext.size_alignment_bytes;
-        return ((size + align - 1) / align) * align;
-    } else {
-        return hdr->part_size;
-    }
-}
-
-static u64 get_full_part_size(const struct mtk_partition_header_data *hdr)
-{
-    if (hdr->ext.magic == MTK_PART_EXT_MAGIC) {
-        const u64 high = (u64)hdr->ext.part_size_hi << 32;
-        return high | hdr->part_size;
-    } else {
-        return (u64)hdr->part_size;
-    }
-}
-
-static u64 get_full_aligned_part_size(
-    const struct mtk_partition_header_data *hdr
-)
-{
-    const u32 low = get_aligned_part_size(hdr);
-    const u64 high = get_full_part_size(hdr) & 0xFFFFFFFF00000000ULL;
-
-    return high | low;
-}
-
-static void * get_full_memory_address(
+static u64 get_full_memory_address(
     const struct mtk_partition_header_data *hdr
 )
 {
     if (hdr->ext.magic == MTK_PART_EXT_MAGIC) {
         const u64 high = (u64)hdr->ext.memory_address_hi << 32;
-        return (void *)(high | hdr->memory_address);
+        return high | hdr->memory_address;
     } else {
-        return (void *)((u64)hdr->memory_address);
+        return (u64)hdr->memory_address;
     }
 }
 
-static const char *get_img_type_string(u32 img_type)
+const char * mtkpart_img_type_string(u32 img_type)
 {
     switch (img_type) {
 #define X_(name, value)                 \
@@ -278,146 +508,245 @@ static const char *get_img_type_string(u32 img_type)
     }
 }
 
-static char * get_out_filename_from_part_name(
+static void get_out_filename_from_part_name(
+    char o_buf[OUT_FILENAME_BUF_SIZE],
     const char part_name[MTK_PART_NAME_LEN],
     bool is_header, u32 index
 )
 {
-    i32 size = snprintf(NULL, 0, "%.32s.%s_0x%x.bin",
+    i32 ret = snprintf(o_buf, OUT_FILENAME_BUF_SIZE, "%.32s.%s_0x%x.bin",
         part_name,
         is_header ? "header" : "extracted",
         index
     );
-    s_assert(size >= 0, "snprintf failed!");
-
-    char *buf = malloc(size + 1 /* For the '\0' terminator */);
-    s_assert(buf != NULL, "malloc failed for new filename buffer");
+    s_assert(ret > 0 && ret < OUT_FILENAME_BUF_SIZE,
+        "snprintf failed (ret: %d)", ret);
+
+    /* The name is used relative to the output directory,
+     * so it must not point anywhere else */
+    for (char *c = o_buf; *c != '\0'; c++) {
+        if (*c == '/')
+            *c = '_';
+    }
+}
 
-    i32 ret = snprintf(buf, size + 1, "%.32s.%s_0x%x.bin",
-        part_name,
-        is_header ? "header" : "extracted",
-        index
-    );
-    s_assert(ret == size, "snprintf failed (ret: %d, expected: %d)", ret, size);
+static i32 open_out_file(i32 out_dirfd, const char *name)
+{
+    const u64 open_start = stats_phase_begin();
+    const i32 fd = openat(out_dirfd, name,
+        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    stats_phase_end(STATS_PHASE_FILE_OPEN, open_start);
+    stats_add(STATS_SYSCALLS, 1);
+    if (fd < 0) {
+        s_log_error("Failed to open file \"%s\" for writing: %s",
+            name, strerror(errno));
+        return -1;
+    }
+    stats_add(STATS_FILES_CREATED, 1);
 
-    return buf;
+    return fd;
 }
 
-static i32 do_save_header(union mtk_partition_header *hdr, u32 index)
+static i32 close_out_file(i32 fd, const char *name)
 {
-    char *out_path_str = NULL;
-    FILE *out_fp = NULL;
+    const u64 close_start = stats_phase_begin();
+    const i32 ret = close(fd);
+    stats_phase_end(STATS_PHASE_FILE_CLOSE, close_start);
+    stats_add(STATS_SYSCALLS, 1);
+    if (ret) {
+        s_log_error("Failed to close the output file \"%s\": %s",
+            name, strerror(errno));
+    }
 
-    out_path_str =
-        get_out_filename_from_part_name(hdr->data.part_name, true, index);
-    s_log_verbose("Saving partition header to file \"%s\"...", out_path_str);
+    return ret;
+}
 
-    out_fp = fopen(out_path_str, "wb");
-    if (out_fp == NULL) {
-        goto_error("Failed to open file \"%s\" for writing: %s",
-            out_path_str, strerror(errno));
+static i32 do_save_header(i32 out_dirfd, struct tar_writer *tar,
+    const union mtk_partition_header *raw_hdr, const char *part_name,
+    u32 index)
+{
+    char out_name[OUT_FILENAME_BUF_SIZE];
+    get_out_filename_from_part_name(out_name, part_name, true, index);
+
+    if (tar != NULL) {
+        s_log_verbose("Adding partition header to the tar stream as \"%s\"...",
+            out_name);
+        if (tar_begin_file(tar, out_name, MTK_PART_HEADER_SIZE))
+            return 1;
+        const i32 ret = tar_write(tar, raw_hdr->buf_, MTK_PART_HEADER_SIZE);
+        return (tar_end_file(tar) || ret) ? 1 : 0;
     }
 
-    i32 ret = fwrite(hdr, sizeof(union mtk_partition_header), 1, out_fp);
-    if (ret != 1) {
-        goto_error("Failed to write the partiton header to file \"%s\": %s",
-            out_path_str, strerror(errno));
+    s_log_verbose("Saving partition header to file \"%s\"...", out_name);
+
+    const i32 out_fd = open_out_file(out_dirfd, out_name);
+    if (out_fd < 0)
+        return 1;
+
+    if (io_write_full(out_fd, raw_hdr->buf_, MTK_PART_HEADER_SIZE)) {
+        s_log_error("Failed to write the partiton header to file \"%s\": %s",
+            out_name, strerror(errno));
+        (void) close_out_file(out_fd, out_name);
+        return 1;
     }
 
-    if (fclose(out_fp)) {
-        out_fp = NULL;
-        goto_error("Failed to close the output file \"%s\": %s",
-            out_path_str, strerror(errno));
+    return close_out_file(out_fd, out_name) ? 1 : 0;
+}
+
+static i32 do_extract_part(i32 in_fd, u64 offset, u64 n_bytes,
+    i32 out_dirfd, const char *out_name, u8 buf[MTKPART_EXTRACT_BUF_SIZE],
+    struct part_analysis *analysis)
+{
+    i32 out_fd = -1;
+
+    s_log_verbose("Extracting partition content to file \"%s\"...", out_name);
+
+    out_fd = open_out_file(out_dirfd, out_name);
+    if (out_fd < 0)
+        goto err;
+
+    io_cache_will_read(in_fd, offset, n_bytes);
+    u64 out_offset = 0, prev_chunk = 0;
+
+    u64 n_bytes_left = n_bytes;
+    while (n_bytes_left > 0) {
+        const u64 chunk = u_min(MTKPART_EXTRACT_BUF_SIZE, n_bytes_left);
+
+        const u64 read_start = stats_phase_begin();
+        const i64 n_read = io_pread_full(in_fd, buf, chunk, offset);
+        stats_phase_end(STATS_PHASE_EXTRACT_READ, read_start);
+        if (n_read < 0) {
+            goto_error("Unexpected error while reading from input file: %s",
+                strerror(errno));
+        } else if ((u64)n_read != chunk) {
+            goto_error("Input file doesn't contain the full partition "
+                "content (unexpected end of file while reading)!");
+        }
+        offset += chunk;
+
+        if (analysis != NULL)
+            part_analysis_update(analysis, buf, chunk);
+
+        const u64 write_start = stats_phase_begin();
+        const i32 ret = io_write_full(out_fd, buf, chunk);
+        stats_phase_end(STATS_PHASE_EXTRACT_WRITE, write_start);
+        if (ret)
+            goto_error("Failed to write to output file: %s", strerror(errno));
+
+        /* With `--cache-friendly`, the writeback of each chunk is started
+         * right away, and the previous chunk (which has had a whole chunk's
+         * worth of time to get written back) is dropped */
+        io_cache_done_reading(in_fd, offset - chunk, chunk);
+        io_cache_start_writeback(out_fd, out_offset, chunk);
+        io_cache_done_writing(out_fd, out_offset - prev_chunk, prev_chunk);
+        out_offset += chunk;
+        prev_chunk = chunk;
+
+        n_bytes_left -= chunk;
     }
-    out_fp = NULL;
+    io_cache_done_writing(out_fd, out_offset - prev_chunk, prev_chunk);
 
-    u_nfree(&out_path_str);
+    const i32 ret = close_out_file(out_fd, out_name);
+    out_fd = -1;
+    if (ret)
+        goto err;
 
     return 0;
 
 err:
-    if (out_fp != NULL) {
-        if (fclose(out_fp)) {
-            s_log_error("Failed to close the output file \"%s\": %s",
-                (out_path_str ? out_path_str : "<n/a>"), strerror(errno));
-        }
-        out_fp = NULL;
+    if (out_fd >= 0) {
+        (void) close_out_file(out_fd, out_name);
+        out_fd = -1;
     }
-    if (out_path_str != NULL)
-        u_nfree(&out_path_str);
-
     return 1;
 }
 
-static i32 do_extract_part(FILE *in_fp, size_t n_bytes, const char *out_path)
+static i32 do_extract_part_to_tar(i32 in_fd, u64 offset, u64 n_bytes,
+    struct tar_writer *tar, const char *out_name,
+    u8 buf[MTKPART_EXTRACT_BUF_SIZE], struct part_analysis *analysis)
 {
-    FILE *out_fp = NULL;
-    u8 *buf = NULL;
+    s_log_verbose("Adding partition content to the tar stream as \"%s\"...",
+        out_name);
+
+    if (tar_begin_file(tar, out_name, n_bytes))
+        return 1;
+
+    /* The stream itself may well be a pipe,
+     * so only the input side is managed with `--cache-friendly` */
+    io_cache_will_read(in_fd, offset, n_bytes);
+
+    i32 ret = 0;
+    if (analysis == NULL) {
+        /* Nothing needs to look at the data,
+         * so it can go straight from the input file to the stream */
+        const u64 write_start = stats_phase_begin();
+        ret = tar_write_range(tar, in_fd, offset, n_bytes,
+            buf, MTKPART_EXTRACT_BUF_SIZE);
+        stats_phase_end(STATS_PHASE_EXTRACT_WRITE, write_start);
+        io_cache_done_reading(in_fd, offset, n_bytes);
+    } else {
+        u64 n_bytes_left = n_bytes;
+        while (n_bytes_left > 0) {
+            const u64 chunk = u_min(MTKPART_EXTRACT_BUF_SIZE, n_bytes_left);
+
+            const u64 read_start = stats_phase_begin();
+            const i64 n_read = io_pread_full(in_fd, buf, chunk, offset);
+            stats_phase_end(STATS_PHASE_EXTRACT_READ, read_start);
+            if (n_read < 0 || (u64)n_read != chunk) {
+                s_log_error("Failed to read the partition content: %s",
+                    n_read < 0 ? strerror(errno) : "unexpected end of file");
+                ret = 1;
+                break;
+            }
+            offset += chunk;
 
-    s_log_verbose("Extracting partition content to file \"%s\"...", out_path);
+            part_analysis_update(analysis, buf, chunk);
+            io_cache_done_reading(in_fd, offset - chunk, chunk);
 
-    out_fp = fopen(out_path, "wb");
-    if (out_fp == NULL) {
-        goto_error("Failed to open output file \"%s\": %s. ",
-            out_path, strerror(errno));
+            const u64 write_start = stats_phase_begin();
+            ret = tar_write(tar, buf, chunk);
+            stats_phase_end(STATS_PHASE_EXTRACT_WRITE, write_start);
+            if (ret)
+                break;
+
+            n_bytes_left -= chunk;
+        }
     }
 
-    /* Copy the contents in 1MB blocks to reduce syscall overhead.
-     * The OS should handle further buffering (e.g. down to disk block size)
-     * by itself. */
-#define BLOCK_BUF_SIZE (1024 * 1024)
+    /* Even after a failure, so that the rest of the stream stays readable */
+    if (tar_end_file(tar))
+        ret = 1;
 
-    /* We might not need the full 1MB if the partition is small enough */
-    const size_t buf_size = u_min(BLOCK_BUF_SIZE, n_bytes);
+    return ret;
+}
 
-    buf = malloc(buf_size);
-    if (buf == NULL) {
-        goto_error("Failed to allocate %llu bytes for the copy buffer",
-            buf_size);
-    }
+static i32 do_analyze_part(i32 in_fd, u64 offset, u64 n_bytes,
+    u8 buf[MTKPART_EXTRACT_BUF_SIZE], struct part_analysis *analysis)
+{
+    io_cache_will_read(in_fd, offset, n_bytes);
 
-    size_t n_bytes_left = n_bytes;
+    u64 n_bytes_left = n_bytes;
     while (n_bytes_left > 0) {
-        const size_t chunk = u_min(buf_size, n_bytes_left);
-
-        size_t n_read = fread(buf, 1, chunk, in_fp);
-        if (n_read != chunk) {
-            if (feof(in_fp)) {
-                goto_error("Input file doesn't contain the full partition "
-                    "content (unexpected end of file while reading)!");
-            } else if (ferror(in_fp)) {
-                goto_error("Unexpected error while reading from input file: %s",
-                    strerror(errno));
-            }
-        }
+        const u64 chunk = u_min(MTKPART_EXTRACT_BUF_SIZE, n_bytes_left);
 
-        size_t n_written = fwrite(buf, 1, chunk, out_fp);
-        if (n_written != chunk)
-            goto_error("Failed to write to output file: %s", strerror(errno));
+        const u64 read_start = stats_phase_begin();
+        const i64 n_read = io_pread_full(in_fd, buf, chunk, offset);
+        stats_phase_end(STATS_PHASE_EXTRACT_READ, read_start);
+        if (n_read < 0) {
+            s_log_error("Unexpected error while reading from input file: %s",
+                strerror(errno));
+            return 1;
+        } else if ((u64)n_read != chunk) {
+            s_log_error("Input file doesn't contain the full partition "
+                "content (unexpected end of file while reading)!");
+            return 1;
+        }
+        offset += chunk;
 
+        part_analysis_update(analysis, buf, chunk);
+        io_cache_done_reading(in_fd, offset - chunk, chunk);
         n_bytes_left -= chunk;
     }
 
-    u_nfree(&buf);
-
-    if (fclose(out_fp)) {
-        out_fp = NULL;
-        goto_error("Failed to close the output file \"%s\": %s",
-            out_path, strerror(errno));
-    }
-    out_fp = NULL;
-
     return 0;
-
-err:
-    if (buf != NULL) {
-        u_nfree(&buf);
-    }
-    if (out_fp != NULL) {
-        if (fclose(out_fp))
-            s_log_error("Failed to close the output file \"%s\": %s",
-                out_path, strerror(errno));
-        out_fp = NULL;
-    }
-    return 1;
 }
@@ -17,9 +17,65 @@
 #ifndef MTKPARTDUMP_H_
 #define MTKPARTDUMP_H_
 
+#include "filter.h"
+#include "analyze.h"
+#include "tar.h"
+#include "bufpool.h"
+#include "mtkparthdr.h"
 #include <core/int.h>
-#include <stdio.h>
+#include <core/threadpool.h>
 
-void mtkpart_dump_file(FILE *fp, u32 flags);
+/* Partition contents are copied in blocks of this size
+ * to reduce syscall overhead. The OS should handle further buffering
+ * (e.g. down to disk block size) by itself.
+ * The copy buffers are borrowed from the buffer pool. */
+#define MTKPART_EXTRACT_BUF_SIZE BUFPOOL_BUF_SIZE
+
+/* The configuration shared by all the processed files */
+struct mtkpart_dump_cfg {
+    /* `ARG_FLAG_...` bits */
+    u32 flags;
+
+    /* Selects the entries to be processed; `NULL` selects all of them */
+    const struct part_filter *filter;
+
+    /* Runs the nested payload scans (`--recurse-payloads`);
+     * must be set if `ARG_FLAG_RECURSE_PAYLOADS` is */
+    struct threadpool *tp;
+
+    /* If not `NULL`, the outputs of `-e` and `-s` are added to this
+     * tar stream (`--tar`) instead of being created in `out_dirfd` */
+    struct tar_writer *tar;
+};
+
+/* Processes the partition header chain in the file open in `fd`.
+ * The file is only accessed with positional reads,
+ * so the file offset of `fd` is never changed.
+ *
+ * Saved headers and extracted partitions are created in the directory
+ * open in `out_dirfd` (which may be `AT_FDCWD`).
+ *
+ * With `ARG_FLAG_RESYNC`, a broken chain is picked up again
+ * at the next valid header (see `resync.h`) instead of ending the walk.
+ *
+ * The copy buffer (if one is needed) is borrowed from the buffer pool
+ * for the duration of the walk. */
+void mtkpart_dump_file(i32 fd, i32 out_dirfd,
+    const struct mtkpart_dump_cfg *cfg);
+
+/* Extracts the body of the `index`-th entry of a chain, whose header
+ * (`hdr`, in host byte order) is at `hdr_offset` in `in_fd`,
+ * into a file in `out_dirfd` named just like with `-e`.
+ * `buf` is the copy buffer. If `analysis` isn't `NULL`,
+ * the body is also fed to it on the way through.
+ * Returns 0 on success and non-zero on failure. */
+i32 mtkpart_extract_part(i32 in_fd, u64 hdr_offset,
+    const struct mtk_partition_header_data *hdr, u32 index,
+    i32 out_dirfd, u8 buf[MTKPART_EXTRACT_BUF_SIZE],
+    struct part_analysis *analysis);
+
+/* Returns the name of the image type `img_type` (e.g. "IMG_TYPE_CERT1"),
+ * or "N/A" for unknown types */
+const char * mtkpart_img_type_string(u32 img_type);
 
 #endif /* MTKPARTDUMP_H_ */
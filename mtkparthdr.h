@@ -64,5 +64,79 @@ union mtk_partition_header {
 	u8 buf_[MTK_PART_HEADER_SIZE];
 };
 
+/* X_(field) - every `u32` field of `struct mtk_partition_header_data`
+ * (i.e. everything except `part_name`), in the order they're stored in */
+#define MTK_PART_HEADER_U32_FIELD_LIST  \
+    X_(magic)                           \
+    X_(part_size)                       \
+    X_(memory_address)                  \
+    X_(memory_address_mode)             \
+    X_(ext.magic)                       \
+    X_(ext.hdr_size)                    \
+    X_(ext.hdr_version)                 \
+    X_(ext.img_type)                    \
+    X_(ext.is_image_list_end)           \
+    X_(ext.size_alignment_bytes)        \
+    X_(ext.part_size_hi)                \
+    X_(ext.memory_address_hi)           \
+
+/* The number of bytes of `buf_` actually used by `data`.
+ * The rest of the header is normally filled with `0xFF` bytes. */
+#define MTK_PART_HEADER_DATA_SIZE (sizeof(struct mtk_partition_header_data))
+
+/* Returns the low 32 bits of the partition size,
+ * rounded up to `size_alignment_bytes` (if there is an extension) */
+static inline u32 get_aligned_part_size(
+    const struct mtk_partition_header_data *hdr
+)
+{
+    if (hdr->ext.magic == MTK_PART_EXT_MAGIC &&
+        hdr->ext.size_alignment_bytes != 0)
+    {
+        /* Round up to the next multiple of `align` */
+        const u32 size = hdr->part_size;
+        const u32 align = hdr->ext.size_alignment_bytes;
+        return ((size + align - 1) / align) * align;
+    } else {
+        return hdr->part_size;
+    }
+}
+
+/* Returns the full 64-bit partition size (including `part_size_hi`) */
+static inline u64 get_full_part_size(
+    const struct mtk_partition_header_data *hdr
+)
+{
+    if (hdr->ext.magic == MTK_PART_EXT_MAGIC) {
+        const u64 high = (u64)hdr->ext.part_size_hi << 32;
+        return high | hdr->part_size;
+    } else {
+        return (u64)hdr->part_size;
+    }
+}
+
+/* Returns the full 64-bit partition size, aligned.
+ * This is the distance between the end of the header and the next one.
+ *
+ * The rounding is done on all 64 bits, so that (unlike with
+ * `get_aligned_part_size()`) a carry out of the low word isn't lost.
+ * A size that can't be represented at all comes out as `UINT64_MAX`,
+ * which doesn't fit in any file. */
+static inline u64 get_full_aligned_part_size(
+    const struct mtk_partition_header_data *hdr
+)
+{
+    const u64 size = get_full_part_size(hdr);
+    if (hdr->ext.magic != MTK_PART_EXT_MAGIC ||
+        hdr->ext.size_alignment_bytes == 0)
+    {
+        return size;
+    }
+
+    const u64 align = hdr->ext.size_alignment_bytes;
+    const u64 padding = (align - size % align) % align;
+    return size > UINT64_MAX - padding ? UINT64_MAX : size + padding;
+}
+
 
 #endif /* MTK_PART_HEADER_H_ */
@@ -0,0 +1,141 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "outdir.h"
+#include "stats.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/hashmap.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MODULE_NAME "outdir"
+
+static const char * get_base_name(const char *path);
+
+i32 outdir_init(struct outdir *o, const char *path)
+{
+    u_check_params(o != NULL && path != NULL);
+    memset(o, 0, sizeof(struct outdir));
+    o->root_fd = -1;
+
+    if (mkdir(path, 0755) && errno != EEXIST) {
+        s_log_error("Failed to create the output directory \"%s\": %s",
+            path, strerror(errno));
+        return 1;
+    }
+    stats_add(STATS_SYSCALLS, 1);
+
+    o->root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    stats_add(STATS_SYSCALLS, 1);
+    if (o->root_fd < 0) {
+        s_log_error("Failed to open the output directory \"%s\": %s",
+            path, strerror(errno));
+        return 1;
+    }
+
+    o->used_names = hashmap_create(0);
+    if (o->used_names == NULL) {
+        s_log_error("Failed to create the subdirectory name map");
+        return 1;
+    }
+
+    return 0;
+}
+
+i32 outdir_open_subdir(struct outdir *o, const char *input_path)
+{
+    u_check_params(o != NULL && o->root_fd >= 0 && input_path != NULL);
+
+    const char *base_name = get_base_name(input_path);
+
+    /* Inputs with the same base name get numbered subdirectories */
+    char name[NAME_MAX + 1];
+    u32 n = 0;
+    do {
+        i32 ret;
+        if (n == 0)
+            ret = snprintf(name, sizeof(name), "%s", base_name);
+        else
+            ret = snprintf(name, sizeof(name), "%s.%u", base_name, n);
+
+        if (ret < 0 || (u32)ret >= sizeof(name)) {
+            s_log_error("Output directory name for \"%s\" is too long",
+                input_path);
+            return -1;
+        }
+        n++;
+    } while (hashmap_lookup_record(o->used_names, name) != NULL);
+
+    if (mkdirat(o->root_fd, name, 0755) && errno != EEXIST) {
+        s_log_error("Failed to create the output directory \"%s\": %s",
+            name, strerror(errno));
+        return -1;
+    }
+    stats_add(STATS_SYSCALLS, 1);
+
+    const i32 fd = openat(o->root_fd, name,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    stats_add(STATS_SYSCALLS, 1);
+    if (fd < 0) {
+        s_log_error("Failed to open the output directory \"%s\": %s",
+            name, strerror(errno));
+        return -1;
+    }
+
+    if (hashmap_insert(o->used_names, name, o)) {
+        s_log_error("Failed to record the output directory name \"%s\"", name);
+        (void) close(fd);
+        return -1;
+    }
+
+    s_log_verbose("Writing the outputs of \"%s\" to \"%s\"",
+        input_path, name);
+
+    return fd;
+}
+
+void outdir_destroy(struct outdir *o)
+{
+    if (o == NULL) return;
+
+    hashmap_destroy(&o->used_names);
+
+    if (o->root_fd >= 0) {
+        (void) close(o->root_fd);
+        o->root_fd = -1;
+    }
+}
+
+static const char * get_base_name(const char *path)
+{
+    const char *last_slash = strrchr(path, '/');
+    const char *base = last_slash != NULL ? last_slash + 1 : path;
+
+    /* "", "." and ".." are no good as directory names */
+    if (*base == '\0' || !strcmp(base, ".") || !strcmp(base, ".."))
+        return "input";
+
+    return base;
+}
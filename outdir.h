@@ -0,0 +1,48 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef OUTDIR_H_
+#define OUTDIR_H_
+
+#include <core/int.h>
+#include <core/hashmap.h>
+
+/* The output directory (`--outdir`).
+ *
+ * Every input file gets its own subdirectory named after the input's
+ * base name, so that e.g. two different `lk.bin` files don't overwrite
+ * each other's outputs (the second one goes into `lk.bin.1`, and so on).
+ *
+ * Both the root and the subdirectories are opened just once,
+ * and all the outputs are then created relative to them (`openat()`). */
+struct outdir {
+    i32 root_fd;
+
+    /* The names of the subdirectories handed out so far */
+    struct hashmap *used_names;
+};
+
+/* Opens (and creates, if needed) the output directory `path`.
+ * Returns 0 on success and non-zero on failure. */
+i32 outdir_init(struct outdir *o, const char *path);
+
+/* Creates (if needed) and opens the subdirectory for `input_path`.
+ * Returns the directory's file descriptor, or -1 on failure. */
+i32 outdir_open_subdir(struct outdir *o, const char *input_path);
+
+void outdir_destroy(struct outdir *o);
+
+#endif /* OUTDIR_H_ */
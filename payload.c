@@ -0,0 +1,574 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#define PAYLOAD_TYPE_LIST_DEF__
+#include "payload.h"
+#undef PAYLOAD_TYPE_LIST_DEF__
+#include "mtkpartdump.h"
+#include "mtkparthdr.h"
+#include "chainindex.h"
+#include "io.h"
+#include "stats.h"
+#include "bufpool.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <core/trace.h>
+#include <core/vector.h>
+#include <core/spinlock.h>
+#include <core/threadpool.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MODULE_NAME "payload"
+
+/* Bodies are scanned in pieces of this size */
+#define PAYLOAD_SCAN_BUF_SIZE BUFPOOL_BUF_SIZE
+
+/* The number of bytes a magic check may look at past the candidate offset.
+ * Consecutive pieces overlap by this much, so that no magic is missed. */
+#define PAYLOAD_MAX_CHECK_SIZE 16
+
+#define X_(name, desc) [PAYLOAD_##name] = desc,
+static const char *const g_type_strings[PAYLOAD_N_TYPES_] = {
+    PAYLOAD_TYPE_LIST
+};
+#undef X_
+#undef PAYLOAD_TYPE_LIST
+
+/* The first two bytes of every magic we look for. Every offset where
+ * any of them occurs is a candidate, which is then checked in full. */
+#define PAYLOAD_N_PREFIXES 8
+static const u8 g_prefixes[PAYLOAD_N_PREFIXES][2] = {
+    { 0x88, 0x16 }, /* MTK (little endian) */
+    { 0x58, 0x88 }, /* MTK (big endian) */
+    { 0x7F, 'E' },  /* ELF */
+    { 'A', 'N' },   /* "ANDROID!" */
+    { 0x1F, 0x8B }, /* gzip */
+    { 0xFD, '7' },  /* xz */
+    { 0x5D, 0x00 }, /* LZMA ("lzma_alone") */
+    { 0x04, 0x22 }, /* LZ4 */
+};
+
+struct payload_node {
+    enum payload_type type;
+    u64 offset; /* In the input file */
+    u64 size; /* 0 if unknown */
+
+    /* `PAYLOAD_MTK_ENTRY`: the name and the index within its chain */
+    u32 index;
+    char name[MTK_PART_NAME_LEN + 1];
+
+    /* Extra information, e.g. the ELF class */
+    char info[32];
+
+    hybridlock_t lock;
+    VECTOR(struct payload_node *) children;
+};
+
+struct payload_ctx {
+    i32 fd;
+    struct threadpool *tp;
+    struct threadpool_group group;
+    bool extract;
+
+    /* All the directories opened for nested extractions,
+     * closed once everything is done */
+    hybridlock_t dirs_lock;
+    VECTOR(i32) dirfds;
+
+    _Atomic u32 n_errors;
+};
+
+struct scan_job {
+    struct payload_ctx *ctx;
+    struct payload_node *node; /* The entry whose body is scanned */
+    u64 start, end; /* The body */
+    u32 depth;
+    i32 dirfd; /* Where the entry was extracted to (or -1) */
+};
+
+struct extract_job {
+    struct payload_ctx *ctx;
+    u64 hdr_offset;
+    struct mtk_partition_header_data hdr;
+    u32 index;
+    i32 dirfd;
+};
+
+static struct payload_node * node_create(enum payload_type type, u64 offset);
+static void node_add_child(struct payload_node *parent,
+    struct payload_node *child);
+static void node_destroy(struct payload_node *node);
+static void node_print(struct payload_node *node, u32 depth);
+
+static void submit_scan(struct payload_ctx *ctx, struct payload_node *node,
+    u64 start, u64 end, u32 depth, i32 dirfd);
+static void scan_task(void *arg);
+static void extract_task(void *arg);
+static u64 handle_mtk_chain(const struct scan_job *job, u64 offset,
+    i32 *nested_dirfd_p, u32 *n_nested_entries_p);
+static enum payload_type identify(const u8 *p, u64 avail,
+    char info[static 32]);
+static u64 find_candidate(const u8 *buf, u64 from, u64 end, u64 avail);
+
+i32 payload_scan(i32 fd, const struct payload_root *roots, u32 n_roots,
+    struct threadpool *tp, i32 out_dirfd, bool extract)
+{
+    u_check_params(fd >= 0 && (roots != NULL || n_roots == 0) && tp != NULL);
+
+    struct payload_ctx ctx = {
+        .fd = fd,
+        .tp = tp,
+        .group = THREADPOOL_GROUP_INIT,
+        .extract = extract,
+        .dirs_lock = HYBRIDLOCK_INIT,
+    };
+    ctx.dirfds = vector_new(i32);
+
+    struct payload_node **nodes = calloc(n_roots, sizeof(*nodes));
+    s_assert(nodes != NULL || n_roots == 0, "calloc() failed for the roots");
+
+    trace_begin("file", "payload scan", NULL);
+    for (u32 i = 0; i < n_roots; i++) {
+        const u64 body = roots[i].hdr_offset + MTK_PART_HEADER_SIZE;
+        nodes[i] = node_create(PAYLOAD_MTK_ENTRY, roots[i].hdr_offset);
+        nodes[i]->index = roots[i].index;
+        nodes[i]->size = get_full_part_size(&roots[i].hdr);
+        memcpy(nodes[i]->name, roots[i].hdr.part_name, MTK_PART_NAME_LEN);
+
+        /* The scan stops at the end of the file anyway */
+        u64 body_end;
+        if (!io_offset_add(body, nodes[i]->size, &body_end))
+            body_end = IO_OFFSET_MAX;
+        submit_scan(&ctx, nodes[i], body, body_end, 0,
+            extract ? out_dirfd : -1);
+    }
+    threadpool_group_wait(tp, &ctx.group);
+    trace_end("file", "payload scan");
+
+    s_log_info("Payloads:");
+    for (u32 i = 0; i < n_roots; i++) {
+        /* Entries with nothing inside are just noise, unless asked for */
+        if (vector_size(nodes[i]->children) > 0 ||
+            s_get_log_level() <= S_LOG_VERBOSE)
+        {
+            node_print(nodes[i], 1);
+        }
+        node_destroy(nodes[i]);
+    }
+    u_nfree(&nodes);
+
+    for (u64 i = 0; i < vector_size(ctx.dirfds); i++)
+        (void) close(ctx.dirfds[i]);
+    vector_destroy(&ctx.dirfds);
+
+    const u32 n_errors = atomic_load(&ctx.n_errors);
+    if (n_errors > 0)
+        s_log_error("%u nested payloads couldn't be read or extracted",
+            n_errors);
+    return n_errors > 0;
+}
+
+const char * payload_type_string(enum payload_type type)
+{
+    if (type < 0 || type >= PAYLOAD_N_TYPES_)
+        return "unknown";
+    return g_type_strings[type];
+}
+
+static struct payload_node * node_create(enum payload_type type, u64 offset)
+{
+    struct payload_node *node = calloc(1, sizeof(struct payload_node));
+    s_assert(node != NULL, "calloc() failed for a payload node");
+    node->type = type;
+    node->offset = offset;
+    hybridlock_init(&node->lock);
+    node->children = vector_new(struct payload_node *);
+    return node;
+}
+
+static void node_add_child(struct payload_node *parent,
+    struct payload_node *child)
+{
+    hybridlock_acquire(&parent->lock);
+    vector_push_back(&parent->children, child);
+    hybridlock_release(&parent->lock);
+}
+
+static void node_destroy(struct payload_node *node)
+{
+    for (u64 i = 0; i < vector_size(node->children); i++)
+        node_destroy(node->children[i]);
+    vector_destroy(&node->children);
+    free(node);
+}
+
+static i32 compare_nodes(const void *a, const void *b)
+{
+    const struct payload_node *na = *(const struct payload_node *const *)a;
+    const struct payload_node *nb = *(const struct payload_node *const *)b;
+    return (na->offset > nb->offset) - (na->offset < nb->offset);
+}
+
+static void node_print(struct payload_node *node, u32 depth)
+{
+    /* The children were added by whichever task found them first */
+    qsort(node->children, vector_size(node->children),
+        sizeof(struct payload_node *), compare_nodes);
+
+    char size_str[32] = "";
+    if (node->size > 0) {
+        (void) snprintf(size_str, sizeof(size_str), " (%llu bytes)",
+            (unsigned long long)node->size);
+    }
+
+    if (node->type == PAYLOAD_MTK_ENTRY) {
+        s_log_info("%*s[%u] \"%s\" @ %#llx%s", depth * 2, "", node->index,
+            node->name, (unsigned long long)node->offset, size_str);
+    } else {
+        s_log_info("%*s%s%s%s @ %#llx%s", depth * 2, "",
+            payload_type_string(node->type), node->info[0] ? ", " : "",
+            node->info, (unsigned long long)node->offset, size_str);
+    }
+
+    for (u64 i = 0; i < vector_size(node->children); i++)
+        node_print(node->children[i], depth + 1);
+}
+
+static void submit_scan(struct payload_ctx *ctx, struct payload_node *node,
+    u64 start, u64 end, u32 depth, i32 dirfd)
+{
+    struct scan_job *job = malloc(sizeof(struct scan_job));
+    s_assert(job != NULL, "malloc() failed for a scan job");
+    *job = (struct scan_job) {
+        .ctx = ctx,
+        .node = node,
+        .start = start,
+        .end = end,
+        .depth = depth,
+        .dirfd = dirfd,
+    };
+    threadpool_submit(ctx->tp, &ctx->group, scan_task, job);
+}
+
+static void scan_task(void *arg)
+{
+    struct scan_job *job = arg;
+    struct payload_ctx *ctx = job->ctx;
+
+    u8 *buf = bufpool_get();
+    if (buf == NULL) {
+        s_log_error("Failed to get a buffer to scan \"%s\"", job->node->name);
+        atomic_fetch_add(&ctx->n_errors, 1);
+        free(job);
+        return;
+    }
+
+    trace_begin("payload", "scan", job->node->name);
+
+    /* The directory for the entries of nested chains, created on demand.
+     * All the chains in the body share it, so their entries are numbered
+     * one after another (and don't overwrite each other's files). */
+    i32 nested_dirfd = -1;
+    u32 n_nested_entries = 0;
+    u32 n_hits = 0;
+
+    u64 pos = job->start;
+    while (pos < job->end && n_hits < PAYLOAD_MAX_HITS) {
+        const u64 len = u_min(PAYLOAD_SCAN_BUF_SIZE, job->end - pos);
+        const i64 n_read = io_pread_full(ctx->fd, buf, len, pos);
+        if (n_read < 0 || (u64)n_read != len) {
+            s_log_error("Failed to read the body of \"%s\" at %#llx",
+                job->node->name, (unsigned long long)pos);
+            atomic_fetch_add(&ctx->n_errors, 1);
+            break;
+        }
+
+        /* Unless this is the last piece, leave the last few bytes
+         * to the next one, so that every magic can be checked in full */
+        const bool last = pos + len == job->end;
+        const u64 scan_len = last ? len : len - PAYLOAD_MAX_CHECK_SIZE;
+        u64 next_pos = pos + scan_len;
+
+        u64 i = 0;
+        while ((i = find_candidate(buf, i, scan_len, len)) < scan_len) {
+            char info[32] = "";
+            const enum payload_type type = identify(buf + i, len - i, info);
+            if (type == PAYLOAD_N_TYPES_) {
+                i++;
+                continue;
+            }
+
+            if (type == PAYLOAD_MTK_CHAIN) {
+                const u64 chain_end =
+                    handle_mtk_chain(job, pos + i, &nested_dirfd,
+                        &n_nested_entries);
+                if (chain_end > 0) {
+                    n_hits++;
+                    /* Whatever is in the chain is scanned by its entries */
+                    next_pos = chain_end;
+                    break;
+                }
+            } else {
+                struct payload_node *node = node_create(type, pos + i);
+                memcpy(node->info, info, sizeof(info));
+                node_add_child(job->node, node);
+                if (++n_hits == PAYLOAD_MAX_HITS) {
+                    s_log_warn("Too many payloads in \"%s\"; "
+                        "not looking any further", job->node->name);
+                    break;
+                }
+            }
+            i++;
+        }
+
+        pos = next_pos;
+    }
+
+    trace_end("payload", "scan");
+    bufpool_put(buf);
+    free(job);
+}
+
+/* Walks the nested chain at `offset` and queues up its entries,
+ * numbering them from `*n_nested_entries_p` on.
+ * Returns the offset of the end of the chain,
+ * or 0 if there's no valid (and complete) chain there. */
+static u64 handle_mtk_chain(const struct scan_job *job, u64 offset,
+    i32 *nested_dirfd_p, u32 *n_nested_entries_p)
+{
+    struct payload_ctx *ctx = job->ctx;
+
+    struct chain_index ci;
+    if (chain_index_build_range(&ci, ctx->fd, offset, job->end))
+        return 0;
+
+    /* A random match of the magic is unlikely to be followed
+     * by a whole chain that fits in the body */
+    if (!ci.complete) {
+        chain_index_destroy(&ci);
+        return 0;
+    }
+
+    const struct chain_entry *last = &ci.entries[vector_size(ci.entries) - 1];
+    const u64 chain_end = last->hdr_offset + MTK_PART_HEADER_SIZE
+        + get_full_aligned_part_size(&last->hdr);
+
+    struct payload_node *chain = node_create(PAYLOAD_MTK_CHAIN, offset);
+    chain->size = chain_end - offset;
+    (void) snprintf(chain->info, sizeof(chain->info), "%llu entries",
+        (unsigned long long)vector_size(ci.entries));
+    node_add_child(job->node, chain);
+
+    if (job->depth + 1 >= PAYLOAD_MAX_DEPTH) {
+        s_log_warn("Not following the chain at %#llx "
+            "(nested more than %u levels deep)",
+            (unsigned long long)offset, PAYLOAD_MAX_DEPTH);
+        chain_index_destroy(&ci);
+        return chain_end;
+    }
+
+    /* The nested entries go to "<name>.payloads_0x<index>/",
+     * next to the file the outer entry was extracted to */
+    if (job->dirfd != -1 && *nested_dirfd_p == -1) {
+        char dir_name[MTK_PART_NAME_LEN + 32];
+        (void) snprintf(dir_name, sizeof(dir_name), "%.32s.payloads_0x%x",
+            job->node->name, job->node->index);
+        for (char *c = dir_name; *c != '\0'; c++) {
+            if (*c == '/')
+                *c = '_';
+        }
+
+        stats_add(STATS_SYSCALLS, 2);
+        i32 dirfd = -1;
+        if (mkdirat(job->dirfd, dir_name, 0755) == 0 || errno == EEXIST)
+            dirfd = openat(job->dirfd, dir_name,
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd < 0) {
+            s_log_error("Failed to create the directory \"%s\": %s",
+                dir_name, strerror(errno));
+            atomic_fetch_add(&ctx->n_errors, 1);
+        } else {
+            hybridlock_acquire(&ctx->dirs_lock);
+            vector_push_back(&ctx->dirfds, dirfd);
+            hybridlock_release(&ctx->dirs_lock);
+            *nested_dirfd_p = dirfd;
+        }
+    }
+
+    for (u64 i = 0; i < vector_size(ci.entries); i++) {
+        const struct chain_entry *e = &ci.entries[i];
+        const u32 index = (*n_nested_entries_p)++;
+
+        struct payload_node *node = node_create(PAYLOAD_MTK_ENTRY,
+            e->hdr_offset);
+        node->index = index;
+        node->size = get_full_part_size(&e->hdr);
+        memcpy(node->name, e->hdr.part_name, MTK_PART_NAME_LEN);
+        node_add_child(chain, node);
+
+        if (*nested_dirfd_p != -1) {
+            struct extract_job *ej = malloc(sizeof(struct extract_job));
+            s_assert(ej != NULL, "malloc() failed for an extraction job");
+            *ej = (struct extract_job) {
+                .ctx = ctx,
+                .hdr_offset = e->hdr_offset,
+                .hdr = e->hdr,
+                .index = index,
+                .dirfd = *nested_dirfd_p,
+            };
+            threadpool_submit(ctx->tp, &ctx->group, extract_task, ej);
+        }
+
+        const u64 body = e->hdr_offset + MTK_PART_HEADER_SIZE;
+        submit_scan(ctx, node, body, body + node->size, job->depth + 1,
+            *nested_dirfd_p);
+    }
+
+    chain_index_destroy(&ci);
+    return chain_end;
+}
+
+static void extract_task(void *arg)
+{
+    struct extract_job *job = arg;
+    struct payload_ctx *ctx = job->ctx;
+
+    u8 *buf = bufpool_get();
+    if (buf == NULL || mtkpart_extract_part(ctx->fd, job->hdr_offset,
+            &job->hdr, job->index, job->dirfd, buf, NULL))
+    {
+        s_log_error("Failed to extract the nested partition \"%.32s\"",
+            job->hdr.part_name);
+        atomic_fetch_add(&ctx->n_errors, 1);
+    }
+
+    bufpool_put(buf);
+    free(job);
+}
+
+static u32 read_le32(const u8 *p)
+{
+    return (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+}
+
+/* Checks the candidate at `p` (with `avail` bytes available) in full.
+ * Returns the type of the payload there, or `PAYLOAD_N_TYPES_` if none.
+ * For MTK magics, `PAYLOAD_MTK_CHAIN` only means that the magic matches. */
+static enum payload_type identify(const u8 *p, u64 avail,
+    char info[static 32])
+{
+    if (avail >= 4 && (!memcmp(p, "\x88\x16\x88\x58", 4) ||
+        !memcmp(p, "\x58\x88\x16\x88", 4)))
+    {
+        return PAYLOAD_MTK_CHAIN;
+    }
+
+    if (avail >= 7 && !memcmp(p, "\x7F" "ELF", 4) &&
+        (p[4] == 1 || p[4] == 2) && (p[5] == 1 || p[5] == 2) && p[6] == 1)
+    {
+        (void) snprintf(info, 32, "%s-bit %s",
+            p[4] == 1 ? "32" : "64", p[5] == 1 ? "LE" : "BE");
+        return PAYLOAD_ELF;
+    }
+
+    if (avail >= 8 && !memcmp(p, "ANDROID!", 8))
+        return PAYLOAD_ANDROID_BOOT;
+
+    /* Deflate, and none of the reserved flags */
+    if (avail >= 4 && p[0] == 0x1F && p[1] == 0x8B && p[2] == 0x08 &&
+        (p[3] & 0xE0) == 0)
+    {
+        return PAYLOAD_GZIP;
+    }
+
+    if (avail >= 6 && !memcmp(p, "\xFD" "7zXZ\0", 6))
+        return PAYLOAD_XZ;
+
+    /* The usual properties byte, and a power-of-two dictionary size
+     * between 4 KiB and 1 GiB */
+    if (avail >= 5 && p[0] == 0x5D) {
+        const u32 dict_size = read_le32(p + 1);
+        if (dict_size >= (4U << 10) && dict_size <= (1U << 30) &&
+            (dict_size & (dict_size - 1)) == 0)
+        {
+            (void) snprintf(info, 32, "%u KiB dictionary", dict_size >> 10);
+            return PAYLOAD_LZMA;
+        }
+    }
+
+    /* Frame format version 01 */
+    if (avail >= 5 && !memcmp(p, "\x04\x22\x4D\x18", 4) && (p[4] >> 6) == 1)
+        return PAYLOAD_LZ4;
+
+    return PAYLOAD_N_TYPES_;
+}
+
+/* Returns the first offset in [`from`, `end`) where any of the prefixes
+ * starts, or `end` if there is none. `avail` is the number of bytes
+ * in `buf`, which may be more than `end`. */
+static u64 find_candidate(const u8 *buf, u64 from, u64 end, u64 avail)
+{
+    u64 i = from;
+
+#if defined(__SSE2__)
+    __m128i first[PAYLOAD_N_PREFIXES], second[PAYLOAD_N_PREFIXES];
+    for (u32 k = 0; k < PAYLOAD_N_PREFIXES; k++) {
+        first[k] = _mm_set1_epi8((char)g_prefixes[k][0]);
+        second[k] = _mm_set1_epi8((char)g_prefixes[k][1]);
+    }
+
+    /* 16 candidate offsets at a time: compare the block with the first
+     * bytes, the block shifted by one with the second bytes, and OR
+     * the results for all the prefixes */
+    for (; i + 16 <= end && i + 17 <= avail; i += 16) {
+        const __m128i v0 = _mm_loadu_si128((const __m128i *)(buf + i));
+        const __m128i v1 = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+
+        __m128i hits = _mm_setzero_si128();
+        for (u32 k = 0; k < PAYLOAD_N_PREFIXES; k++) {
+            hits = _mm_or_si128(hits, _mm_and_si128(
+                _mm_cmpeq_epi8(v0, first[k]), _mm_cmpeq_epi8(v1, second[k])));
+        }
+
+        const u32 mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif /* __SSE2__ */
+
+    for (; i < end && i + 1 < avail; i++) {
+        for (u32 k = 0; k < PAYLOAD_N_PREFIXES; k++) {
+            if (buf[i] == g_prefixes[k][0] && buf[i + 1] == g_prefixes[k][1])
+                return i;
+        }
+    }
+
+    return end;
+}
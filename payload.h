@@ -0,0 +1,84 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef PAYLOAD_H_
+#define PAYLOAD_H_
+
+#include "mtkparthdr.h"
+#include <core/int.h>
+#include <core/threadpool.h>
+#include <stdbool.h>
+
+/* Nested payload detection (`--recurse-payloads`).
+ *
+ * The bodies of the selected entries are scanned for the magic values
+ * of known formats. Nested MTK chains are walked, their entries
+ * are extracted (with `-e`) into a `<name>.payloads_0x<index>` directory
+ * next to the entry they were found in (numbered across all the chains
+ * in that body), and their bodies are scanned
+ * in turn, up to `PAYLOAD_MAX_DEPTH` levels deep. Every body scan
+ * and every nested extraction is a separate task on the thread pool.
+ * Other payloads (ELF images, compressed streams, ...) are only reported.
+ *
+ * The results are logged as a tree, ordered by offset,
+ * once the whole file is done. */
+
+#define PAYLOAD_TYPE_LIST                                                   \
+    X_(MTK_CHAIN, "MTK partition chain")                                    \
+    X_(MTK_ENTRY, "MTK partition")                                          \
+    X_(ELF, "ELF image")                                                    \
+    X_(ANDROID_BOOT, "Android boot image")                                  \
+    X_(GZIP, "gzip stream")                                                 \
+    X_(XZ, "xz stream")                                                     \
+    X_(LZMA, "LZMA stream")                                                 \
+    X_(LZ4, "LZ4 frame")                                                    \
+
+#define X_(name, desc) PAYLOAD_##name,
+enum payload_type {
+    PAYLOAD_TYPE_LIST
+    PAYLOAD_N_TYPES_
+};
+#undef X_
+
+/* How deep nested MTK chains are followed */
+#define PAYLOAD_MAX_DEPTH 8
+
+/* The maximum number of payloads recorded per scanned body,
+ * so that a body full of false positives can't flood the output */
+#define PAYLOAD_MAX_HITS 256
+
+/* An entry of the top-level chain, whose body is to be scanned */
+struct payload_root {
+    u32 index;
+    u64 hdr_offset;
+    struct mtk_partition_header_data hdr;
+};
+
+/* Scans the bodies of the `n_roots` entries in `roots` (of the chain in
+ * `fd`) on `tp`, extracting nested MTK entries into subdirectories
+ * of `out_dirfd` if `extract` is set, and logs the resulting tree.
+ * Returns 0 on success and non-zero if any read or extraction failed. */
+i32 payload_scan(i32 fd, const struct payload_root *roots, u32 n_roots,
+    struct threadpool *tp, i32 out_dirfd, bool extract);
+
+/* Returns the description of the payload type `type` */
+const char * payload_type_string(enum payload_type type);
+
+#ifndef PAYLOAD_TYPE_LIST_DEF__
+#undef PAYLOAD_TYPE_LIST
+#endif /* PAYLOAD_TYPE_LIST_DEF__ */
+
+#endif /* PAYLOAD_H_ */
@@ -0,0 +1,233 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "resync.h"
+#include "byteorder.h"
+#include "mtkparthdr.h"
+#include "io.h"
+#include <core/log.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#define MODULE_NAME "resync"
+
+#define MAGIC_LEN 4
+
+/* `MTK_PART_MAGIC` as stored in the file, in both byte orders */
+static const u8 g_magics[][MAGIC_LEN] = {
+    [MTK_PART_BYTE_ORDER_LE - 1] = { 0x88, 0x16, 0x88, 0x58 },
+    [MTK_PART_BYTE_ORDER_BE - 1] = { 0x58, 0x88, 0x16, 0x88 },
+};
+#define N_MAGICS (sizeof(g_magics) / sizeof(*g_magics))
+
+static u64 read_window(i32 fd, u8 *buf, u64 size, u64 offset);
+static bool magic_at(const u8 *p, enum mtk_part_byte_order order);
+static u64 find_magic(const u8 *buf, u64 from, u64 end, u64 avail,
+    enum mtk_part_byte_order order);
+static bool header_valid(i32 fd, u64 offset, u64 file_size,
+    enum mtk_part_byte_order order);
+
+u64 resync_find_header(i32 fd, u64 from, u64 file_size,
+    enum mtk_part_byte_order order, u8 *buf, u64 buf_size)
+{
+    u_check_params(fd >= 0 && buf != NULL && buf_size >= RESYNC_STRIDE);
+
+    u64 pos = from;
+    while (pos < file_size && file_size - pos >= MTK_PART_HEADER_SIZE) {
+        const u64 n = read_window(fd, buf, u_min(buf_size, file_size - pos),
+            pos);
+        if (n < MTK_PART_HEADER_SIZE)
+            break;
+
+        /* A header must fit in what's left of the file,
+         * so there's no point in checking the last 511 bytes */
+        const u64 n_candidates = u_min(n - MAGIC_LEN + 1,
+            file_size - pos - MTK_PART_HEADER_SIZE + 1);
+
+        /* First pass: only the sector boundaries */
+        u64 limit = n_candidates;
+        const u64 first_aligned = (RESYNC_STRIDE - pos % RESYNC_STRIDE)
+            % RESYNC_STRIDE;
+        for (u64 i = first_aligned; i < n_candidates; i += RESYNC_STRIDE) {
+            if (magic_at(buf + i, order) &&
+                header_valid(fd, pos + i, file_size, order))
+            {
+                limit = i;
+                break;
+            }
+        }
+
+        /* Second pass: everything before the first good aligned header
+         * (the boundaries themselves have already been ruled out) */
+        u64 i = 0;
+        while ((i = find_magic(buf, i, limit, n, order)) < limit) {
+            if ((pos + i) % RESYNC_STRIDE != 0 &&
+                header_valid(fd, pos + i, file_size, order))
+            {
+                return pos + i;
+            }
+            i++;
+        }
+
+        if (limit < n_candidates)
+            return pos + limit;
+
+        pos += n_candidates;
+    }
+
+    return file_size;
+}
+
+static u64 read_window(i32 fd, u8 *buf, u64 size, u64 offset)
+{
+    const i64 n_read = io_pread_full(fd, buf, size, offset);
+    if (n_read >= 0)
+        return (u64)n_read;
+
+    /* Something in the window can't be read (most likely a bad block),
+     * so go sector by sector to still see everything around it */
+    s_log_verbose("Failed to read %#llx bytes at %#llx (%s); "
+        "retrying sector by sector",
+        (unsigned long long)size, (unsigned long long)offset, strerror(errno));
+
+    u64 n_bad = 0;
+    for (u64 i = 0; i < size; i += RESYNC_STRIDE) {
+        const u64 len = u_min(RESYNC_STRIDE, size - i);
+        const i64 ret = io_pread_full(fd, buf + i, len, offset + i);
+        if (ret < 0) {
+            memset(buf + i, 0, len);
+            n_bad++;
+        } else if ((u64)ret != len) { /* EOF */
+            return i + ret;
+        }
+    }
+    if (n_bad > 0) {
+        s_log_warn("%llu unreadable sectors at %#llx - %#llx",
+            (unsigned long long)n_bad, (unsigned long long)offset,
+            (unsigned long long)(offset + size));
+    }
+
+    return size;
+}
+
+static bool magic_at(const u8 *p, enum mtk_part_byte_order order)
+{
+    for (u32 k = 0; k < N_MAGICS; k++) {
+        if ((order == MTK_PART_BYTE_ORDER_UNKNOWN || order == k + 1) &&
+            !memcmp(p, g_magics[k], MAGIC_LEN))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns the first offset in [`from`, `end`) in `buf` at which the magic
+ * (in `order`, or in either byte order) starts, or `end` if there is none.
+ * `avail` is the number of valid bytes in `buf`. */
+static u64 find_magic(const u8 *buf, u64 from, u64 end, u64 avail,
+    enum mtk_part_byte_order order)
+{
+    u64 i = from;
+
+#if defined(__SSE2__)
+    __m128i bytes[N_MAGICS][MAGIC_LEN];
+    for (u32 k = 0; k < N_MAGICS; k++) {
+        for (u32 b = 0; b < MAGIC_LEN; b++)
+            bytes[k][b] = _mm_set1_epi8((char)g_magics[k][b]);
+    }
+
+    /* 16 candidate offsets at a time: the block shifted by 0..3 bytes
+     * is compared with the 4 bytes of each magic, and the results
+     * are AND'ed per magic and OR'ed across them */
+    for (; i + 16 <= end && i + 16 + MAGIC_LEN - 1 <= avail; i += 16) {
+        __m128i v[MAGIC_LEN];
+        for (u32 b = 0; b < MAGIC_LEN; b++)
+            v[b] = _mm_loadu_si128((const __m128i *)(buf + i + b));
+
+        __m128i hits = _mm_setzero_si128();
+        for (u32 k = 0; k < N_MAGICS; k++) {
+            if (order != MTK_PART_BYTE_ORDER_UNKNOWN && order != k + 1)
+                continue;
+
+            __m128i match = _mm_cmpeq_epi8(v[0], bytes[k][0]);
+            for (u32 b = 1; b < MAGIC_LEN; b++)
+                match = _mm_and_si128(match, _mm_cmpeq_epi8(v[b], bytes[k][b]));
+            hits = _mm_or_si128(hits, match);
+        }
+
+        const u32 mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif /* __SSE2__ */
+
+    for (; i < end && i + MAGIC_LEN <= avail; i++) {
+        if (magic_at(buf + i, order))
+            return i;
+    }
+
+    return end;
+}
+
+static bool header_valid(i32 fd, u64 offset, u64 file_size,
+    enum mtk_part_byte_order order)
+{
+    union mtk_partition_header raw;
+    if (io_pread_full(fd, raw.buf_, MTK_PART_HEADER_SIZE, offset)
+        != MTK_PART_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    const enum mtk_part_byte_order raw_order = mtk_part_detect_byte_order(&raw);
+    if (raw_order == MTK_PART_BYTE_ORDER_UNKNOWN ||
+        (order != MTK_PART_BYTE_ORDER_UNKNOWN && raw_order != order))
+    {
+        return false;
+    }
+
+    struct mtk_partition_header_data hdr;
+    mtk_part_get_header_parser(raw_order)(&hdr, &raw);
+
+    /* Random data is very unlikely to have a clean name */
+    if (hdr.part_name[0] == '\0')
+        return false;
+    for (u32 i = 0; i < MTK_PART_NAME_LEN && hdr.part_name[i] != '\0'; i++) {
+        if (hdr.part_name[i] < 0x20 || hdr.part_name[i] > 0x7e)
+            return false;
+    }
+
+    if (hdr.ext.magic == MTK_PART_EXT_MAGIC &&
+        (hdr.ext.hdr_size != MTK_PART_HEADER_SIZE ||
+            hdr.ext.is_image_list_end > 1))
+    {
+        return false;
+    }
+
+    u64 body_end;
+    return io_offset_add(offset + MTK_PART_HEADER_SIZE,
+            get_full_aligned_part_size(&hdr), &body_end) &&
+        body_end <= file_size;
+}
@@ -0,0 +1,53 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef RESYNC_H_
+#define RESYNC_H_
+
+#include "byteorder.h"
+#include <core/int.h>
+
+/* Finding the next header after a broken chain (`--resync`).
+ *
+ * On a damaged dump, a corrupted header (or a body that can't be read)
+ * would end the walk, and every entry after it would be lost.
+ * Instead, the data following the failure point is scanned for the magic,
+ * and the first match that also passes a few sanity checks
+ * (see `resync_find_header()`) is where the walk picks up again.
+ *
+ * Headers almost always start on a sector boundary, so those are checked
+ * first in each window, and only the bytes before the first
+ * good aligned header are then searched byte by byte (with SSE2,
+ * if available). Sectors that can't be read are treated as zeroes. */
+
+/* The alignment of the positions checked in the first pass (a sector) */
+#define RESYNC_STRIDE 512
+
+/* Returns the offset of the first valid-looking header at or after `from`
+ * in `fd` (of `file_size` bytes), or `file_size` if there is none.
+ * If `order` isn't `MTK_PART_BYTE_ORDER_UNKNOWN`, only headers
+ * in that byte order are accepted.
+ *
+ * A header is accepted if its magic is valid, its name is a printable,
+ * non-empty string, its extension (if it has one) is consistent,
+ * and its body fits in the file.
+ *
+ * `buf` (of `buf_size` bytes, at least `RESYNC_STRIDE`) is used
+ * to read the file in windows. */
+u64 resync_find_header(i32 fd, u64 from, u64 file_size,
+    enum mtk_part_byte_order order, u8 *buf, u64 buf_size);
+
+#endif /* RESYNC_H_ */
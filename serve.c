@@ -0,0 +1,1232 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "serve.h"
+#include "chainindex.h"
+#include "mtkpartdump.h"
+#include "mtkparthdr.h"
+#include "byteorder.h"
+#include "filter.h"
+#include "verify.h"
+#include "stats.h"
+#include "bufpool.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/vector.h>
+#include <core/hashmap.h>
+#include <core/spinlock.h>
+#include <core/threadpool.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define MODULE_NAME "serve"
+
+/* The maximum number of events handled per `epoll_wait()` call */
+#define SERVE_MAX_EVENTS 64
+
+/* The maximum number of file descriptors accepted in one message */
+#define SERVE_MAX_PASSED_FDS 4
+
+#define SERVE_OP_LIST   \
+    X_(PING, "ping")    \
+    X_(LIST, "list")    \
+    X_(EXTRACT, "extract") \
+    X_(VERIFY, "verify")   \
+
+#define X_(name, str) SERVE_OP_##name,
+enum serve_op {
+    SERVE_OP_LIST
+    SERVE_N_OPS_
+};
+#undef X_
+
+#define X_(name, str) str,
+static const char *const g_op_names[SERVE_N_OPS_] = {
+    SERVE_OP_LIST
+};
+#undef X_
+#undef SERVE_OP_LIST
+
+struct conn {
+    i32 fd;
+
+    /* A request from this connection is being handled by the pool.
+     * Until it's done, no further requests are parsed. */
+    bool busy;
+
+    /* The socket has been closed. The connection itself is only freed
+     * by `reap_conns()`, after the batch of events that may still
+     * refer to it, and once no request needs it anymore. */
+    bool closed;
+
+    /* The peer has shut down its sending side (e.g. `socat` at the end
+     * of its input). The requests already received are still answered,
+     * and the connection is closed once all the responses are sent. */
+    bool read_closed;
+
+    /* The `EPOLL*` events the socket is currently polled for */
+    u32 events;
+
+    /* The descriptor passed with the last message (`SCM_RIGHTS`), or -1 */
+    i32 passed_fd;
+
+    char in[SERVE_MAX_REQUEST_SIZE];
+    u32 in_len;
+
+    VECTOR(char) out;
+    u64 out_off;
+
+    /* The list of all open connections */
+    struct conn *prev, *next;
+};
+
+struct request {
+    struct server *srv;
+    struct conn *conn;
+
+    enum serve_op op;
+    char *path;
+    char *outdir;
+    char *only;
+    /* The raw JSON text of the `id` value (a valid number or string
+     * of at most `SERVE_MAX_ID_LEN` bytes), or `NULL` */
+    char *id;
+    /* `"fd": true` - work on the descriptor passed with the request
+     * instead of opening `path` */
+    bool use_fd;
+    i32 fd; /* Passed by the client, or -1 */
+
+    VECTOR(char) response;
+
+    /* The next request in the list of finished requests */
+    struct request *next;
+};
+
+/* Identifies a version of a file */
+struct file_key {
+    u64 dev;
+    u64 ino;
+    u64 size;
+    i64 mtime_sec;
+    i64 mtime_nsec;
+};
+
+struct cached_index {
+    /* One reference is held by the cache,
+     * and one by every request using the index */
+    _Atomic u32 refs;
+    struct chain_index ci;
+};
+
+struct server {
+    struct threadpool *tp;
+    struct threadpool_group group;
+
+    i32 listen_fd;
+    i32 epoll_fd;
+    i32 event_fd; /* Signaled whenever a request is finished */
+    i32 signal_fd;
+    struct conn *conns;
+    u32 n_conns;
+
+    /* Shutting down - no more requests are submitted to the pool */
+    bool stopping;
+
+    /* Requests finished by the pool, to be sent by the event loop */
+    hybridlock_t done_lock;
+    struct request *done_head;
+
+    hybridlock_t cache_lock;
+    struct hashmap *cache;
+    VECTOR(struct cached_index *) cached;
+    _Atomic u64 n_cache_hits;
+    _Atomic u64 n_cache_misses;
+};
+
+static i32 open_listen_socket(const char *socket_path);
+static void accept_conns(struct server *srv);
+static void read_conn(struct server *srv, struct conn *c);
+static void handle_lines(struct server *srv, struct conn *c);
+static void flush_conn(struct server *srv, struct conn *c);
+static void update_conn_events(struct server *srv, struct conn *c,
+    bool pending);
+static void close_conn(struct server *srv, struct conn *c);
+static void reap_conns(struct server *srv);
+static void finish_requests(struct server *srv);
+
+static i32 parse_request(struct request *req, const char *line, u32 len,
+    const char **o_error);
+static bool is_json_number(const char *str, u32 len);
+static void request_destroy(struct request *req);
+static void handle_request(void *arg);
+static void do_list(struct request *req, const struct cached_index *idx,
+    bool cached);
+static void do_extract(struct request *req, i32 fd,
+    const struct cached_index *idx);
+static void do_verify(struct request *req, i32 fd);
+
+static struct cached_index * get_index(struct server *srv, i32 fd,
+    bool *o_cached);
+static void release_index(struct cached_index *idx);
+static void clear_cache(struct server *srv);
+
+static void out_append(VECTOR(char) *out, const char *str, u64 len);
+static void out_printf(VECTOR(char) *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static void out_json_string(VECTOR(char) *out, const char *str, u64 max_len);
+static void out_begin_response(VECTOR(char) *out, const struct request *req);
+static void respond_error(struct request *req, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+i32 serve_run(const char *socket_path, struct threadpool *tp)
+{
+    u_check_params(socket_path != NULL && tp != NULL);
+
+    struct server srv = {
+        .tp = tp,
+        .group = THREADPOOL_GROUP_INIT,
+        .listen_fd = -1,
+        .epoll_fd = -1,
+        .event_fd = -1,
+        .signal_fd = -1,
+        .done_lock = HYBRIDLOCK_INIT,
+        .cache_lock = HYBRIDLOCK_INIT,
+    };
+    i32 ret = 1;
+    bool listening = false;
+
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &signals, &old_signals)) {
+        s_log_error("Failed to block SIGINT and SIGTERM");
+        return 1;
+    }
+    /* Writing to a socket whose peer is gone must not kill the daemon */
+    (void) signal(SIGPIPE, SIG_IGN);
+
+    srv.cache = hashmap_create(0);
+    if (srv.cache == NULL) {
+        s_log_error("Failed to create the index cache");
+        goto out;
+    }
+    srv.cached = vector_new(struct cached_index *);
+
+    srv.listen_fd = open_listen_socket(socket_path);
+    if (srv.listen_fd < 0)
+        goto out;
+    listening = true;
+
+    srv.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    srv.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    srv.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (srv.epoll_fd < 0 || srv.event_fd < 0 || srv.signal_fd < 0) {
+        s_log_error("Failed to set up the event loop: %s", strerror(errno));
+        goto out;
+    }
+
+    /* The non-connection descriptors are told apart by their address */
+    const i32 *const loop_fds[] = {
+        &srv.listen_fd, &srv.event_fd, &srv.signal_fd
+    };
+    for (u32 i = 0; i < u_arr_size(loop_fds); i++) {
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.ptr = (void *)loop_fds[i],
+        };
+        if (epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, *loop_fds[i], &ev)) {
+            s_log_error("Failed to add a descriptor to the event loop: %s",
+                strerror(errno));
+            goto out;
+        }
+    }
+
+    s_log_info("Listening on \"%s\" with %u worker threads",
+        socket_path, threadpool_get_n_workers(tp));
+
+    bool running = true;
+    while (running) {
+        struct epoll_event events[SERVE_MAX_EVENTS];
+        const i32 n = epoll_wait(srv.epoll_fd, events, SERVE_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            s_log_error("epoll_wait() failed: %s", strerror(errno));
+            goto out;
+        }
+
+        for (i32 i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &srv.listen_fd) {
+                accept_conns(&srv);
+            } else if (ptr == &srv.event_fd) {
+                u64 n_signaled;
+                (void) read(srv.event_fd, &n_signaled, sizeof(n_signaled));
+                finish_requests(&srv);
+            } else if (ptr == &srv.signal_fd) {
+                struct signalfd_siginfo si;
+                if (read(srv.signal_fd, &si, sizeof(si)) == sizeof(si))
+                    s_log_info("Got %s, stopping", strsignal(si.ssi_signo));
+                running = false;
+            } else {
+                struct conn *c = ptr;
+                if (!c->closed && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                    /* Gone in both directions - nobody to answer to */
+                    close_conn(&srv, c);
+                }
+                if (!c->closed && (events[i].events & EPOLLOUT))
+                    flush_conn(&srv, c);
+                if (!c->closed && (events[i].events & (EPOLLIN | EPOLLRDHUP)))
+                    read_conn(&srv, c);
+            }
+        }
+
+        /* Only now can nothing refer to the closed connections anymore */
+        reap_conns(&srv);
+    }
+
+    s_log_verbose("Index cache: %llu hits, %llu misses",
+        (unsigned long long)atomic_load(&srv.n_cache_hits),
+        (unsigned long long)atomic_load(&srv.n_cache_misses));
+    ret = 0;
+
+out:
+    /* Let the requests still in flight finish, then drop everything.
+     * Pipelined requests that haven't been started yet are dropped too,
+     * as nothing may outlive `srv`. */
+    srv.stopping = true;
+    threadpool_group_wait(tp, &srv.group);
+    if (srv.epoll_fd >= 0)
+        finish_requests(&srv);
+
+    if (srv.n_conns > 0)
+        s_log_verbose("Closing %u client connections", srv.n_conns);
+    for (struct conn *c = srv.conns; c != NULL; c = c->next)
+        close_conn(&srv, c);
+    reap_conns(&srv);
+
+    if (srv.cache != NULL) {
+        clear_cache(&srv);
+        hashmap_destroy(&srv.cache);
+    }
+    if (srv.cached != NULL)
+        vector_destroy(&srv.cached);
+
+    if (srv.signal_fd >= 0) (void) close(srv.signal_fd);
+    if (srv.event_fd >= 0) (void) close(srv.event_fd);
+    if (srv.epoll_fd >= 0) (void) close(srv.epoll_fd);
+    if (srv.listen_fd >= 0) (void) close(srv.listen_fd);
+    if (listening)
+        (void) unlink(socket_path);
+
+    (void) pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    return ret;
+}
+
+static i32 open_listen_socket(const char *socket_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        s_log_error("The socket path \"%s\" is too long", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    const i32 fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+        0);
+    if (fd < 0) {
+        s_log_error("Failed to create the socket: %s", strerror(errno));
+        return -1;
+    }
+
+    i32 bind_ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (bind_ret && errno == EADDRINUSE) {
+        /* Only replace the socket if nobody is listening on it anymore */
+        const i32 probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool in_use = probe >= 0 &&
+            connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0)
+            (void) close(probe);
+
+        if (in_use) {
+            s_log_error("Another server is already listening on \"%s\"",
+                socket_path);
+            (void) close(fd);
+            return -1;
+        }
+
+        s_log_verbose("Replacing the stale socket \"%s\"", socket_path);
+        (void) unlink(socket_path);
+        bind_ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    if (bind_ret || listen(fd, SOMAXCONN)) {
+        s_log_error("Failed to listen on \"%s\": %s",
+            socket_path, strerror(errno));
+        (void) close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void accept_conns(struct server *srv)
+{
+    for (;;) {
+        const i32 fd = accept4(srv->listen_fd, NULL, NULL,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                s_log_warn("Failed to accept a connection: %s",
+                    strerror(errno));
+            return;
+        }
+
+        if (srv->n_conns >= SERVE_MAX_CONNECTIONS) {
+            s_log_warn("Too many connections; refusing a new one");
+            (void) close(fd);
+            continue;
+        }
+
+        struct conn *c = calloc(1, sizeof(struct conn));
+        s_assert(c != NULL, "calloc() failed for a connection");
+        c->fd = fd;
+        c->passed_fd = -1;
+        c->out = vector_new(char);
+        c->events = EPOLLIN | EPOLLRDHUP;
+
+        struct epoll_event ev = { .events = c->events, .data.ptr = c };
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+            s_log_warn("Failed to add a connection to the event loop: %s",
+                strerror(errno));
+            vector_destroy(&c->out);
+            free(c);
+            (void) close(fd);
+            continue;
+        }
+        c->next = srv->conns;
+        if (srv->conns != NULL)
+            srv->conns->prev = c;
+        srv->conns = c;
+        srv->n_conns++;
+        s_log_debug("New connection (%u open)", srv->n_conns);
+    }
+}
+
+static void read_conn(struct server *srv, struct conn *c)
+{
+    while (!c->read_closed) {
+        if (c->in_len == SERVE_MAX_REQUEST_SIZE) {
+            /* The lines already in the buffer have to be handled first
+             * (the socket isn't polled for input until they are) */
+            if (c->busy || memchr(c->in, '\n', c->in_len) != NULL)
+                break;
+
+            s_log_warn("A request is longer than %u bytes; "
+                "dropping the connection", SERVE_MAX_REQUEST_SIZE);
+            close_conn(srv, c);
+            return;
+        }
+
+        union {
+            struct cmsghdr hdr;
+            char buf[CMSG_SPACE(SERVE_MAX_PASSED_FDS * sizeof(i32))];
+        } control;
+        struct iovec iov = {
+            .iov_base = c->in + c->in_len,
+            .iov_len = SERVE_MAX_REQUEST_SIZE - c->in_len,
+        };
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof(control.buf),
+        };
+
+        const ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n < 0) {
+            close_conn(srv, c);
+            return;
+        }
+        if (n == 0) {
+            /* An unterminated last line is still a request */
+            if (c->in_len > 0 && c->in[c->in_len - 1] != '\n' &&
+                c->in_len < SERVE_MAX_REQUEST_SIZE)
+            {
+                c->in[c->in_len++] = '\n';
+            }
+            c->read_closed = true;
+            break;
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+            cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            const u32 n_fds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(i32);
+            for (u32 i = 0; i < n_fds; i++) {
+                i32 fd;
+                memcpy(&fd, CMSG_DATA(cm) + i * sizeof(i32), sizeof(i32));
+                /* Only the most recent one is kept */
+                if (c->passed_fd >= 0)
+                    (void) close(c->passed_fd);
+                c->passed_fd = fd;
+            }
+        }
+
+        c->in_len += n;
+    }
+
+    handle_lines(srv, c);
+}
+
+static void handle_lines(struct server *srv, struct conn *c)
+{
+    while (!c->busy && !srv->stopping) {
+        char *nl = memchr(c->in, '\n', c->in_len);
+        if (nl == NULL)
+            break;
+
+        const u32 line_len = nl - c->in;
+        struct request *req = calloc(1, sizeof(struct request));
+        s_assert(req != NULL, "calloc() failed for a request");
+        req->srv = srv;
+        req->conn = c;
+        req->fd = -1;
+        req->response = vector_new(char);
+
+        const char *error = NULL;
+        const bool empty = line_len == 0 ||
+            (line_len == 1 && c->in[0] == '\r');
+        if (!empty && parse_request(req, c->in, line_len, &error))
+            respond_error(req, "invalid request: %s", error);
+
+        c->in_len -= line_len + 1;
+        memmove(c->in, nl + 1, c->in_len);
+
+        if (empty) {
+            request_destroy(req);
+            continue;
+        }
+
+        if (vector_size(req->response) > 0) {
+            /* Rejected by the parser - answer right away */
+            out_append(&c->out, req->response, vector_size(req->response));
+            request_destroy(req);
+            continue;
+        }
+
+        /* The passed descriptor (if any) belongs to the request from now on */
+        if (req->use_fd) {
+            req->fd = c->passed_fd;
+            c->passed_fd = -1;
+        }
+
+        c->busy = true;
+        threadpool_submit(srv->tp, &srv->group, handle_request, req);
+    }
+
+    flush_conn(srv, c);
+}
+
+static void flush_conn(struct server *srv, struct conn *c)
+{
+    while (c->out_off < vector_size(c->out)) {
+        const ssize_t n = send(c->fd, c->out + c->out_off,
+            vector_size(c->out) - c->out_off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n < 0) {
+            close_conn(srv, c);
+            return;
+        }
+        c->out_off += n;
+    }
+
+    const bool pending = c->out_off < vector_size(c->out);
+    if (!pending) {
+        vector_clear_nozero(&c->out);
+        c->out_off = 0;
+    }
+
+    /* After a half-close, everything has been answered once nothing
+     * is in flight (`handle_lines()` has taken all the complete lines) */
+    if (c->read_closed && !c->busy && !pending) {
+        close_conn(srv, c);
+        return;
+    }
+
+    update_conn_events(srv, c, pending);
+}
+
+static void update_conn_events(struct server *srv, struct conn *c,
+    bool pending)
+{
+    /* Input is level-triggered, so it must not be polled for when
+     * it can't be read: after a half-close, or while the buffer
+     * is full and waiting for the current request */
+    const bool can_read = !c->read_closed &&
+        !(c->busy && c->in_len == SERVE_MAX_REQUEST_SIZE);
+    const u32 events = (can_read ? EPOLLIN | EPOLLRDHUP : 0) |
+        (pending ? EPOLLOUT : 0);
+
+    if (events != c->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = c };
+        (void) epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+static void close_conn(struct server *srv, struct conn *c)
+{
+    if (c->closed)
+        return;
+
+    (void) epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    (void) close(c->fd);
+    c->fd = -1;
+    if (c->passed_fd >= 0) {
+        (void) close(c->passed_fd);
+        c->passed_fd = -1;
+    }
+    c->closed = true;
+}
+
+static void reap_conns(struct server *srv)
+{
+    struct conn *c = srv->conns;
+    while (c != NULL) {
+        struct conn *next = c->next;
+
+        /* A request still in flight needs the connection to report back to */
+        if (c->closed && !c->busy) {
+            if (c->prev != NULL)
+                c->prev->next = c->next;
+            else
+                srv->conns = c->next;
+            if (c->next != NULL)
+                c->next->prev = c->prev;
+
+            vector_destroy(&c->out);
+            free(c);
+            srv->n_conns--;
+            s_log_debug("Connection closed (%u open)", srv->n_conns);
+        }
+
+        c = next;
+    }
+}
+
+static void finish_requests(struct server *srv)
+{
+    hybridlock_acquire(&srv->done_lock);
+    struct request *req = srv->done_head;
+    srv->done_head = NULL;
+    hybridlock_release(&srv->done_lock);
+
+    while (req != NULL) {
+        struct request *next = req->next;
+        struct conn *c = req->conn;
+        c->busy = false;
+
+        /* A closed connection is freed by the next `reap_conns()` */
+        if (!c->closed) {
+            out_append(&c->out, req->response, vector_size(req->response));
+            /* Also picks up any requests that were queued up meanwhile */
+            handle_lines(srv, c);
+        }
+
+        request_destroy(req);
+        req = next;
+    }
+}
+
+/* Parses a JSON string starting right after its opening quote at `*p`.
+ * Only escapes of code points below U+0800 are supported. */
+static char * parse_json_string(const char **p, const char *end)
+{
+    VECTOR(char) str = vector_new(char);
+    const char *s = *p;
+
+    while (s < end && *s != '"') {
+        char ch = *s++;
+        if ((u8)ch < 0x20)
+            goto err;
+        if (ch != '\\') {
+            vector_push_back(&str, ch);
+            continue;
+        }
+
+        if (s >= end)
+            goto err;
+        switch (*s++) {
+        case '"': ch = '"'; break;
+        case '\\': ch = '\\'; break;
+        case '/': ch = '/'; break;
+        case 'b': ch = '\b'; break;
+        case 'f': ch = '\f'; break;
+        case 'n': ch = '\n'; break;
+        case 'r': ch = '\r'; break;
+        case 't': ch = '\t'; break;
+        case 'u': {
+            if (end - s < 4)
+                goto err;
+            char hex[5] = { s[0], s[1], s[2], s[3], '\0' };
+            char *hex_end = NULL;
+            const unsigned long cp = strtoul(hex, &hex_end, 16);
+            if (hex_end != hex + 4 || cp == 0 || cp >= 0x800)
+                goto err;
+            s += 4;
+            if (cp >= 0x80) {
+                vector_push_back(&str, (char)(0xC0 | (cp >> 6)));
+                ch = (char)(0x80 | (cp & 0x3F));
+            } else {
+                ch = (char)cp;
+            }
+            break;
+        }
+        default:
+            goto err;
+        }
+        vector_push_back(&str, ch);
+    }
+    if (s >= end)
+        goto err;
+
+    *p = s + 1;
+
+    char *ret = malloc(vector_size(str) + 1);
+    s_assert(ret != NULL, "malloc() failed for a string");
+    memcpy(ret, str, vector_size(str));
+    ret[vector_size(str)] = '\0';
+    vector_destroy(&str);
+    return ret;
+
+err:
+    vector_destroy(&str);
+    return NULL;
+}
+
+static const char * skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+#define parse_fail(msg) do { *o_error = msg; goto err; } while (0)
+
+/* Parses a flat JSON object (string, number, boolean and null values only).
+ * Unknown keys are ignored. */
+static i32 parse_request(struct request *req, const char *line, u32 len,
+    const char **o_error)
+{
+    const char *p = line, *end = line + len;
+    char *key = NULL, *op = NULL, *str = NULL;
+
+    p = skip_ws(p, end);
+    if (p >= end || *p++ != '{')
+        parse_fail("expected an object");
+
+    p = skip_ws(p, end);
+    bool first = true;
+    while (p < end && *p != '}') {
+        if (!first) {
+            if (*p++ != ',')
+                parse_fail("expected ','");
+            p = skip_ws(p, end);
+        }
+        first = false;
+
+        if (p >= end || *p++ != '"' || (key = parse_json_string(&p, end)) == NULL)
+            parse_fail("expected a string key");
+        p = skip_ws(p, end);
+        if (p >= end || *p++ != ':')
+            parse_fail("expected ':'");
+        p = skip_ws(p, end);
+        if (p >= end)
+            parse_fail("expected a value");
+
+        const char *value_start = p;
+        if (*p == '"') {
+            p++;
+            if ((str = parse_json_string(&p, end)) == NULL)
+                parse_fail("invalid string");
+        } else {
+            while (p < end && *p != ',' && *p != '}' && *p != ' ')
+                p++;
+            if (p == value_start)
+                parse_fail("expected a value");
+        }
+        const u32 value_len = p - value_start;
+
+        char **dst = NULL;
+        if (!strcmp(key, "op")) dst = &op;
+        else if (!strcmp(key, "path")) dst = &req->path;
+        else if (!strcmp(key, "outdir")) dst = &req->outdir;
+        else if (!strcmp(key, "only")) dst = &req->only;
+
+        if (dst != NULL) {
+            if (str == NULL)
+                parse_fail("expected a string value");
+            free(*dst);
+            *dst = str;
+            str = NULL;
+        } else if (!strcmp(key, "id")) {
+            /* Echoed back verbatim, so it must be valid JSON on its own */
+            if (value_len > SERVE_MAX_ID_LEN ||
+                (str == NULL && !is_json_number(value_start, value_len)))
+            {
+                parse_fail("\"id\" must be a number or a short string");
+            }
+            free(req->id);
+            req->id = strndup(value_start, value_len);
+            s_assert(req->id != NULL, "strndup() failed for the id");
+        } else if (!strcmp(key, "fd")) {
+            req->use_fd = value_len == 4 && !strncmp(value_start, "true", 4);
+        }
+        u_nfree(&str);
+        u_nfree(&key);
+
+        p = skip_ws(p, end);
+    }
+    if (p >= end)
+        parse_fail("expected '}'");
+
+    if (op == NULL)
+        parse_fail("missing \"op\"");
+    req->op = SERVE_N_OPS_;
+    for (u32 i = 0; i < SERVE_N_OPS_; i++) {
+        if (!strcmp(op, g_op_names[i]))
+            req->op = i;
+    }
+    if (req->op == SERVE_N_OPS_)
+        parse_fail("unknown \"op\"");
+
+    /* With `"fd": true`, the path isn't needed (or used) */
+    if (!req->use_fd && req->op != SERVE_OP_PING && req->path == NULL)
+        parse_fail("missing \"path\" (or \"fd\": true)");
+    else if (!req->use_fd && req->path != NULL && req->path[0] != '/')
+        parse_fail("\"path\" must be absolute");
+
+    if (req->op == SERVE_OP_EXTRACT &&
+        (req->outdir == NULL || req->outdir[0] != '/'))
+    {
+        parse_fail("\"extract\" needs an absolute \"outdir\"");
+    }
+
+    free(op);
+    return 0;
+
+err:
+    free(str);
+    free(key);
+    free(op);
+    return 1;
+}
+#undef parse_fail
+
+static bool is_json_number(const char *str, u32 len)
+{
+    const char *p = str, *end = str + len;
+
+#define digits_() do {                                      \
+        if (p >= end || *p < '0' || *p > '9')               \
+            return false;                                   \
+        while (p < end && *p >= '0' && *p <= '9')           \
+            p++;                                            \
+    } while (0)
+
+    if (p < end && *p == '-')
+        p++;
+    digits_();
+    if (p < end && *p == '.') {
+        p++;
+        digits_();
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+            p++;
+        digits_();
+    }
+#undef digits_
+
+    return p == end;
+}
+
+static void request_destroy(struct request *req)
+{
+    if (req->fd >= 0)
+        (void) close(req->fd);
+    free(req->path);
+    free(req->outdir);
+    free(req->only);
+    free(req->id);
+    vector_destroy(&req->response);
+    free(req);
+}
+
+static void handle_request(void *arg)
+{
+    struct request *req = arg;
+    struct server *srv = req->srv;
+
+    i32 fd = req->fd;
+    if (req->op == SERVE_OP_PING) {
+        out_begin_response(&req->response, req);
+        out_printf(&req->response, "\"ok\":true}\n");
+        goto done;
+    }
+
+    if (req->use_fd && fd < 0) {
+        respond_error(req, "no file descriptor was passed");
+        goto done;
+    } else if (fd < 0) {
+        fd = open(req->path, O_RDONLY | O_CLOEXEC);
+        stats_add(STATS_SYSCALLS, 1);
+        if (fd < 0) {
+            respond_error(req, "failed to open \"%s\": %s",
+                req->path, strerror(errno));
+            goto done;
+        }
+    }
+
+    if (req->op == SERVE_OP_VERIFY) {
+        do_verify(req, fd);
+    } else {
+        bool cached = false;
+        struct cached_index *idx = get_index(srv, fd, &cached);
+        if (idx == NULL) {
+            respond_error(req, "not an MTK partition file");
+        } else {
+            if (req->op == SERVE_OP_LIST)
+                do_list(req, idx, cached);
+            else
+                do_extract(req, fd, idx);
+            release_index(idx);
+        }
+    }
+
+    if (fd != req->fd)
+        (void) close(fd);
+
+done:
+    hybridlock_acquire(&srv->done_lock);
+    req->next = srv->done_head;
+    srv->done_head = req;
+    hybridlock_release(&srv->done_lock);
+
+    const u64 one = 1;
+    (void) write(srv->event_fd, &one, sizeof(one));
+}
+
+static void do_list(struct request *req, const struct cached_index *idx,
+    bool cached)
+{
+    VECTOR(char) *out = &req->response;
+    const struct chain_index *ci = &idx->ci;
+
+    out_begin_response(out, req);
+    out_printf(out, "\"ok\":true,\"byte_order\":\"%s\",\"complete\":%s,"
+        "\"cached\":%s,\"entries\":[",
+        mtk_part_byte_order_string(ci->byte_order),
+        ci->complete ? "true" : "false", cached ? "true" : "false");
+
+    for (u64 i = 0; i < vector_size(ci->entries); i++) {
+        const struct chain_entry *e = &ci->entries[i];
+        const bool has_ext = e->hdr.ext.magic == MTK_PART_EXT_MAGIC;
+
+        out_printf(out, "%s{\"index\":%llu,\"name\":", i > 0 ? "," : "",
+            (unsigned long long)i);
+        out_json_string(out, e->hdr.part_name, MTK_PART_NAME_LEN);
+        out_printf(out, ",\"type\":\"%s\",\"hdr_offset\":%llu,"
+            "\"size\":%llu,\"memory_address\":%llu}",
+            has_ext ? mtkpart_img_type_string(e->hdr.ext.img_type) : "N/A",
+            (unsigned long long)e->hdr_offset,
+            (unsigned long long)get_full_part_size(&e->hdr),
+            (unsigned long long)(has_ext ?
+                ((u64)e->hdr.ext.memory_address_hi << 32) : 0)
+                | e->hdr.memory_address);
+    }
+    out_printf(out, "]}\n");
+}
+
+static void do_extract(struct request *req, i32 fd,
+    const struct cached_index *idx)
+{
+    struct part_filter filter = { 0 };
+    const bool use_filter = req->only != NULL;
+    if (use_filter && part_filter_init(&filter, req->only, NULL)) {
+        respond_error(req, "invalid \"only\" filter");
+        return;
+    }
+
+    i32 dirfd = -1;
+    u8 *buf = NULL;
+    u32 n_extracted = 0;
+
+    if (mkdir(req->outdir, 0755) && errno != EEXIST) {
+        respond_error(req, "failed to create \"%s\": %s",
+            req->outdir, strerror(errno));
+        goto out;
+    }
+    dirfd = open(req->outdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    stats_add(STATS_SYSCALLS, 2);
+    if (dirfd < 0) {
+        respond_error(req, "failed to open \"%s\": %s",
+            req->outdir, strerror(errno));
+        goto out;
+    }
+
+    buf = bufpool_get();
+    if (buf == NULL) {
+        respond_error(req, "failed to get a copy buffer");
+        goto out;
+    }
+
+    for (u64 i = 0; i < vector_size(idx->ci.entries); i++) {
+        const struct chain_entry *e = &idx->ci.entries[i];
+        if (use_filter && !part_filter_match(&filter, &e->hdr))
+            continue;
+
+        if (mtkpart_extract_part(fd, e->hdr_offset, &e->hdr, i, dirfd, buf,
+                NULL))
+        {
+            respond_error(req, "failed to extract entry %llu (\"%.32s\")",
+                (unsigned long long)i, e->hdr.part_name);
+            goto out;
+        }
+        n_extracted++;
+    }
+
+    out_begin_response(&req->response, req);
+    out_printf(&req->response, "\"ok\":true,\"extracted\":%u}\n",
+        n_extracted);
+
+out:
+    bufpool_put(buf);
+    if (dirfd >= 0)
+        (void) close(dirfd);
+    if (use_filter)
+        part_filter_destroy(&filter);
+}
+
+static void do_verify(struct request *req, i32 fd)
+{
+    /* `verify` works on paths, so go through procfs for passed descriptors */
+    char fd_path[32];
+    const char *path = req->path;
+    if (req->use_fd) {
+        (void) snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+        path = fd_path;
+    }
+
+    const u32 problems = verify_file_problems(path, req->srv->tp);
+
+    VECTOR(char) *out = &req->response;
+    out_begin_response(out, req);
+    out_printf(out, "\"ok\":true,\"pass\":%s,\"problems\":[",
+        problems == 0 ? "true" : "false");
+
+    bool first = true;
+    for (u32 bit = 0; bit < VERIFY_N_PROBLEMS_; bit++) {
+        if (problems & (1U << bit)) {
+            out_printf(out, "%s", first ? "" : ",");
+            const char *desc = verify_problem_string(bit);
+            out_json_string(out, desc, strlen(desc));
+            first = false;
+        }
+    }
+    out_printf(out, "]}\n");
+}
+
+static struct cached_index * get_index(struct server *srv, i32 fd,
+    bool *o_cached)
+{
+    struct stat st;
+    stats_add(STATS_SYSCALLS, 1);
+    if (fstat(fd, &st))
+        return NULL;
+
+    struct file_key key;
+    memset(&key, 0, sizeof(key));
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.size = st.st_size;
+    key.mtime_sec = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+
+    hybridlock_acquire(&srv->cache_lock);
+    struct cached_index *idx =
+        hashmap_lookup_bytes(srv->cache, &key, sizeof(key));
+    if (idx != NULL)
+        atomic_fetch_add(&idx->refs, 1);
+    hybridlock_release(&srv->cache_lock);
+
+    if (idx != NULL) {
+        atomic_fetch_add_explicit(&srv->n_cache_hits, 1, memory_order_relaxed);
+        *o_cached = true;
+        return idx;
+    }
+    atomic_fetch_add_explicit(&srv->n_cache_misses, 1, memory_order_relaxed);
+    *o_cached = false;
+
+    /* Built outside of the lock, as it does I/O */
+    idx = calloc(1, sizeof(struct cached_index));
+    s_assert(idx != NULL, "calloc() failed for a cached index");
+    if (chain_index_build(&idx->ci, fd)) {
+        free(idx);
+        return NULL;
+    }
+    atomic_init(&idx->refs, 2); /* The cache's and ours */
+
+    hybridlock_acquire(&srv->cache_lock);
+    struct cached_index *existing =
+        hashmap_lookup_bytes(srv->cache, &key, sizeof(key));
+    if (existing != NULL) {
+        /* Someone else was faster - use theirs */
+        atomic_fetch_add(&existing->refs, 1);
+        hybridlock_release(&srv->cache_lock);
+        chain_index_destroy(&idx->ci);
+        free(idx);
+        return existing;
+    }
+
+    if (vector_size(srv->cached) >= SERVE_CACHE_MAX_FILES) {
+        s_log_verbose("The index cache is full; dropping it");
+        clear_cache(srv);
+    }
+    if (hashmap_insert_bytes(srv->cache, &key, sizeof(key), idx)) {
+        /* Not cached after all */
+        atomic_fetch_sub(&idx->refs, 1);
+    } else {
+        vector_push_back(&srv->cached, idx);
+    }
+    hybridlock_release(&srv->cache_lock);
+
+    return idx;
+}
+
+static void release_index(struct cached_index *idx)
+{
+    if (atomic_fetch_sub(&idx->refs, 1) == 1) {
+        chain_index_destroy(&idx->ci);
+        free(idx);
+    }
+}
+
+/* Must be called with `cache_lock` held (or without any other threads) */
+static void clear_cache(struct server *srv)
+{
+    for (u64 i = 0; i < vector_size(srv->cached); i++)
+        release_index(srv->cached[i]);
+    vector_clear_nozero(&srv->cached);
+
+    /* Recreated to also drop the stored keys */
+    hashmap_destroy(&srv->cache);
+    srv->cache = hashmap_create(0);
+    s_assert(srv->cache != NULL, "Failed to recreate the index cache");
+}
+
+static void out_append(VECTOR(char) *out, const char *str, u64 len)
+{
+    if (len > 0)
+        vector_push_back_n(out, str, len);
+}
+
+static void out_printf(VECTOR(char) *out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    const i32 len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    s_assert(len >= 0 && (u32)len < sizeof(buf),
+        "a response fragment is too long (%d bytes)", len);
+
+    out_append(out, buf, len);
+}
+
+static void out_json_string(VECTOR(char) *out, const char *str, u64 max_len)
+{
+    out_append(out, "\"", 1);
+    for (u64 i = 0; i < max_len && str[i] != '\0'; i++) {
+        const u8 ch = str[i];
+        if (ch == '"' || ch == '\\') {
+            const char esc[2] = { '\\', (char)ch };
+            out_append(out, esc, 2);
+        } else if (ch < 0x20 || ch >= 0x7F) {
+            /* Part names aren't guaranteed to be UTF-8, so escape
+             * everything that isn't plain ASCII */
+            out_printf(out, "\\u%04x", ch);
+        } else {
+            out_append(out, (const char *)&ch, 1);
+        }
+    }
+    out_append(out, "\"", 1);
+}
+
+/* Starts a response object, with the request's `id` (if it had one) */
+static void out_begin_response(VECTOR(char) *out, const struct request *req)
+{
+    out_append(out, "{", 1);
+    if (req->id != NULL) {
+        out_append(out, "\"id\":", 5);
+        out_append(out, req->id, strlen(req->id));
+        out_append(out, ",", 1);
+    }
+}
+
+static void respond_error(struct request *req, const char *fmt, ...)
+{
+    char msg[512];
+    va_list ap;
+    va_start(ap, fmt);
+    (void) vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    vector_clear_nozero(&req->response);
+    out_begin_response(&req->response, req);
+    out_printf(&req->response, "\"ok\":false,\"error\":");
+    out_json_string(&req->response, msg, sizeof(msg));
+    out_printf(&req->response, "}\n");
+}
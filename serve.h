@@ -0,0 +1,71 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef SERVE_H_
+#define SERVE_H_
+
+#include <core/int.h>
+#include <core/threadpool.h>
+
+/* Daemon mode (`--serve SOCKET`).
+ *
+ * Listens on the Unix stream socket `SOCKET` and answers requests
+ * until it gets `SIGINT` or `SIGTERM`. All the sockets are driven by
+ * a single `epoll` loop on the calling thread, while the requests
+ * themselves run as tasks on the (already warm) thread pool.
+ *
+ * Requests and responses are single-line JSON objects, one per line.
+ * A connection can send any number of requests, which are answered
+ * in order, e.g.:
+ *
+ *   {"op": "list", "path": "/fw/lk.bin", "id": 1}
+ *   {"op": "extract", "path": "/fw/md1img.bin", "outdir": "/tmp/md1",
+ *       "only": "md1rom,cert*"}
+ *   {"op": "verify", "path": "/fw/lk.bin"}
+ *   {"op": "ping"}
+ *
+ * Instead of a `path`, a client can pass an open file descriptor
+ * (`SCM_RIGHTS`) along with the request and set `"fd": true`.
+ * Paths must be absolute, and the parent of an `outdir` must exist.
+ * The `id` (if any) is echoed back in the response, which always
+ * has `"ok": true` or `"ok": false` with an `"error"`.
+ *
+ * The chain indexes of the files seen so far are cached (keyed by
+ * device, inode, size and modification time, so changed files are
+ * re-read), which makes repeated `list`s and `extract`s of the same file
+ * skip all the header reads. */
+
+/* The maximum length of a single request line */
+#define SERVE_MAX_REQUEST_SIZE (16 * 1024)
+
+/* The maximum length of a request's `id` (as it appears in the request,
+ * quotes included for strings) */
+#define SERVE_MAX_ID_LEN 64
+
+/* The maximum number of open client connections */
+#define SERVE_MAX_CONNECTIONS 1024
+
+/* The maximum number of cached chain indexes.
+ * When it's reached, the whole cache is dropped. */
+#define SERVE_CACHE_MAX_FILES 4096
+
+/* Serves requests on the socket `socket_path` (which is created,
+ * replacing any stale socket there) using `tp`,
+ * until the process receives `SIGINT` or `SIGTERM`.
+ * Returns 0 when stopped by a signal and non-zero on failure. */
+i32 serve_run(const char *socket_path, struct threadpool *tp);
+
+#endif /* SERVE_H_ */
@@ -0,0 +1,149 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#define STATS_LIST_DEF__
+#include "stats.h"
+#undef STATS_LIST_DEF__
+#include <core/log.h>
+#include <core/spinlock.h>
+#include <core/int.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define MODULE_NAME "stats"
+
+static _Atomic bool g_enabled = ATOMIC_VAR_INIT(false);
+
+static _Atomic u64 g_counters[STATS_N_COUNTERS_];
+static _Atomic u64 g_phase_calls[STATS_N_PHASES_];
+static _Atomic u64 g_phase_ns[STATS_N_PHASES_];
+
+#define X_(name, desc) [STATS_##name] = desc,
+static const char *const g_counter_names[STATS_N_COUNTERS_] = {
+    STATS_COUNTER_LIST
+};
+#undef X_
+
+#define X_(name, desc) [STATS_PHASE_##name] = desc,
+static const char *const g_phase_names[STATS_N_PHASES_] = {
+    STATS_PHASE_LIST
+};
+#undef X_
+
+#undef STATS_COUNTER_LIST
+#undef STATS_PHASE_LIST
+
+static u64 now_ns(void);
+
+void stats_enable(bool enable)
+{
+    atomic_store_explicit(&g_enabled, enable, memory_order_relaxed);
+}
+
+bool stats_enabled(void)
+{
+    return atomic_load_explicit(&g_enabled, memory_order_relaxed);
+}
+
+void stats_add(enum stats_counter counter, u64 n)
+{
+    atomic_fetch_add_explicit(&g_counters[counter], n, memory_order_relaxed);
+}
+
+u64 stats_phase_begin(void)
+{
+    if (!atomic_load_explicit(&g_enabled, memory_order_relaxed))
+        return 0;
+
+    return now_ns();
+}
+
+void stats_phase_end(enum stats_phase phase, u64 start)
+{
+    if (start == 0)
+        return;
+
+    const u64 elapsed = now_ns() - start;
+    atomic_fetch_add_explicit(&g_phase_calls[phase], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_phase_ns[phase], elapsed,
+        memory_order_relaxed);
+}
+
+void stats_snapshot(struct stats_snapshot *o)
+{
+    for (u32 i = 0; i < STATS_N_COUNTERS_; i++)
+        o->counters[i] =
+            atomic_load_explicit(&g_counters[i], memory_order_relaxed);
+
+    for (u32 i = 0; i < STATS_N_PHASES_; i++) {
+        o->phases[i].n_calls =
+            atomic_load_explicit(&g_phase_calls[i], memory_order_relaxed);
+        o->phases[i].total_ns =
+            atomic_load_explicit(&g_phase_ns[i], memory_order_relaxed);
+    }
+}
+
+void stats_print_summary(const char *title,
+    const struct stats_snapshot *since)
+{
+    struct stats_snapshot curr = { 0 };
+    stats_snapshot(&curr);
+
+    if (since != NULL) {
+        for (u32 i = 0; i < STATS_N_COUNTERS_; i++)
+            curr.counters[i] -= since->counters[i];
+        for (u32 i = 0; i < STATS_N_PHASES_; i++) {
+            curr.phases[i].n_calls -= since->phases[i].n_calls;
+            curr.phases[i].total_ns -= since->phases[i].total_ns;
+        }
+    }
+
+    s_log_info("===== Statistics: %s =====", title);
+    for (u32 i = 0; i < STATS_N_COUNTERS_; i++) {
+        s_log_info("%-24s %llu", g_counter_names[i],
+            (unsigned long long)curr.counters[i]);
+    }
+
+    u64 total_ns = 0;
+    for (u32 i = 0; i < STATS_N_PHASES_; i++) {
+        const struct stats_phase_data *p = &curr.phases[i];
+        total_ns += p->total_ns;
+        s_log_info("%-24s %10.3f ms (%llu calls)", g_phase_names[i],
+            (f64)p->total_ns / 1e6, (unsigned long long)p->n_calls);
+    }
+    s_log_info("%-24s %10.3f ms", "total (timed phases)", (f64)total_ns / 1e6);
+
+    /* The lock counters are process-wide, so they're only printed
+     * in the overall summary */
+    if (since == NULL) {
+        for (u32 i = 0; i < SPINLOCK_N_COUNTERS_; i++) {
+            s_log_info("lock: %-18s %llu", spinlock_get_counter_name(i),
+                (unsigned long long)spinlock_get_counter(i));
+        }
+    }
+}
+
+static u64 now_ns(void)
+{
+    struct timespec ts = { 0 };
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    /* Never return 0, as that means "timings disabled" */
+    return ((u64)ts.tv_sec * 1000000000ULL) + (u64)ts.tv_nsec + 1;
+}
@@ -0,0 +1,102 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <core/int.h>
+#include <stdbool.h>
+
+/* Run-time statistics (`--stats`).
+ *
+ * The counters are plain relaxed atomics and are always updated,
+ * so they cost next to nothing and can be left on in production.
+ * The phase timings need a monotonic clock read on both ends of each phase,
+ * so they are only collected when enabled with `stats_enable()`. */
+
+#define STATS_COUNTER_LIST                                                  \
+    X_(BYTES_READ, "bytes read")                                            \
+    X_(BYTES_WRITTEN, "bytes written")                                      \
+    X_(BYTES_SKIPPED, "body bytes skipped")                                 \
+    X_(HEADERS, "headers seen")                                             \
+    X_(FILES_PROCESSED, "input files processed")                            \
+    X_(FILES_CREATED, "output files created")                               \
+    X_(SYSCALLS, "I/O calls issued")                                        \
+    X_(DIRS_WALKED, "directories walked")                                   \
+    X_(FILES_REJECTED, "non-MTK files skipped")                             \
+    X_(BUFFER_WAITS, "waits for an I/O buffer")                             \
+    X_(BYTES_RESYNCED, "bytes skipped by --resync")                         \
+
+#define STATS_PHASE_LIST                                                    \
+    X_(HDR_READ, "header read")                                             \
+    X_(PARSE_PRINT, "header parse/print")                                   \
+    X_(EXTRACT_READ, "extraction read")                                     \
+    X_(EXTRACT_WRITE, "extraction write")                                   \
+    X_(FILE_OPEN, "file open")                                              \
+    X_(FILE_CLOSE, "file close")                                            \
+
+#define X_(name, desc) STATS_##name,
+enum stats_counter {
+    STATS_COUNTER_LIST
+    STATS_N_COUNTERS_
+};
+#undef X_
+
+#define X_(name, desc) STATS_PHASE_##name,
+enum stats_phase {
+    STATS_PHASE_LIST
+    STATS_N_PHASES_
+};
+#undef X_
+
+/* A copy of all the statistics at some point in time */
+struct stats_snapshot {
+    u64 counters[STATS_N_COUNTERS_];
+    struct stats_phase_data {
+        u64 n_calls;
+        u64 total_ns;
+    } phases[STATS_N_PHASES_];
+};
+
+/* Enables or disables the collection of phase timings */
+void stats_enable(bool enable);
+bool stats_enabled(void);
+
+/* Adds `n` to `counter` */
+void stats_add(enum stats_counter counter, u64 n);
+
+/* Returns the timestamp to be passed to `stats_phase_end()`
+ * (or 0 if timings are disabled) */
+u64 stats_phase_begin(void);
+
+/* Accounts the time elapsed since `start` to `phase` */
+void stats_phase_end(enum stats_phase phase, u64 start);
+
+/* Stores the current values of all the statistics in `o` */
+void stats_snapshot(struct stats_snapshot *o);
+
+/* Logs the statistics accumulated since `since`
+ * (or since the start of the program if `since` is `NULL`).
+ * `title` is printed in the first line of the summary. */
+void stats_print_summary(const char *title,
+    const struct stats_snapshot *since);
+
+#ifndef STATS_LIST_DEF__
+#undef STATS_COUNTER_LIST
+#undef STATS_PHASE_LIST
+#endif /* STATS_LIST_DEF__ */
+
+#endif /* STATS_H_ */
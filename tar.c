@@ -0,0 +1,285 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "tar.h"
+#include "io.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MODULE_NAME "tar"
+
+#define TAR_BLOCK_SIZE 512
+
+/* The largest size that fits in the (11-digit octal) ustar size field */
+#define TAR_MAX_USTAR_SIZE 077777777777ULL
+
+#define TAR_TYPE_FILE '0'
+#define TAR_TYPE_DIR '5'
+#define TAR_TYPE_PAX 'x'
+
+struct ustar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad_[12];
+};
+static_assert(sizeof(struct ustar_header) == TAR_BLOCK_SIZE,
+    "The ustar header must be exactly one block");
+
+static i32 write_header(struct tar_writer *w, char type, const char *name,
+    u64 size, u32 mode);
+static i32 write_pax_header(struct tar_writer *w, const char *path, u64 size);
+static void fill_header(struct ustar_header *h, char type, const char *name,
+    u64 size, u32 mode, u32 mtime);
+static u64 append_pax_record(char *buf, u64 buf_size, u64 pos,
+    const char *key, const char *value);
+static i32 put(struct tar_writer *w, const void *buf, u64 size);
+static i32 pad_block(struct tar_writer *w);
+
+i32 tar_writer_init(struct tar_writer *w, i32 fd)
+{
+    u_check_params(w != NULL && fd >= 0);
+    memset(w, 0, sizeof(struct tar_writer));
+    w->fd = fd;
+    const time_t now = time(NULL);
+    w->mtime = now > 0 ? (u32)now : 0;
+    return 0;
+}
+
+i32 tar_set_dir(struct tar_writer *w, const char *name)
+{
+    u_check_params(w != NULL);
+    w->dir[0] = '\0';
+    if (name == NULL)
+        return 0;
+
+    const i32 ret = snprintf(w->dir, sizeof(w->dir), "%s", name);
+    if (ret < 0 || (u64)ret >= sizeof(w->dir)) {
+        s_log_error("The directory name \"%s\" is too long", name);
+        w->dir[0] = '\0';
+        return 1;
+    }
+
+    char dir_name[sizeof(w->dir) + 1];
+    (void) snprintf(dir_name, sizeof(dir_name), "%s/", name);
+    return write_header(w, TAR_TYPE_DIR, dir_name, 0, 0755);
+}
+
+i32 tar_begin_file(struct tar_writer *w, const char *name, u64 size)
+{
+    u_check_params(w != NULL && name != NULL && w->file_left == 0);
+
+    char path[sizeof(w->dir) + 256];
+    const i32 ret = snprintf(path, sizeof(path), "%s%s%s",
+        w->dir, w->dir[0] ? "/" : "", name);
+    if (ret < 0 || (u64)ret >= sizeof(path)) {
+        s_log_error("The entry name \"%s\" is too long", name);
+        return 1;
+    }
+
+    if (write_header(w, TAR_TYPE_FILE, path, size, 0644))
+        return 1;
+
+    w->file_left = size;
+    return 0;
+}
+
+i32 tar_write(struct tar_writer *w, const void *buf, u64 size)
+{
+    u_check_params(w != NULL && size <= w->file_left);
+
+    if (put(w, buf, size))
+        return 1;
+    w->file_left -= size;
+    return 0;
+}
+
+i32 tar_write_range(struct tar_writer *w, i32 in_fd, u64 offset, u64 size,
+    void *buf, u64 buf_size)
+{
+    u_check_params(w != NULL && size <= w->file_left);
+
+    const i64 n_copied = io_copy_range(w->fd, in_fd, offset, size,
+        buf, buf_size);
+    if (n_copied < 0) {
+        s_log_error("Failed to copy into the tar stream: %s",
+            strerror(errno));
+        return 1;
+    }
+
+    w->file_left -= n_copied;
+    w->block_fill = (w->block_fill + n_copied) % TAR_BLOCK_SIZE;
+
+    if ((u64)n_copied != size) {
+        s_log_error("Unexpected end of the input file "
+            "while copying into the tar stream");
+        return 1;
+    }
+    return 0;
+}
+
+i32 tar_end_file(struct tar_writer *w)
+{
+    u_check_params(w != NULL);
+
+    static const u8 zeros[TAR_BLOCK_SIZE] = { 0 };
+    while (w->file_left > 0) {
+        const u64 chunk = u_min(w->file_left, TAR_BLOCK_SIZE);
+        if (put(w, zeros, chunk))
+            return 1;
+        w->file_left -= chunk;
+    }
+
+    return pad_block(w);
+}
+
+i32 tar_writer_finish(struct tar_writer *w)
+{
+    u_check_params(w != NULL && w->file_left == 0);
+
+    static const u8 zeros[TAR_BLOCK_SIZE * 2] = { 0 };
+    return put(w, zeros, sizeof(zeros));
+}
+
+static i32 write_header(struct tar_writer *w, char type, const char *name,
+    u64 size, u32 mode)
+{
+    struct ustar_header h;
+
+    /* Whatever doesn't fit in the ustar header goes into a pax header
+     * right before it, which readers use to override the ustar fields */
+    if (strlen(name) > sizeof(h.name) || size > TAR_MAX_USTAR_SIZE) {
+        if (write_pax_header(w, name, size))
+            return 1;
+    }
+
+    fill_header(&h, type, name, u_min(size, TAR_MAX_USTAR_SIZE), mode,
+        w->mtime);
+    return put(w, &h, sizeof(h));
+}
+
+static i32 write_pax_header(struct tar_writer *w, const char *path, u64 size)
+{
+    char records[1024];
+    u64 len = 0;
+
+    if (strlen(path) > sizeof(((struct ustar_header *)0)->name))
+        len = append_pax_record(records, sizeof(records), len, "path", path);
+
+    if (size > TAR_MAX_USTAR_SIZE) {
+        char size_str[32];
+        (void) snprintf(size_str, sizeof(size_str), "%llu",
+            (unsigned long long)size);
+        len = append_pax_record(records, sizeof(records), len,
+            "size", size_str);
+    }
+
+    struct ustar_header h;
+    fill_header(&h, TAR_TYPE_PAX, "././@PaxHeader", len, 0644, w->mtime);
+    if (put(w, &h, sizeof(h)) || put(w, records, len))
+        return 1;
+    return pad_block(w);
+}
+
+static void fill_header(struct ustar_header *h, char type, const char *name,
+    u64 size, u32 mode, u32 mtime)
+{
+    memset(h, 0, sizeof(struct ustar_header));
+
+    /* Truncated names are overridden by a pax header */
+    memcpy(h->name, name, u_min(strlen(name), sizeof(h->name)));
+    (void) snprintf(h->mode, sizeof(h->mode), "%07o", mode);
+    (void) snprintf(h->uid, sizeof(h->uid), "%07o", 0);
+    (void) snprintf(h->gid, sizeof(h->gid), "%07o", 0);
+    (void) snprintf(h->size, sizeof(h->size), "%011llo",
+        (unsigned long long)size);
+    (void) snprintf(h->mtime, sizeof(h->mtime), "%011o", mtime);
+    h->typeflag = type;
+    memcpy(h->magic, "ustar", sizeof(h->magic)); /* Including the NUL */
+    memcpy(h->version, "00", sizeof(h->version));
+
+    /* The checksum is calculated with its own field set to spaces */
+    memset(h->chksum, ' ', sizeof(h->chksum));
+    u32 sum = 0;
+    const u8 *bytes = (const u8 *)h;
+    for (u32 i = 0; i < sizeof(struct ustar_header); i++)
+        sum += bytes[i];
+    (void) snprintf(h->chksum, sizeof(h->chksum), "%06o", sum);
+    h->chksum[7] = ' ';
+}
+
+/* Appends the record "<length> <key>=<value>\n" to `buf` at `pos`,
+ * where <length> is the length of the whole record (including itself).
+ * Returns the new end of the records. */
+static u64 append_pax_record(char *buf, u64 buf_size, u64 pos,
+    const char *key, const char *value)
+{
+    const u64 payload_len = 1 + strlen(key) + 1 + strlen(value) + 1;
+
+    /* Adding the length can make the length one digit longer */
+    u64 len = payload_len + 1;
+    char len_str[32];
+    while ((u64)snprintf(len_str, sizeof(len_str), "%llu",
+            (unsigned long long)len) + payload_len != len)
+    {
+        len++;
+    }
+
+    const i32 ret = snprintf(buf + pos, buf_size - pos, "%s %s=%s\n",
+        len_str, key, value);
+    s_assert(ret > 0 && (u64)ret == len && pos + len < buf_size,
+        "pax record doesn't fit (ret: %d)", ret);
+    return pos + len;
+}
+
+static i32 put(struct tar_writer *w, const void *buf, u64 size)
+{
+    if (io_write_full(w->fd, buf, size)) {
+        s_log_error("Failed to write the tar stream: %s", strerror(errno));
+        return 1;
+    }
+    w->block_fill = (w->block_fill + size) % TAR_BLOCK_SIZE;
+    return 0;
+}
+
+static i32 pad_block(struct tar_writer *w)
+{
+    static const u8 zeros[TAR_BLOCK_SIZE] = { 0 };
+    if (w->block_fill == 0)
+        return 0;
+    return put(w, zeros, TAR_BLOCK_SIZE - w->block_fill);
+}
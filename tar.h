@@ -0,0 +1,81 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef TAR_H_
+#define TAR_H_
+
+#include <core/int.h>
+#include <stdbool.h>
+
+/* A POSIX tar (ustar, with pax extended headers where ustar isn't enough)
+ * stream writer for `--tar`.
+ *
+ * The stream is written strictly sequentially, so `fd` may be a pipe
+ * or a socket. File contents are copied straight from the input file
+ * with `io_copy_range()` (`splice()`/`sendfile()`) whenever possible.
+ *
+ * A file entry must be completed with `tar_end_file` before
+ * the next one is started. If fewer bytes than announced were written
+ * by then, the rest is filled with zeros, so that the stream stays
+ * readable after a failed read. */
+struct tar_writer {
+    i32 fd;
+
+    /* The modification time of all the entries (the start of the run) */
+    u32 mtime;
+
+    /* Prepended (with a '/') to the names of all the entries; may be empty */
+    char dir[256];
+
+    /* The number of bytes of the current file that are yet to be written */
+    u64 file_left;
+    /* The number of bytes written since the last 512-byte block boundary */
+    u32 block_fill;
+};
+
+/* Initializes `w` to write a stream into `fd` (which isn't closed
+ * by `tar_writer_finish`). Returns 0 on success and non-zero on failure. */
+i32 tar_writer_init(struct tar_writer *w, i32 fd);
+
+/* Adds a directory entry `name`, and makes all the following entries
+ * go into it (or into the top level, if `name` is `NULL`).
+ * Returns 0 on success and non-zero on failure. */
+i32 tar_set_dir(struct tar_writer *w, const char *name);
+
+/* Starts a regular file entry `name` of `size` bytes.
+ * Returns 0 on success and non-zero on failure. */
+i32 tar_begin_file(struct tar_writer *w, const char *name, u64 size);
+
+/* Appends the `size` bytes in `buf` to the current file.
+ * Returns 0 on success and non-zero on failure. */
+i32 tar_write(struct tar_writer *w, const void *buf, u64 size);
+
+/* Appends `size` bytes at `offset` in `in_fd` to the current file,
+ * with `buf` (of `buf_size` bytes) used only if a zero-copy transfer
+ * isn't possible. Returns 0 on success and non-zero on failure
+ * (including the end of `in_fd` being reached too early). */
+i32 tar_write_range(struct tar_writer *w, i32 in_fd, u64 offset, u64 size,
+    void *buf, u64 buf_size);
+
+/* Pads the current file to its announced size and to the block size.
+ * Returns 0 on success and non-zero on failure. */
+i32 tar_end_file(struct tar_writer *w);
+
+/* Writes the end-of-archive marker.
+ * Returns 0 on success and non-zero on failure. */
+i32 tar_writer_finish(struct tar_writer *w);
+
+#endif /* TAR_H_ */
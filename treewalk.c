@@ -0,0 +1,304 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "treewalk.h"
+#include "byteorder.h"
+#include "io.h"
+#include "stats.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/arena.h>
+#include <core/trace.h>
+#include <core/vector.h>
+#include <core/threadpool.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define MODULE_NAME "treewalk"
+
+/* The record format of `getdents64(2)` */
+struct linux_dirent64 {
+    u64 d_ino;
+    i64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct walk_ctx {
+    struct treewalk *tw;
+    struct threadpool *tp;
+    struct threadpool_group group;
+
+    /* The paths found by each thread, indexed by slot */
+    VECTOR(const char *) *found;
+
+    _Atomic u64 n_dirs;
+    _Atomic u64 n_rejected;
+};
+
+struct dir_task {
+    struct walk_ctx *ctx;
+    const char *path;
+};
+
+static struct arena * get_slot_arena(struct treewalk *tw, u32 slot);
+static void submit_dir(struct walk_ctx *ctx, const char *path);
+static void walk_dir(void *arg);
+static u8 get_entry_type(i32 dirfd, const char *name, u8 d_type);
+static i32 compare_paths(const void *a, const void *b);
+
+i32 treewalk_expand(struct treewalk *tw, struct threadpool *tp,
+    VECTOR(const char *) *paths_p)
+{
+    u_check_params(tw != NULL && tp != NULL &&
+        paths_p != NULL && *paths_p != NULL);
+
+    if (tw->arenas == NULL) {
+        tw->n_slots = threadpool_get_n_workers(tp) + 1;
+        tw->arenas = calloc(tw->n_slots, sizeof(struct arena *));
+        s_assert(tw->arenas != NULL, "calloc() failed for the arena table");
+    }
+    s_assert(tw->n_slots == threadpool_get_n_workers(tp) + 1,
+        "the tree walker can't switch thread pools");
+
+    struct walk_ctx ctx = {
+        .tw = tw,
+        .tp = tp,
+        .group = THREADPOOL_GROUP_INIT,
+    };
+    ctx.found = calloc(tw->n_slots, sizeof(VECTOR(const char *)));
+    s_assert(ctx.found != NULL, "calloc() failed for the result table");
+    for (u32 i = 0; i < tw->n_slots; i++)
+        ctx.found[i] = vector_new(const char *);
+
+    VECTOR(const char *) in = *paths_p;
+    VECTOR(const char *) out = vector_new(const char *);
+    i32 ret = 1;
+
+    for (u64 i = 0; i < vector_size(in); i++) {
+        struct stat st;
+        stats_add(STATS_SYSCALLS, 1);
+        if (stat(in[i], &st) || !S_ISDIR(st.st_mode)) {
+            /* Not a directory - any errors are reported when it's opened */
+            vector_push_back(&out, in[i]);
+            continue;
+        }
+
+        if (get_slot_arena(tw, threadpool_get_slot(tp)) == NULL)
+            goto out;
+
+        trace_begin("walk", "directory tree", in[i]);
+        s_log_verbose("Walking \"%s\"...", in[i]);
+        submit_dir(&ctx, in[i]);
+        threadpool_group_wait(tp, &ctx.group);
+        trace_end("walk", "directory tree");
+
+        /* Threads finish in random order, so sort for stable output */
+        const u64 start = vector_size(out);
+        for (u32 j = 0; j < tw->n_slots; j++) {
+            vector_append_range(&out, ctx.found[j],
+                ctx.found[j] + vector_size(ctx.found[j]));
+            vector_clear_nozero(&ctx.found[j]);
+        }
+        qsort(out + start, vector_size(out) - start, sizeof(const char *),
+            compare_paths);
+
+        if (vector_size(out) == start)
+            s_log_warn("No MTK partition files found in \"%s\"", in[i]);
+    }
+
+    s_log_verbose("Walked %llu directories: %llu files found, "
+        "%llu rejected by the magic probe",
+        (unsigned long long)atomic_load(&ctx.n_dirs),
+        (unsigned long long)vector_size(out),
+        (unsigned long long)atomic_load(&ctx.n_rejected));
+
+    vector_destroy(paths_p);
+    *paths_p = out;
+    out = NULL;
+    ret = 0;
+
+out:
+    if (out != NULL)
+        vector_destroy(&out);
+    for (u32 i = 0; i < tw->n_slots; i++)
+        vector_destroy(&ctx.found[i]);
+    u_nfree(&ctx.found);
+    return ret;
+}
+
+void treewalk_destroy(struct treewalk *tw)
+{
+    if (tw == NULL || tw->arenas == NULL)
+        return;
+
+    for (u32 i = 0; i < tw->n_slots; i++)
+        arena_destroy(&tw->arenas[i]);
+    u_nfree(&tw->arenas);
+    tw->n_slots = 0;
+}
+
+bool treewalk_probe_file(i32 dirfd, const char *name)
+{
+    const i32 fd = openat(dirfd, name,
+        O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY);
+    stats_add(STATS_SYSCALLS, 1);
+    if (fd < 0)
+        return false;
+
+    u32 magic = 0;
+    const i64 n_read = io_pread_full(fd, &magic, sizeof(magic), 0);
+    (void) close(fd);
+    stats_add(STATS_SYSCALLS, 1);
+
+    return n_read == sizeof(magic) &&
+        mtk_part_detect_magic_byte_order(magic) != MTK_PART_BYTE_ORDER_UNKNOWN;
+}
+
+static struct arena * get_slot_arena(struct treewalk *tw, u32 slot)
+{
+    if (tw->arenas[slot] == NULL) {
+        tw->arenas[slot] = arena_create(0, 0);
+        if (tw->arenas[slot] == NULL)
+            s_log_error("Failed to create the path arena");
+    }
+    return tw->arenas[slot];
+}
+
+/* Must be called from the pool or the thread waiting on it */
+static void submit_dir(struct walk_ctx *ctx, const char *path)
+{
+    struct arena *arena =
+        ctx->tw->arenas[threadpool_get_slot(ctx->tp)];
+
+    struct dir_task *t = arena_alloc(arena, sizeof(struct dir_task));
+    s_assert(t != NULL, "arena_alloc() failed for a directory task");
+    t->ctx = ctx;
+    t->path = path;
+
+    threadpool_submit(ctx->tp, &ctx->group, walk_dir, t);
+}
+
+static void walk_dir(void *arg)
+{
+    const struct dir_task *t = arg;
+    struct walk_ctx *ctx = t->ctx;
+    const u32 slot = threadpool_get_slot(ctx->tp);
+
+    struct arena *arena = get_slot_arena(ctx->tw, slot);
+    if (arena == NULL)
+        return;
+
+    const i32 dirfd = open(t->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    stats_add(STATS_SYSCALLS, 1);
+    if (dirfd < 0) {
+        s_log_warn("Failed to open directory \"%s\": %s",
+            t->path, strerror(errno));
+        return;
+    }
+    atomic_fetch_add_explicit(&ctx->n_dirs, 1, memory_order_relaxed);
+    stats_add(STATS_DIRS_WALKED, 1);
+
+    const size_t path_len = strlen(t->path);
+    const char *sep = (path_len > 0 && t->path[path_len - 1] == '/') ? "" : "/";
+
+    /* u64 to keep the records aligned */
+    u64 buf[TREEWALK_DENTS_BUF_SIZE / sizeof(u64)];
+    for (;;) {
+        const long n = syscall(SYS_getdents64, dirfd, buf, sizeof(buf));
+        stats_add(STATS_SYSCALLS, 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            s_log_warn("Failed to read directory \"%s\": %s",
+                t->path, strerror(errno));
+            break;
+        }
+        if (n == 0)
+            break;
+
+        for (long off = 0; off < n;) {
+            const struct linux_dirent64 *d =
+                (const struct linux_dirent64 *)((const u8 *)buf + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (!strcmp(name, ".") || !strcmp(name, ".."))
+                continue;
+
+            const u8 type = get_entry_type(dirfd, name, d->d_type);
+            if (type == DT_DIR) {
+                const char *sub = arena_sprintf(arena, "%s%s%s",
+                    t->path, sep, name);
+                s_assert(sub != NULL, "arena_sprintf() failed for a path");
+                submit_dir(ctx, sub);
+            } else if (type == DT_REG) {
+                if (!treewalk_probe_file(dirfd, name)) {
+                    atomic_fetch_add_explicit(&ctx->n_rejected, 1,
+                        memory_order_relaxed);
+                    stats_add(STATS_FILES_REJECTED, 1);
+                    continue;
+                }
+
+                const char *file = arena_sprintf(arena, "%s%s%s",
+                    t->path, sep, name);
+                s_assert(file != NULL, "arena_sprintf() failed for a path");
+                vector_push_back(&ctx->found[slot], file);
+            }
+        }
+    }
+
+    (void) close(dirfd);
+    stats_add(STATS_SYSCALLS, 1);
+}
+
+static u8 get_entry_type(i32 dirfd, const char *name, u8 d_type)
+{
+    if (d_type != DT_UNKNOWN)
+        return d_type;
+
+    /* Only ask for the file type, which is the cheapest thing to get */
+    struct statx stx;
+    stats_add(STATS_SYSCALLS, 1);
+    if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+            STATX_TYPE, &stx))
+    {
+        return DT_UNKNOWN;
+    }
+
+    if (S_ISDIR(stx.stx_mode))
+        return DT_DIR;
+    else if (S_ISREG(stx.stx_mode))
+        return DT_REG;
+    else
+        return DT_UNKNOWN;
+}
+
+static i32 compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
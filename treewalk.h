@@ -0,0 +1,66 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef TREEWALK_H_
+#define TREEWALK_H_
+
+#include <core/int.h>
+#include <core/vector.h>
+#include <core/arena.h>
+#include <core/threadpool.h>
+#include <stdbool.h>
+
+/* Recursive directory ingestion (`-r`, `--recursive`).
+ *
+ * Every directory is a separate task on the thread pool, so big trees
+ * are walked in parallel. Directories are read with raw `getdents64()`
+ * calls into a large buffer, and the entry types come straight from
+ * the directory entries, so most files never need a `stat()`
+ * (`statx()` with just `STATX_TYPE` is the fallback for file systems
+ * that don't fill in `d_type`).
+ *
+ * Regular files are then probed by reading just their first 4 bytes
+ * (relative to the already open directory, with `openat()`),
+ * and only those that start with an MTK partition magic (of either
+ * byte order) are kept. Symbolic links are not followed. */
+
+/* The size of the buffer for a single `getdents64()` call */
+#define TREEWALK_DENTS_BUF_SIZE (32 * 1024)
+
+struct treewalk {
+    /* Per-thread storage for the found paths and the directory tasks,
+     * indexed by `threadpool_get_slot()`. Lives until `treewalk_destroy`. */
+    u32 n_slots;
+    struct arena **arenas;
+};
+
+/* Replaces every directory in `*paths_p` with the MTK partition files
+ * found anywhere under it (sorted by path), walking it on `tp`.
+ * Anything else in `*paths_p` is kept as it is.
+ *
+ * The new paths are owned by `tw`. Directories (or files) that can't be
+ * read are skipped with a warning.
+ * Returns 0 on success and non-zero on failure. */
+i32 treewalk_expand(struct treewalk *tw, struct threadpool *tp,
+    VECTOR(const char *) *paths_p);
+
+void treewalk_destroy(struct treewalk *tw);
+
+/* Returns whether the regular file `name` (relative to `dirfd`)
+ * starts with an MTK partition magic. Reads just the first 4 bytes. */
+bool treewalk_probe_file(i32 dirfd, const char *name);
+
+#endif /* TREEWALK_H_ */
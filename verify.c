@@ -0,0 +1,368 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#define VERIFY_PROBLEM_LIST_DEF__
+#include "verify.h"
+#undef VERIFY_PROBLEM_LIST_DEF__
+#include "mtkparthdr.h"
+#include "byteorder.h"
+#include "io.h"
+#include "stats.h"
+#include "bufpool.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <core/trace.h>
+#include <core/vector.h>
+#include <core/threadpool.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MODULE_NAME "verify"
+
+/* The number of files that are open and verified at the same time */
+#define VERIFY_BATCH_SIZE 256
+
+/* The size of the buffer used to read the partition bodies */
+#define VERIFY_BODY_BUF_SIZE BUFPOOL_BUF_SIZE
+
+/* The largest plausible `size_alignment_bytes` (real images use 16) */
+#define VERIFY_MAX_ALIGNMENT (1U << 20)
+
+#define X_(name, desc) [VERIFY_PROBLEM_##name##_BIT_] = desc,
+static const char *const g_problem_strings[VERIFY_N_PROBLEMS_] = {
+    VERIFY_PROBLEM_LIST
+};
+#undef X_
+#undef VERIFY_PROBLEM_LIST
+
+struct verify_entry {
+    u64 hdr_offset;
+    union mtk_partition_header raw; /* As stored in the file */
+    struct mtk_partition_header_data hdr; /* In host byte order */
+
+    /* Problems found in this entry (`VERIFY_PROBLEM_...` bits).
+     * Written first by the walker, and then by exactly one worker. */
+    u32 problems;
+};
+
+struct verify_file {
+    const char *path;
+    i32 fd;
+    u64 file_size;
+
+    VECTOR(struct verify_entry) entries;
+
+    /* Problems with the chain as a whole */
+    u32 problems;
+    u64 problem_offset;
+    i32 open_errno;
+};
+
+struct verify_task {
+    struct verify_file *file;
+    u32 entry_index;
+};
+
+struct verify_batch {
+    struct verify_file *files;
+    struct verify_task *tasks;
+};
+
+static void walk_file(void *arg, u64 index, u32 slot);
+static void check_entry(void *arg, u64 index, u32 slot);
+static u32 report_file(const struct verify_file *f);
+static void run_batch(struct verify_batch *batch, u32 batch_size,
+    struct threadpool *tp);
+static void destroy_file(struct verify_file *f);
+
+u32 verify_files(VECTOR(const char *) paths, struct threadpool *tp)
+{
+    u32 n_failed = 0;
+    const u32 n_paths = vector_size(paths);
+
+    struct verify_batch batch = { 0 };
+
+    for (u32 batch_start = 0; batch_start < n_paths;
+        batch_start += VERIFY_BATCH_SIZE)
+    {
+        const u32 batch_size = u_min(VERIFY_BATCH_SIZE, n_paths - batch_start);
+
+        struct verify_file *files = calloc(batch_size,
+            sizeof(struct verify_file));
+        s_assert(files != NULL, "calloc() failed for the file batch");
+        for (u32 i = 0; i < batch_size; i++) {
+            files[i].path = paths[batch_start + i];
+            files[i].fd = -1;
+        }
+
+        batch.files = files;
+        run_batch(&batch, batch_size, tp);
+
+        /* 3. Report the results in the original order */
+        for (u32 i = 0; i < batch_size; i++) {
+            n_failed += report_file(&files[i]);
+            destroy_file(&files[i]);
+        }
+        u_nfree(&files);
+    }
+
+    return n_failed;
+}
+
+u32 verify_file_problems(const char *path, struct threadpool *tp)
+{
+    u_check_params(path != NULL && tp != NULL);
+
+    struct verify_file file = { .path = path, .fd = -1 };
+    struct verify_batch batch = { .files = &file };
+
+    run_batch(&batch, 1, tp);
+
+    u32 problems = file.problems;
+    for (u64 i = 0; i < vector_size(file.entries); i++)
+        problems |= file.entries[i].problems;
+
+    destroy_file(&file);
+
+    return problems;
+}
+
+const char * verify_problem_string(enum verify_problem_bit bit)
+{
+    u_check_params(bit < VERIFY_N_PROBLEMS_);
+    return g_problem_strings[bit];
+}
+
+static void run_batch(struct verify_batch *batch, u32 batch_size,
+    struct threadpool *tp)
+{
+    /* 1. Walk the chains (cheap checks), in parallel across files */
+    threadpool_parallel_for(tp, batch_size, 1, walk_file, batch);
+
+    /* 2. Run the expensive checks, in parallel across all entries */
+    VECTOR(struct verify_task) tasks = vector_new(struct verify_task);
+    u64 n_tasks = 0;
+    for (u32 i = 0; i < batch_size; i++)
+        n_tasks += vector_size(batch->files[i].entries);
+    vector_reserve(&tasks, n_tasks);
+    for (u32 i = 0; i < batch_size; i++) {
+        for (u32 j = 0; j < vector_size(batch->files[i].entries); j++) {
+            vector_push_back(&tasks, (struct verify_task) {
+                .file = &batch->files[i],
+                .entry_index = j,
+            });
+        }
+    }
+    /* One entry per task, as the body sizes vary wildly
+     * (a single huge image next to a bunch of tiny ones) */
+    batch->tasks = tasks;
+    threadpool_parallel_for(tp, vector_size(tasks), 1, check_entry, batch);
+    batch->tasks = NULL;
+    vector_destroy(&tasks);
+}
+
+static void destroy_file(struct verify_file *f)
+{
+    if (f->fd >= 0)
+        (void) close(f->fd);
+    f->fd = -1;
+    if (f->entries != NULL)
+        vector_destroy(&f->entries);
+}
+
+static void walk_file(void *arg, u64 index, u32 slot)
+{
+    (void) slot;
+    struct verify_file *f = &((struct verify_batch *)arg)->files[index];
+    f->entries = vector_new(struct verify_entry);
+
+    trace_begin("file", "verify walk", f->path);
+
+    f->fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    stats_add(STATS_SYSCALLS, 1);
+    const i64 file_size = f->fd >= 0 ? io_get_size(f->fd) : -1;
+    if (file_size < 0) {
+        f->open_errno = errno;
+        f->problems |= VERIFY_PROBLEM_OPEN;
+        trace_end("file", "verify walk");
+        return;
+    }
+    f->file_size = file_size;
+    stats_add(STATS_FILES_PROCESSED, 1);
+
+    u64 offset = 0;
+    bool chain = true;
+    mtk_part_header_parser_t parse_header = NULL;
+    while (chain) {
+        struct verify_entry e = { .hdr_offset = offset };
+
+        const i64 n_read = io_pread_full(f->fd, e.raw.buf_,
+            MTK_PART_HEADER_SIZE, offset);
+        if (n_read != MTK_PART_HEADER_SIZE) {
+            /* Ran out of headers before the end of the list */
+            f->problems |= VERIFY_PROBLEM_TRUNCATED;
+            f->problem_offset = offset;
+            break;
+        }
+
+        /* Same as when dumping - the first header decides the byte order */
+        if (parse_header == NULL) {
+            const enum mtk_part_byte_order order =
+                mtk_part_detect_byte_order(&e.raw);
+            if (order != MTK_PART_BYTE_ORDER_UNKNOWN)
+                parse_header = mtk_part_get_header_parser(order);
+        }
+        if (parse_header != NULL)
+            parse_header(&e.hdr, &e.raw);
+
+        if (parse_header == NULL || e.hdr.magic != MTK_PART_MAGIC) {
+            f->problems |= VERIFY_PROBLEM_BAD_MAGIC;
+            f->problem_offset = offset;
+            break;
+        }
+        stats_add(STATS_HEADERS, 1);
+
+        const struct mtk_partition_header_data *hdr = &e.hdr;
+        const bool has_ext = hdr->ext.magic == MTK_PART_EXT_MAGIC;
+        const u64 body_offset = offset + MTK_PART_HEADER_SIZE;
+        const u64 body_size = get_full_aligned_part_size(hdr);
+
+        if (has_ext && hdr->ext.hdr_size != MTK_PART_HEADER_SIZE)
+            e.problems |= VERIFY_PROBLEM_HDR_SIZE;
+
+        /* The bodies can still be found with any alignment,
+         * so this doesn't end the chain */
+        const u32 align = hdr->ext.size_alignment_bytes;
+        if (has_ext && ((align & (align - 1)) != 0 ||
+            align > VERIFY_MAX_ALIGNMENT))
+        {
+            e.problems |= VERIFY_PROBLEM_ALIGNMENT;
+        }
+
+        if (body_size > f->file_size - body_offset ||
+            body_offset > f->file_size)
+        {
+            if (has_ext && hdr->ext.part_size_hi != 0)
+                e.problems |= VERIFY_PROBLEM_SIZE_HI;
+            else
+                e.problems |= VERIFY_PROBLEM_BODY_BOUNDS;
+        }
+
+        vector_push_back(&f->entries, e);
+
+        /* Without the extension there's no `is_image_list_end`,
+         * so (just like when dumping) such an entry ends the chain */
+        if (!has_ext || hdr->ext.is_image_list_end ||
+            (e.problems & (VERIFY_PROBLEM_SIZE_HI
+                | VERIFY_PROBLEM_BODY_BOUNDS)))
+        {
+            chain = false;
+        }
+        offset = body_offset + body_size;
+    }
+
+    trace_end("file", "verify walk");
+}
+
+static void check_entry(void *arg, u64 index, u32 slot)
+{
+    struct verify_batch *batch = arg;
+    const struct verify_task *task = &batch->tasks[index];
+    struct verify_entry *e = &task->file->entries[task->entry_index];
+    const struct verify_file *f = task->file;
+    (void) slot;
+
+    trace_begin("header", "verify entry", f->path);
+
+    /* Padding scan */
+    for (u32 i = MTK_PART_HEADER_DATA_SIZE; i < MTK_PART_HEADER_SIZE; i++) {
+        if (e->raw.buf_[i] != 0xFF) {
+            e->problems |= VERIFY_PROBLEM_PADDING;
+            break;
+        }
+    }
+
+    /* Body check - read through the whole body
+     * (unless we already know that it's out of bounds) */
+    if (!(e->problems & (VERIFY_PROBLEM_BODY_BOUNDS | VERIFY_PROBLEM_SIZE_HI)))
+    {
+        u64 offset = e->hdr_offset + MTK_PART_HEADER_SIZE;
+        u64 left = get_full_aligned_part_size(&e->hdr);
+
+        u8 *buf = left > 0 ? bufpool_get() : NULL;
+        if (buf == NULL && left > 0)
+            e->problems |= VERIFY_PROBLEM_BODY_READ;
+
+        while (buf != NULL && left > 0) {
+            const u64 chunk = u_min(left, VERIFY_BODY_BUF_SIZE);
+            const i64 ret = io_pread_full(f->fd, buf, chunk, offset);
+            if (ret < 0 || (u64)ret != chunk) {
+                e->problems |= VERIFY_PROBLEM_BODY_READ;
+                break;
+            }
+            offset += chunk;
+            left -= chunk;
+        }
+        bufpool_put(buf);
+    }
+
+    trace_end("header", "verify entry");
+}
+
+static u32 report_file(const struct verify_file *f)
+{
+    u32 all_problems = f->problems;
+    for (u32 i = 0; i < vector_size(f->entries); i++)
+        all_problems |= f->entries[i].problems;
+
+    if (all_problems == 0) {
+        s_log_info("PASS %s (%llu entries)", f->path,
+            (unsigned long long)vector_size(f->entries));
+        return 0;
+    }
+
+    s_log_info("FAIL %s", f->path);
+    if (f->problems & VERIFY_PROBLEM_OPEN) {
+        s_log_info("    %s: %s", g_problem_strings[VERIFY_PROBLEM_OPEN_BIT_],
+            strerror(f->open_errno));
+        return 1;
+    }
+    for (u32 i = 0; i < vector_size(f->entries); i++) {
+        const struct verify_entry *e = &f->entries[i];
+        for (u32 bit = 0; bit < VERIFY_N_PROBLEMS_; bit++) {
+            if (e->problems & (1U << bit)) {
+                s_log_info("    entry %u (\"%.32s\" @ %#llx): %s", i,
+                    e->hdr.part_name,
+                    (unsigned long long)e->hdr_offset,
+                    g_problem_strings[bit]);
+            }
+        }
+    }
+    for (u32 bit = 0; bit < VERIFY_N_PROBLEMS_; bit++) {
+        if (f->problems & (1U << bit)) {
+            s_log_info("    chain (@ %#llx): %s",
+                (unsigned long long)f->problem_offset, g_problem_strings[bit]);
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,80 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef VERIFY_H_
+#define VERIFY_H_
+
+#include <core/int.h>
+#include <core/vector.h>
+#include <core/threadpool.h>
+
+/* Chain validation (`--verify`).
+ *
+ * Every file is first walked header by header (one `pread()` per header),
+ * checking the cheap, structural properties of each entry.
+ * The expensive checks - the header padding scans and reading through
+ * the partition bodies - are then run in parallel
+ * across all the entries of all the files in a batch,
+ * one task per entry, so that idle threads steal the remaining entries
+ * while one thread is stuck reading a huge body.
+ *
+ * For every file, a single `PASS <path>` or `FAIL <path>` line is logged,
+ * followed (on failure) by a description of each problem found. */
+
+#define VERIFY_PROBLEM_LIST                                                 \
+    X_(OPEN, "failed to open or stat the file")                             \
+    X_(BAD_MAGIC, "invalid header magic")                                   \
+    X_(TRUNCATED, "the chain ends without an `is_image_list_end` entry")    \
+    X_(HDR_SIZE, "`hdr_size` is not MTK_PART_HEADER_SIZE")                  \
+    X_(ALIGNMENT, "`size_alignment_bytes` is not a power of two "           \
+        "of at most 1 MiB")                                                 \
+    X_(SIZE_HI, "the 64-bit size (`part_size_hi`) exceeds the file size")   \
+    X_(BODY_BOUNDS, "the partition body extends past the end of the file")  \
+    X_(PADDING, "the unused header bytes are not all 0xFF")                 \
+    X_(BODY_READ, "failed to read the partition body")                      \
+
+#define X_(name, desc) VERIFY_PROBLEM_##name##_BIT_,
+enum verify_problem_bit {
+    VERIFY_PROBLEM_LIST
+    VERIFY_N_PROBLEMS_
+};
+#undef X_
+
+#define X_(name, desc) \
+    VERIFY_PROBLEM_##name = 1 << VERIFY_PROBLEM_##name##_BIT_,
+enum verify_problem {
+    VERIFY_PROBLEM_LIST
+};
+#undef X_
+
+/* Verifies all the files in `paths`, running the checks on `tp`
+ * (the calling thread helps out while waiting).
+ * Returns the number of files that failed verification. */
+u32 verify_files(VECTOR(const char *) paths, struct threadpool *tp);
+
+/* Verifies the single file `path` on `tp` without logging anything.
+ * Returns the `VERIFY_PROBLEM_...` bits of all the problems found
+ * (so 0 means that the file passed). */
+u32 verify_file_problems(const char *path, struct threadpool *tp);
+
+/* Returns the description of the problem `bit` */
+const char * verify_problem_string(enum verify_problem_bit bit);
+
+#ifndef VERIFY_PROBLEM_LIST_DEF__
+#undef VERIFY_PROBLEM_LIST
+#endif /* VERIFY_PROBLEM_LIST_DEF__ */
+
+#endif /* VERIFY_H_ */
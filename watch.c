@@ -0,0 +1,281 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#define _GNU_SOURCE
+#include "watch.h"
+#include "treewalk.h"
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+#define MODULE_NAME "watch"
+
+/* The size of the buffer for reading inotify events */
+#define WATCH_EVENT_BUF_SIZE (16 * 1024)
+
+#define WATCH_EVENT_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR     \
+    | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct pending_file {
+    char name[NAME_MAX + 1];
+    u64 deadline_ns;
+};
+
+struct watcher {
+    const char *dir;
+    i32 dirfd;
+    i32 inotify_fd;
+    i32 signal_fd;
+
+    watch_file_fn_t fn;
+    void *arg;
+
+    /* Files waiting for their debounce period, in order of arrival */
+    struct pending_file *pending;
+    u32 n_pending;
+
+    u64 n_processed;
+    u64 n_ignored;
+};
+
+static u64 now_ns(void);
+static i32 read_events(struct watcher *w);
+static void queue_file(struct watcher *w, const char *name);
+static void process_due(struct watcher *w, u64 now);
+static void process_pending(struct watcher *w, u32 index);
+
+i32 watch_dir(const char *dir, watch_file_fn_t fn, void *arg)
+{
+    u_check_params(dir != NULL && fn != NULL);
+
+    struct watcher w = {
+        .dir = dir,
+        .dirfd = -1,
+        .inotify_fd = -1,
+        .signal_fd = -1,
+        .fn = fn,
+        .arg = arg,
+    };
+    i32 ret = 1;
+
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &signals, &old_signals)) {
+        s_log_error("Failed to block SIGINT and SIGTERM");
+        return 1;
+    }
+
+    w.dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (w.dirfd < 0) {
+        s_log_error("Failed to open the watched directory \"%s\": %s",
+            dir, strerror(errno));
+        goto out;
+    }
+
+    w.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w.inotify_fd < 0) {
+        s_log_error("Failed to initialize inotify: %s", strerror(errno));
+        goto out;
+    }
+    if (inotify_add_watch(w.inotify_fd, dir, WATCH_EVENT_MASK) < 0) {
+        s_log_error("Failed to watch \"%s\": %s", dir, strerror(errno));
+        goto out;
+    }
+
+    w.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (w.signal_fd < 0) {
+        s_log_error("Failed to create the signalfd: %s", strerror(errno));
+        goto out;
+    }
+
+    w.pending = calloc(WATCH_MAX_PENDING, sizeof(struct pending_file));
+    s_assert(w.pending != NULL, "calloc() failed for the pending file queue");
+
+    s_log_info("Watching \"%s\" for new files (Ctrl+C to stop)...", dir);
+
+    for (;;) {
+        /* Sleep until the next file is due (or forever) */
+        i32 timeout_ms = -1;
+        const u64 now = now_ns();
+        for (u32 i = 0; i < w.n_pending; i++) {
+            const u64 left_ns = w.pending[i].deadline_ns > now ?
+                w.pending[i].deadline_ns - now : 0;
+            const i32 left_ms = (i32)((left_ns + 999999) / 1000000);
+            if (timeout_ms < 0 || left_ms < timeout_ms)
+                timeout_ms = left_ms;
+        }
+
+        struct pollfd pfds[2] = {
+            { .fd = w.inotify_fd, .events = POLLIN },
+            { .fd = w.signal_fd, .events = POLLIN },
+        };
+        if (poll(pfds, 2, timeout_ms) < 0) {
+            if (errno == EINTR)
+                continue;
+            s_log_error("poll() failed: %s", strerror(errno));
+            goto out;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            if (read(w.signal_fd, &si, sizeof(si)) == sizeof(si))
+                s_log_info("Got %s, stopping", strsignal(si.ssi_signo));
+            break;
+        }
+
+        if ((pfds[0].revents & POLLIN) && read_events(&w))
+            goto out;
+
+        process_due(&w, now_ns());
+    }
+
+    s_log_verbose("Processed %llu new files (%llu ignored, %u still pending)",
+        (unsigned long long)w.n_processed, (unsigned long long)w.n_ignored,
+        w.n_pending);
+    ret = 0;
+
+out:
+    u_nfree(&w.pending);
+    if (w.signal_fd >= 0) (void) close(w.signal_fd);
+    if (w.inotify_fd >= 0) (void) close(w.inotify_fd);
+    if (w.dirfd >= 0) (void) close(w.dirfd);
+    (void) pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    return ret;
+}
+
+static u64 now_ns(void)
+{
+    struct timespec ts = { 0 };
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+static i32 read_events(struct watcher *w)
+{
+    /* u64 to keep the events aligned */
+    u64 buf[WATCH_EVENT_BUF_SIZE / sizeof(u64)];
+
+    for (;;) {
+        const ssize_t n = read(w->inotify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return 0;
+        if (n <= 0) {
+            s_log_error("Failed to read inotify events: %s",
+                n < 0 ? strerror(errno) : "end of file");
+            return 1;
+        }
+
+        for (ssize_t off = 0; off < n;) {
+            const struct inotify_event *ev =
+                (const struct inotify_event *)((const u8 *)buf + off);
+            off += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                s_log_warn("The inotify queue overflowed; "
+                    "some new files may have been missed");
+                continue;
+            }
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                s_log_error("The watched directory \"%s\" was removed "
+                    "or moved away", w->dir);
+                return 1;
+            }
+            if ((ev->mask & IN_ISDIR) || ev->len == 0)
+                continue;
+
+            queue_file(w, ev->name);
+        }
+    }
+}
+
+static void queue_file(struct watcher *w, const char *name)
+{
+    const u64 deadline = now_ns() + WATCH_DEBOUNCE_MS * 1000000ULL;
+
+    /* Still being written - start the debounce period over */
+    for (u32 i = 0; i < w->n_pending; i++) {
+        if (!strcmp(w->pending[i].name, name)) {
+            w->pending[i].deadline_ns = deadline;
+            return;
+        }
+    }
+
+    /* The queue is full - make room by not waiting for the oldest file */
+    if (w->n_pending == WATCH_MAX_PENDING) {
+        s_log_debug("Too many pending files; processing \"%s\" early",
+            w->pending[0].name);
+        process_pending(w, 0);
+    }
+
+    struct pending_file *p = &w->pending[w->n_pending++];
+    (void) snprintf(p->name, sizeof(p->name), "%s", name);
+    p->deadline_ns = deadline;
+    s_log_debug("New file \"%s\" (%u pending)", name, w->n_pending);
+}
+
+static void process_due(struct watcher *w, u64 now)
+{
+    u32 i = 0;
+    while (i < w->n_pending) {
+        if (w->pending[i].deadline_ns <= now)
+            process_pending(w, i);
+        else
+            i++;
+    }
+}
+
+/* Removes the `index`-th file from the queue and processes it */
+static void process_pending(struct watcher *w, u32 index)
+{
+    struct pending_file p = w->pending[index];
+    memmove(&w->pending[index], &w->pending[index + 1],
+        (w->n_pending - index - 1) * sizeof(struct pending_file));
+    w->n_pending--;
+
+    /* Also filters out files that were deleted or renamed in the meantime */
+    if (!treewalk_probe_file(w->dirfd, p.name)) {
+        s_log_verbose("Ignoring \"%s\" (not an MTK partition file)", p.name);
+        w->n_ignored++;
+        return;
+    }
+
+    char path[PATH_MAX];
+    const i32 len = snprintf(path, sizeof(path), "%s/%s", w->dir, p.name);
+    if (len < 0 || (u32)len >= sizeof(path)) {
+        s_log_warn("The path of \"%s\" is too long; skipping it", p.name);
+        return;
+    }
+
+    if (w->fn(w->arg, path))
+        s_log_warn("Failed to process \"%s\"", path);
+    w->n_processed++;
+}
@@ -0,0 +1,53 @@
+/* mtkpartdump - Mediatek partition dump tool
+ * Copyright (C) 2025 Jan Sołtan <jsoltan226@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include <core/int.h>
+
+/* Watch-folder mode (`--watch DIR`).
+ *
+ * New files are picked up with inotify as soon as they are completely
+ * written (`IN_CLOSE_WRITE`) or moved into the directory (`IN_MOVED_TO`).
+ * Since writers often close and reopen a file a few times, every file
+ * is only processed once there have been no events for it for
+ * `WATCH_DEBOUNCE_MS`. Files that don't start with an MTK partition magic
+ * are ignored.
+ *
+ * At most `WATCH_MAX_PENDING` files can wait for their debounce period
+ * at the same time; when a new file arrives with the queue full,
+ * the longest-waiting file is processed right away to make room.
+ *
+ * The watcher runs until it gets `SIGINT` or `SIGTERM`
+ * (received with a `signalfd`, so nothing is interrupted mid-file). */
+
+/* How long a file must stay untouched before it's processed */
+#define WATCH_DEBOUNCE_MS 500
+
+/* The maximum number of files waiting for their debounce period */
+#define WATCH_MAX_PENDING 1024
+
+/* Called for every new file in the watched directory.
+ * Returns 0 on success and non-zero on failure (which is only logged). */
+typedef i32 (*watch_file_fn_t)(void *arg, const char *path);
+
+/* Watches `dir`, calling `fn(arg, <path of the new file>)` for every
+ * new file, until the process receives `SIGINT` or `SIGTERM`.
+ * Returns 0 when stopped by a signal and non-zero on failure. */
+i32 watch_dir(const char *dir, watch_file_fn_t fn, void *arg);
+
+#endif /* WATCH_H_ */